@@ -230,7 +230,7 @@ OBJECTS = $(SOURCES:.cpp=.o)
 EXAMPLES_SRC=$(wildcard examples/*.cpp)
 EXAMPLES=$(EXAMPLES_SRC:.cpp=.exe)
 
-CXXFLAGS= -std=c++11
+CXXFLAGS= -std=c++11 -pthread
 
 # Directories
 '  >> ./Makefile
@@ -250,7 +250,7 @@ LIBnuSQUIDS=$(PATH_nuSQUIDS)/lib
 # FLAGS
 CFLAGS= -O3 -fPIC -I$(INCnuSQUIDS) $(SQUIDS_CFLAGS) $(GSL_CFLAGS) $(HDF5_CFLAGS)
 LDFLAGS= -Wl,-rpath -Wl,$(LIBnuSQUIDS) -L$(LIBnuSQUIDS) -lnuSQuIDS
-LDFLAGS+= $(SQUIDS_LDFLAGS) $(GSL_LDFLAGS) $(HDF5_LDFLAGS)
+LDFLAGS+= $(SQUIDS_LDFLAGS) $(GSL_LDFLAGS) $(HDF5_LDFLAGS) -pthread
 
 # Project files
 NAME=nuSQuIDS
@@ -341,7 +341,7 @@ INCnuSQUIDS=$(PATH_nuSQUIDS)/inc
 
 LDFLAGS+= -L$(LIBnuSQUIDS) -lnuSQuIDS
 INCCFLAGS+= -I$(INCnuSQUIDS)
-CXXFLAGS= -O3 -fPIC -std=c++11 $(INCCFLAGS)
+CXXFLAGS= -O3 -fPIC -std=c++11 -pthread $(INCCFLAGS)
 ' >> resources/python/src/Makefile
 
 echo '
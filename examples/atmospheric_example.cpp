@@ -85,6 +85,9 @@ int main()
   std::cout << "End: setting initial state." << std::endl;
 
   nus_atm.Set_ProgressBar(true);
+  // zenith bins are independent, so they can be evolved
+  // concurrently using all the available cores.
+  nus_atm.Set_NumThreads(0);
   nus_atm.EvolveState();
   // we can save the current state in HDF5 format
   // for future use.
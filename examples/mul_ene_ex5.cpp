@@ -41,7 +41,6 @@ class nuSQUIDSNSI: public nuSQUIDS {
     squids::SU_vector NSI;
     std::vector<squids::SU_vector> NSI_evol;
     std::unique_ptr<double[]> hiBuffer;
-    double HI_prefactor;
     // nsi parameters
     double epsilon_mutau;
 
@@ -68,24 +67,15 @@ class nuSQUIDSNSI: public nuSQUIDS {
     }
 
     squids::SU_vector HI(unsigned int ei,unsigned int index_rho) const{
-      double ye = body->ye(*track);
-      double density = body->density(*track);
-
-      double CC = HI_prefactor*density*ye;
-      double NC;
-
-      if (ye < 1.0e-10){
-        NC = HI_prefactor*density;
-      }
-      else {
-        NC = CC*(-0.5*(1.0-ye)/ye);
-      }
+      // matter potentials at the current position, evaluated once per step by nuSQUIDS
+      double CC = medium.CC;
+      double NC = medium.NC;
 
       // construct potential in flavor basis
       squids::SU_vector potential(nsun,hiBuffer.get());
-      potential = (CC+NC)*evol_b1_proj[index_rho][0][ei];
-      potential += (NC)*(evol_b1_proj[index_rho][1][ei]);
-      potential += (NC)*(evol_b1_proj[index_rho][2][ei]);
+      potential = (CC+NC)*EvolvedFlavorProj(index_rho,0,ei);
+      potential += (NC)*(EvolvedFlavorProj(index_rho,1,ei));
+      potential += (NC)*(EvolvedFlavorProj(index_rho,2,ei));
       // plus sign so that the NSI potential has the same sign as the VCC potential
       // and the factor of 3 comes from average n_n/n_e at Earth.
       potential += (3.0*CC)*NSI_evol[ei];
@@ -126,8 +116,6 @@ class nuSQUIDSNSI: public nuSQUIDS {
          NSI_evol[ei] = squids::SU_vector(nsun);
        }
        gsl_matrix_complex_free(M);
-
-       HI_prefactor = params.sqrt2*params.GF*params.Na*pow(params.cm,-3);
     }
 
     void dump_state() const {
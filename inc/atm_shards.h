@@ -0,0 +1,78 @@
+ /******************************************************************************
+ *    This program is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by      *
+ *   the Free Software Foundation, either version 3 of the License, or         *
+ *   (at your option) any later version.                                       *
+ *                                                                             *
+ *   This program is distributed in the hope that it will be useful,           *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ *   GNU General Public License for more details.                              *
+ *                                                                             *
+ *   You should have received a copy of the GNU General Public License         *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *                                                                             *
+ *   Authors:                                                                  *
+ *      Carlos Arguelles (University of Wisconsin Madison)                     *
+ *         carguelles@icecube.wisc.edu                                         *
+ *      Jordi Salvado (University of Wisconsin Madison)                        *
+ *         jsalvado@icecube.wisc.edu                                           *
+ *      Christopher Weaver (University of Wisconsin Madison)                   *
+ *         chris.weaver@icecube.wisc.edu                                       *
+ ******************************************************************************/
+
+
+#ifndef __ATM_SHARDS_H
+#define __ATM_SHARDS_H
+
+#if __cplusplus < 201103L
+#error C++11 compiler required. Update your compiler and use the flag -std=c++11
+#endif
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include "marray.h"
+
+/*
+ * A nuSQUIDSAtm table can be computed by several independent jobs. Each
+ * job builds a nuSQUIDSAtm on the zenith nodes returned by
+ * GetAtmShardZenithRange, evolves it, and writes it with WriteStateHDF5.
+ * MergeAtmStateHDF5 then combines the shard files into a single file with
+ * the layout that nuSQUIDSAtm::ReadStateHDF5 expects. Shards written with the
+ * consolidated layout are merged into a consolidated file, and shards written
+ * with one group per zenith node into a file with one group per zenith node.
+ */
+
+namespace nusquids{
+
+/// \brief Returns the zenith nodes that belong to one shard.
+/// @param costh_array Zenith nodes of the complete table.
+/// @param ishard Index of the shard, from 0 to nshards-1.
+/// @param nshards Number of shards the table is split into.
+/// \details The nodes are split into contiguous blocks whose sizes differ
+/// by at most one node.
+marray<double,1> GetAtmShardZenithRange(const marray<double,1>& costh_array,
+                                        unsigned int ishard, unsigned int nshards);
+
+/// \brief Checks that nuSQUIDSAtm shard files can be merged.
+/// @param shard_files Files written by nuSQUIDSAtm::WriteStateHDF5.
+/// \details Throws if the shards differ in their energy grid, number of
+/// flavors, neutrino type, interaction settings, mixing parameters,
+/// body, cross sections, or the SQuIDS and nuSQuIDS versions used
+/// to write them, if they were written with different layouts, or if a
+/// zenith node is present in more than one shard.
+void CheckAtmShardConsistency(const std::vector<std::string>& shard_files);
+
+/// \brief Merges nuSQUIDSAtm shard files into one file.
+/// @param shard_files Files written by nuSQUIDSAtm::WriteStateHDF5.
+/// @param output_file File to create. It is overwritten if it exists.
+/// \details The shards are checked with CheckAtmShardConsistency. The
+/// zenith nodes of all the shards are sorted, and the state of each node
+/// is copied unchanged, either as its group or as its rows of the stacked datasets. The cross sections are taken from the first shard.
+/// The result can be read with nuSQUIDSAtm::ReadStateHDF5.
+void MergeAtmStateHDF5(const std::vector<std::string>& shard_files, std::string output_file);
+
+} // close namespace
+
+#endif
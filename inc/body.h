@@ -31,6 +31,8 @@
 
 #include "version.h"
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <math.h>
 #include <cmath>
 #include <gsl/gsl_interp.h>
@@ -65,8 +67,20 @@ class Body{
     /// \class Track
     /// \brief Trajectory subclass. Specifies the trajectory
     /// to take within the body.
+    /// \details The track also keeps the interpolation lookup state of the body splines,
+    /// so bodies can be evaluated concurrently as long as each thread uses its own tracks.
     class Track{
         friend class Body;
+        private:
+          /// \brief Lookup state of a spline evaluated on this track.
+          struct SplineLookup{
+            /// \brief Spline the accelerator refers to.
+            const gsl_spline* spline = nullptr;
+            /// \brief GSL interpolation accelerator.
+            gsl_interp_accel accel;
+          };
+          /// \brief Lookup state of the splines evaluated on this track, see Body::EvalSpline.
+          mutable SplineLookup spline_lookup[2];
         protected:
           /// \brief Current position.
           double x;
@@ -90,10 +104,44 @@ class Body{
           /// \brief Returns parameters that define the trajectory.
           std::vector<double> GetTrackParams() const { return TrackParams; }
     };
+  protected:
+    /// \brief Evaluates a spline of the body keeping the lookup state in the track.
+    /// @param spline Spline to evaluate, which is only read.
+    /// @param x Position at which to evaluate it.
+    /// @param track Track being evaluated.
+    /// @param slot Index of the lookup state of the track to use, 0 or 1.
+    /// \details Consecutive evaluations along a track are in neighbouring intervals,
+    /// so a lookup state per track keeps the speed of a per-spline accelerator
+    /// without modifying the body.
+    static double EvalSpline(const gsl_spline* spline, double x, const Track& track, unsigned int slot){
+      Track::SplineLookup& lookup = track.spline_lookup[slot];
+      if(lookup.spline != spline){
+        gsl_interp_accel_reset(&lookup.accel);
+        lookup.spline = spline;
+      }
+      return gsl_spline_eval(spline,x,&lookup.accel);
+    }
+  public:
+    /// \brief Returns true if density() and ye() can be called from several threads at once.
+    /// \details The bodies of nuSQUIDS only read their data when evaluated, but a derived
+    /// class may not, so this is \c false unless the class states otherwise. The tracks
+    /// are not safe to share between threads in any case.
+    virtual bool IsThreadSafe() const { return false; }
     /// \brief Retursn the density at a given trajectory object.
     virtual double density(const Track&) const {return 0.0;}
     /// \brief Retursn the electron fraction at a given trajectory object.
     virtual double ye(const Track&) const {return 1.0;}
+    /// \brief Returns the positions along the track at which the density is discontinuous.
+    /// \details The positions are sorted and lie strictly between the initial and final
+    /// positions of the track, so the density is smooth between two consecutive ones.
+    /// Tabulated bodies, whose interpolation turns a jump into a steep ramp, return both
+    /// ends of the ramp. Bodies without discontinuities return none.
+    virtual std::vector<double> GetLayerBoundaries(const Track&) const {return std::vector<double>();}
+    /// \brief Returns true if density() and ye() are the same at every position of every track.
+    /// \details nuSQUIDS then evolves the state without interactions in closed form, see
+    /// nuSQUIDS::Set_ClosedFormEvolution. Classes deriving from a constant body must
+    /// override it if their density varies.
+    virtual bool IsConstant() const {return false;}
     /// \brief Returns parameters that define the body.
     const std::vector<double>& GetBodyParams() const { return BodyParams;}
     /// \brief Returns the body identifier.
@@ -127,6 +175,10 @@ class Vacuum: public Body {
         Track(double xend):Track(0.0,xend){}
     };
 
+    /// \brief Evaluating the body does not modify it.
+    bool IsThreadSafe() const { return true; }
+    /// \brief The density is zero everywhere.
+    bool IsConstant() const { return true; }
     /// \brief Returns the density in g/cm^3
     double density(const GenericTrack&) const;
     /// \brief Returns the electron fraction
@@ -162,6 +214,10 @@ class ConstantDensity: public Body{
         Track(double xend):Track(0.0,xend){}
     };
 
+    /// \brief Evaluating the body does not modify it.
+    bool IsThreadSafe() const { return true; }
+    /// \brief The density and electron fraction do not depend on the position.
+    bool IsConstant() const { return true; }
     /// \brief Returns the density in g/cm^3
     double density(const GenericTrack&) const;
     /// \brief Returns the electron fraction
@@ -190,13 +246,9 @@ class VariableDensity: public Body{
 
     /// \brief Density gsl spline.
     gsl_spline * inter_density;
-    /// \brief Density gsl spline auxiliary pointer.
-    gsl_interp_accel * inter_density_accel;
 
     /// \brief Electron fraction gsl spline.
     gsl_spline * inter_ye;
-    /// \brief Electron fraction gsl spline auxiliary pointer.
-    gsl_interp_accel * inter_ye_accel;
   public:
     /// \brief Constructor.
     /// @param x Vector containing position nodes in cm.
@@ -219,6 +271,8 @@ class VariableDensity: public Body{
         Track(double xend):Track(0.0,xend){}
     };
 
+    /// \brief Evaluating the body does not modify it.
+    bool IsThreadSafe() const { return true; }
     /// \brief Returns the density in g/cm^3
     double density(const GenericTrack&) const;
     /// \brief Returns the electron fraction
@@ -234,12 +288,8 @@ class Earth: public Body{
 
     /// \brief Density gsl spline.
     gsl_spline * inter_density;
-    /// \brief Density gsl spline auxiliary pointer.
-    gsl_interp_accel * inter_density_accel;
     /// \brief Electron fraction gsl spline.
     gsl_spline * inter_ye;
-    /// \brief Electron fraction gsl spline auxiliary pointer.
-    gsl_interp_accel * inter_ye_accel;
 
     /// \brief Minimum radius.
     double x_radius_min;
@@ -253,6 +303,9 @@ class Earth: public Body{
     double x_ye_min;
     /// \brief Electron fraction at maximum radius.
     double x_ye_max;
+    /// \brief Radii of the table nodes that bound the density discontinuities of the model,
+    /// relative to the radius.
+    std::vector<double> layer_radii;
   public:
     /// \brief Default constructor using supplied PREM.
     Earth();
@@ -288,10 +341,15 @@ class Earth: public Body{
         double GetBaseline() const {return baseline;}
     };
 
+    /// \brief Evaluating the body does not modify it.
+    bool IsThreadSafe() const { return true; }
     /// \brief Returns the density in g/cm^3
     double density(const GenericTrack&) const;
     /// \brief Returns the electron fraction
     double ye(const GenericTrack&) const;
+    /// \brief Returns the positions at which the track crosses the table nodes that
+    /// bound a discontinuity of the model.
+    std::vector<double> GetLayerBoundaries(const GenericTrack&) const;
 
     /// \brief Returns the radius of the Earth in natural units.
     double GetRadius() const {return radius;}
@@ -326,13 +384,9 @@ class Sun: public Body{
 
     /// \brief Density gsl spline.
     gsl_spline * inter_density;
-    /// \brief Density gsl spline auxiliary pointer.
-    gsl_interp_accel * inter_density_accel;
 
     /// \brief Hidrogen fraction gsl spline.
     gsl_spline * inter_rxh;
-    /// \brief Hidrogen fraction gsl spline auxiliary pointer.
-    gsl_interp_accel * inter_rxh_accel;
 
     // /// \brief Electron content gsl spline.
     //gsl_spline * inter_nele;
@@ -341,10 +395,12 @@ class Sun: public Body{
 
     /// \brief Returns the density in g/cm^3 at a given radius fraction x
     /// @param x Radius fraction: 0:center, 1:surface.
-    double rdensity(double x) const;
+    /// @param track Track that keeps the spline lookup state.
+    double rdensity(double x, const GenericTrack& track) const;
     /// \brief Returns the electron fraction at a given radius fraction x
     /// @param x Radius fraction: 0:center, 1:surface.
-    double rxh(double x) const;
+    /// @param track Track that keeps the spline lookup state.
+    double rxh(double x, const GenericTrack& track) const;
   public:
     /// \brief Detault constructor.
     Sun();
@@ -364,6 +420,8 @@ class Sun: public Body{
         Track(double xend):Track(0.,xend){}
     };
 
+    /// \brief Evaluating the body does not modify it.
+    bool IsThreadSafe() const { return true; }
     /// \brief Returns the density in g/cm^3
     double density(const GenericTrack&) const;
     /// \brief Returns the electron fraction
@@ -394,20 +452,18 @@ class SunASnu: public Body{
 
     /// \brief Density gsl spline.
     gsl_spline * inter_density;
-    /// \brief Density gsl spline auxiliary pointer.
-    gsl_interp_accel * inter_density_accel;
 
     /// \brief Hidrogen fraction gsl spline.
     gsl_spline * inter_rxh;
-    /// \brief Hidrogen fraction gsl spline auxiliary pointer.
-    gsl_interp_accel * inter_rxh_accel;
 
     /// \brief Returns the density in g/cm^3 at a given radius fraction x
     /// @param x Radius fraction: 0:center, 1:surface.
-    double rdensity(double x) const;
+    /// @param track Track that keeps the spline lookup state.
+    double rdensity(double x, const GenericTrack& track) const;
     /// \brief Returns the electron fraction at a given radius fraction x
     /// @param x Radius fraction: 0:center, 1:surface.
-    double rxh(double x) const;
+    /// @param track Track that keeps the spline lookup state.
+    double rxh(double x, const GenericTrack& track) const;
   public:
     /// \brief Detault constructor.
     SunASnu();
@@ -436,6 +492,8 @@ class SunASnu: public Body{
         Track(double b_impact_):Track(0.0,b_impact_){}
     };
 
+    /// \brief Evaluating the body does not modify it.
+    bool IsThreadSafe() const { return true; }
     /// \brief Returns the density in g/cm^3
     double density(const GenericTrack&) const;
     /// \brief Returns the electron fraction
@@ -458,12 +516,8 @@ class EarthAtm: public Body{
 
     /// \brief Density gsl spline.
     gsl_spline * inter_density;
-    /// \brief Density gsl spline auxiliary pointer.
-    gsl_interp_accel * inter_density_accel;
     /// \brief Electron fraction gsl spline.
     gsl_spline * inter_ye;
-    /// \brief Electron fraction gsl spline auxiliary pointer.
-    gsl_interp_accel * inter_ye_accel;
 
     /// \brief Minimum radius.
     double x_radius_min;
@@ -477,6 +531,9 @@ class EarthAtm: public Body{
     double x_ye_min;
     /// \brief Electron fraction at maximum radius.
     double x_ye_max;
+    /// \brief Radii of the table nodes that bound the density discontinuities of the model,
+    /// relative to the radius.
+    std::vector<double> layer_radii;
   public:
     /// \brief Default constructor using supplied PREM.
     EarthAtm();
@@ -513,10 +570,15 @@ class EarthAtm: public Body{
         double GetBaseline() const {return L;}
     };
 
+    /// \brief Evaluating the body does not modify it.
+    bool IsThreadSafe() const { return true; }
     /// \brief Returns the density in g/cm^3
     double density(const GenericTrack&) const;
     /// \brief Returns the electron fraction
     double ye(const GenericTrack&) const;
+    /// \brief Returns the positions at which the track crosses the table nodes that
+    /// bound a discontinuity of the model, or the surface of the Earth.
+    std::vector<double> GetLayerBoundaries(const GenericTrack&) const;
     /// \brief Returns the radius of the Earth in natural units.
     double GetRadius() const {return radius;}
 };
@@ -524,6 +586,82 @@ class EarthAtm: public Body{
 // type defining
 typedef Body::Track Track;
 
+/// \class TrackProfile
+/// \brief Density and electron fraction of a body sampled along a track.
+/// \details The track is split at the discontinuities given by Body::GetLayerBoundaries,
+/// and each piece is sampled on its own uniform grid, whose end nodes lie just inside
+/// the piece, so that no cell straddles a jump. The profile is then linearly
+/// interpolated, so a lookup costs the same for every body. The grids are refined by
+/// halving the spacing of the piece with the largest error, until the largest
+/// difference between the profile and the body at any cell midpoint, relative to the
+/// largest value along the track, is below the requested tolerance or the next grid
+/// would exceed the node budget.
+class TrackProfile{
+  private:
+    /// \brief Uniform grid covering one piece of the track.
+    struct Segment{
+      /// \brief Position of the first node.
+      double x0;
+      /// \brief Inverse of the grid spacing.
+      double inv_dx;
+      /// \brief Number of cells.
+      unsigned int ncells;
+      /// \brief Index of the first node in TrackProfile#nodes.
+      size_t offset;
+    };
+    /// \brief Positions at which a new piece starts, the first piece excluded.
+    std::vector<double> boundaries;
+    /// \brief Grids of the pieces, in order along the track.
+    std::vector<Segment> segments;
+    /// \brief Largest relative difference reached.
+    double error;
+    /// \brief Density and electron fraction at the nodes of all the pieces, interleaved.
+    std::vector<double> nodes;
+  public:
+    /// \brief Samples the body along the track.
+    /// @param body Body to sample.
+    /// @param track Track within the body. Its position is restored after sampling.
+    /// @param tolerance Target largest difference between the profile and the body,
+    /// relative to the largest density or electron fraction along the track.
+    /// @param max_nodes Maximum number of grid nodes, each taking two doubles. When it
+    /// is smaller than two nodes per piece the discontinuities are not used.
+    TrackProfile(const Body& body, Track& track, double tolerance = 1.0e-4, unsigned int max_nodes = 1u<<15);
+
+    /// \brief Returns the density [gr/cm^3] and electron fraction at position \c x.
+    /// \details Positions outside of the track take the value at its closest end, and
+    /// positions at a discontinuity the value after it.
+    void Evaluate(double x, double& density, double& ye) const{
+      const Segment& segment = segments[std::upper_bound(boundaries.begin(),boundaries.end(),x) - boundaries.begin()];
+      const double* node = nodes.data() + 2*segment.offset;
+      if(segment.ncells == 0){
+        density = node[0];
+        ye = node[1];
+        return;
+      }
+      double u = (x - segment.x0)*segment.inv_dx;
+      if(not (u > 0.))
+        u = 0.;
+      unsigned int i = std::min(static_cast<unsigned int>(std::min(u,static_cast<double>(segment.ncells))),segment.ncells - 1);
+      const double t = std::min(u - i, 1.);
+      node += 2*i;
+      density = node[0] + t*(node[2] - node[0]);
+      ye = node[1] + t*(node[3] - node[1]);
+    }
+    /// \brief Returns the density [gr/cm^3] at position \c x.
+    double density(double x) const{ double rho, ye; Evaluate(x,rho,ye); return rho; }
+    /// \brief Returns the electron fraction at position \c x.
+    double ye(double x) const{ double rho, ye; Evaluate(x,rho,ye); return ye; }
+
+    /// \brief Returns the number of grid nodes.
+    unsigned int GetNodes() const { return nodes.size()/2; }
+    /// \brief Returns the number of pieces the track was split into.
+    unsigned int GetSegments() const { return segments.size(); }
+    /// \brief Returns the largest relative difference estimated for the final grids.
+    double GetError() const { return error; }
+    /// \brief Returns the memory used by the profile in bytes.
+    size_t GetMemory() const { return nodes.size()*sizeof(double); }
+};
+
 } // close namespace
 
 #endif
@@ -0,0 +1,207 @@
+ /******************************************************************************
+ *    This program is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by      *
+ *   the Free Software Foundation, either version 3 of the License, or         *
+ *   (at your option) any later version.                                       *
+ *                                                                             *
+ *   This program is distributed in the hope that it will be useful,           *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ *   GNU General Public License for more details.                              *
+ *                                                                             *
+ *   You should have received a copy of the GNU General Public License         *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *                                                                             *
+ *   Authors:                                                                  *
+ *      Carlos Arguelles (University of Wisconsin Madison)                     *
+ *         carguelles@icecube.wisc.edu                                         *
+ *      Jordi Salvado (University of Wisconsin Madison)                        *
+ *         jsalvado@icecube.wisc.edu                                           *
+ *      Christopher Weaver (University of Wisconsin Madison)                   *
+ *         chris.weaver@icecube.wisc.edu                                       *
+ ******************************************************************************/
+
+
+#ifndef __FLAVOR_TABLE_H
+#define __FLAVOR_TABLE_H
+
+#if __cplusplus < 201103L
+#error C++11 compiler required. Update your compiler and use the flag -std=c++11
+#endif
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+
+/*
+ * Dense table of flavor expectation values sampled from an evolved
+ * nuSQUIDSAtm by nuSQUIDSAtm::FreezeFlavorTable. The table depends only
+ * on the standard library, so that it can be evaluated, or written to
+ * and read from a file, without nuSQUIDS, SQuIDS or GSL.
+ */
+
+namespace nusquids{
+
+/// \class FlavorTable
+/// \brief Flavor content on a grid uniform in cos(zenith) and log(energy).
+/// \details The values are stored in one contiguous array, ordered by
+/// cos(zenith), energy, rho and flavor, the last one running fastest.
+/// Eval() interpolates bilinearly in cos(zenith) and log(energy), as
+/// nuSQUIDSAtm::EvalFlavor does, with a constant number of operations.
+class FlavorTable{
+  private:
+    /// \brief Number of cos(zenith) nodes.
+    unsigned int ncosth = 0;
+    /// \brief Number of energy nodes.
+    unsigned int nenergy = 0;
+    /// \brief Number of rho indices, i.e. 2 for neutrinos and antineutrinos.
+    unsigned int nrho = 0;
+    /// \brief Number of neutrino flavors.
+    unsigned int numneu = 0;
+    /// \brief cos(zenith) range.
+    double costh_min = 0, costh_max = 0;
+    /// \brief Energy range [GeV].
+    double enu_min = 0, enu_max = 0;
+    /// \brief Grid spacings in cos(zenith) and log(energy).
+    double costh_step = 0, log_enu_step = 0;
+    /// \brief Flavor content at the nodes.
+    std::vector<double> data;
+    /// \brief Identifies the files written by Write().
+    static std::string Magic(){return "nuSQuIDS::FlavorTable";}
+
+    void SetSteps(){
+      if(ncosth < 2 or nenergy < 2)
+        throw std::runtime_error("FlavorTable::Error::At least two nodes are needed in cos(th) and energy.");
+      if(not (costh_max > costh_min) or not (enu_max > enu_min) or enu_min <= 0)
+        throw std::runtime_error("FlavorTable::Error::Invalid cos(th) or energy range.");
+      costh_step = (costh_max - costh_min)/(ncosth-1);
+      log_enu_step = (log(enu_max) - log(enu_min))/(nenergy-1);
+    }
+    /// \brief Position of a node in FlavorTable#data.
+    size_t Index(size_t ic,size_t ie,unsigned int rho,unsigned int flv) const {
+      return ((ic*nenergy + ie)*nrho + rho)*numneu + flv;
+    }
+  public:
+    /// \brief Empty table.
+    FlavorTable(){}
+
+    /// \brief Constructs a table with all values set to zero.
+    /// @param costh_min Minimum cos(th) value.
+    /// @param costh_max Maximum cos(th) value.
+    /// @param ncosth Number of cos(th) nodes.
+    /// @param enu_min Minimum neutrino energy [GeV].
+    /// @param enu_max Maximum neutrino energy [GeV].
+    /// @param nenergy Number of energy nodes, logarithmically spaced.
+    /// @param nrho Number of rho indices.
+    /// @param numneu Number of neutrino flavors.
+    FlavorTable(double costh_min,double costh_max,unsigned int ncosth,
+                double enu_min,double enu_max,unsigned int nenergy,
+                unsigned int nrho,unsigned int numneu):
+    ncosth(ncosth),nenergy(nenergy),nrho(nrho),numneu(numneu),
+    costh_min(costh_min),costh_max(costh_max),enu_min(enu_min),enu_max(enu_max),
+    data(size_t(ncosth)*nenergy*nrho*numneu,0.0)
+    {
+      SetSteps();
+    }
+
+    /// \brief Constructor from a file written by Write().
+    FlavorTable(std::string filename){Read(filename);}
+
+    /// \brief Returns the interpolated flavor content.
+    /// @param flv Neutrino flavor.
+    /// @param costh Cosine of the zenith.
+    /// @param enu Neutrino energy [GeV].
+    /// @param rho Index of the equation, as in nuSQUIDSAtm::EvalFlavor.
+    double Eval(unsigned int flv,double costh,double enu,unsigned int rho = 0) const {
+      if(not (costh >= costh_min and costh <= costh_max))
+        throw std::runtime_error("FlavorTable::Error::cos(th) out of bounds.");
+      if(not (enu >= enu_min and enu <= enu_max))
+        throw std::runtime_error("FlavorTable::Error::neutrino energy out of bounds.");
+      if(flv >= numneu or rho >= nrho)
+        throw std::runtime_error("FlavorTable::Error::flavor or rho out of bounds.");
+
+      double x = (costh - costh_min)/costh_step;
+      double y = (log(enu/enu_min))/log_enu_step;
+      size_t ic = std::min<size_t>(static_cast<size_t>(x),ncosth-2);
+      size_t ie = std::min<size_t>(static_cast<size_t>(y),nenergy-2);
+      double fx = x - ic, fy = y - ie;
+
+      double vMM = data[Index(ic,ie,rho,flv)];
+      double vMP = data[Index(ic,ie+1,rho,flv)];
+      double vPM = data[Index(ic+1,ie,rho,flv)];
+      double vPP = data[Index(ic+1,ie+1,rho,flv)];
+      return (1.0-fx)*((1.0-fy)*vMM + fy*vMP) + fx*((1.0-fy)*vPM + fy*vPP);
+    }
+
+    /// \brief Returns the value of the ic-th cos(zenith) node.
+    double GetCosth(size_t ic) const {
+      return (ic + 1 == ncosth) ? costh_max : costh_min + ic*costh_step;
+    }
+    /// \brief Returns the value of the ie-th energy node [GeV].
+    double GetEnergy(size_t ie) const {
+      if(ie == 0)
+        return enu_min;
+      return (ie + 1 == nenergy) ? enu_max : enu_min*exp(ie*log_enu_step);
+    }
+    /// \brief Returns the number of cos(zenith) nodes.
+    unsigned int GetNumCos() const {return ncosth;}
+    /// \brief Returns the number of energy nodes.
+    unsigned int GetNumE() const {return nenergy;}
+    /// \brief Returns the number of rho indices.
+    unsigned int GetNumRho() const {return nrho;}
+    /// \brief Returns the number of neutrino flavors.
+    unsigned int GetNumNeu() const {return numneu;}
+    /// \brief Returns the table contents, see the class details for the ordering.
+    double* GetData() {return data.data();}
+    /// \brief Returns the table contents, see the class details for the ordering.
+    const double* GetData() const {return data.data();}
+    /// \brief Returns the value at a node.
+    double& operator()(size_t ic,size_t ie,unsigned int rho,unsigned int flv) {return data[Index(ic,ie,rho,flv)];}
+    /// \brief Returns the value at a node.
+    double operator()(size_t ic,size_t ie,unsigned int rho,unsigned int flv) const {return data[Index(ic,ie,rho,flv)];}
+
+    /// \brief Writes the table to a binary file.
+    /// \details The file uses the byte order of the machine that writes it.
+    void Write(std::string filename) const {
+      std::ofstream file(filename,std::ios::binary);
+      if(not file)
+        throw std::runtime_error("FlavorTable::Error::Cannot create file at " + filename + ".");
+      unsigned int dims[4] = {ncosth,nenergy,nrho,numneu};
+      double ranges[4] = {costh_min,costh_max,enu_min,enu_max};
+      file.write(Magic().c_str(),Magic().size());
+      file.write(reinterpret_cast<const char*>(dims),sizeof(dims));
+      file.write(reinterpret_cast<const char*>(ranges),sizeof(ranges));
+      file.write(reinterpret_cast<const char*>(data.data()),data.size()*sizeof(double));
+      if(not file)
+        throw std::runtime_error("FlavorTable::Error::Cannot write to " + filename + ".");
+    }
+
+    /// \brief Reads a table written by Write().
+    void Read(std::string filename){
+      std::ifstream file(filename,std::ios::binary);
+      if(not file)
+        throw std::runtime_error("FlavorTable::Error::file not found : " + filename + ".");
+      std::string header(Magic().size(),'\0');
+      file.read(&header[0],header.size());
+      if(header != Magic())
+        throw std::runtime_error("FlavorTable::Error::" + filename + " is not a flavor table.");
+      unsigned int dims[4];
+      double ranges[4];
+      file.read(reinterpret_cast<char*>(dims),sizeof(dims));
+      file.read(reinterpret_cast<char*>(ranges),sizeof(ranges));
+      ncosth = dims[0]; nenergy = dims[1]; nrho = dims[2]; numneu = dims[3];
+      costh_min = ranges[0]; costh_max = ranges[1]; enu_min = ranges[2]; enu_max = ranges[3];
+      SetSteps();
+      data.resize(size_t(ncosth)*nenergy*nrho*numneu);
+      file.read(reinterpret_cast<char*>(data.data()),data.size()*sizeof(double));
+      if(not file)
+        throw std::runtime_error("FlavorTable::Error::" + filename + " is truncated.");
+    }
+};
+
+} // close namespace
+
+#endif
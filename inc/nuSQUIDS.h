@@ -34,12 +34,24 @@
 #include "xsections.h"
 #include "taudecay.h"
 #include "marray.h"
+#include "scheduler.h"
+#include "atm_shards.h"
+#include "flavor_table.h"
 
 #include <algorithm>
 #include <SQuIDS/SQuIDS.h>
 #include <memory>
 #include <map>
 #include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <numeric>
+#include <exception>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <typeinfo>
 
 #include "H5Epublic.h"
 #include "H5Tpublic.h"
@@ -92,9 +104,36 @@ class nuSQUIDS: public squids::SQuIDS {
     /// at x = track.GetX().
     double GetNucleonNumber() const;
 
+    /// \brief Returns the number of nucleons for a given density.
+    /// @param density Density [gr/cm^3].
+    double NucleonNumber(double density) const;
+
+    /// \brief Properties of the medium at the current position of the track.
+    struct MediumState {
+      /// \brief Density [gr/cm^3].
+      double density = 0;
+      /// \brief Electron fraction.
+      double ye = 0;
+      /// \brief Nucleon number density in natural units, as returned by GetNucleonNumber().
+      double nucleon_number = 0;
+      /// \brief Charged current matter potential in natural units.
+      double CC = 0;
+      /// \brief Neutral current matter potential in natural units.
+      double NC = 0;
+    };
+    /// \brief Medium at the position of the last PreDerive() call.
+    /// \details HI() and UpdateInteractions() read it instead of evaluating the body,
+    /// so the body is evaluated once per right hand side evaluation. Terms added by
+    /// derived classes should read it too.
+    MediumState medium;
+    /// \brief Evaluates the body at the current track position and fills nuSQUIDS#medium.
+    /// \details If enabled by Set_TrackProfile(), the body is read from nuSQUIDS#track_profile,
+    /// which is built on the first call after the body or the track change.
+    void UpdateMediumState();
+
     /// \brief Updates the interaction length arrays.
     ///
-    /// Uses GetNucleonNumber() together with the stored cross section
+    /// Uses the nucleon number in nuSQUIDS#medium together with the stored cross section
     /// information to update: nuSQUIDS#invlen_NC, nuSQUIDS#invlen_CC, nuSQUIDS#invlen_INT, and nuSQUIDS#invlen_tau.
     void UpdateInteractions();
 
@@ -107,22 +146,83 @@ class nuSQUIDS: public squids::SQuIDS {
 
     /// \brief Interface that calculate and interpolates neutrino cross sections.
     std::shared_ptr<NeutrinoCrossSections> ncs;
-    /// \brief Neutrino charge current differential cross section with respect to
-    /// the outgoing lepton energy.
-    ///
-    /// The array four dimensional is constructed when InitializeInteractionVectors() is called and
-    /// its initialized when InitializeInteractions() is called. The first dimension
-    /// is number of neutrino types (neutrino/antineutrino/both), the second the neutrino flavor,
-    /// and the last two the initial and final energy node respectively.
-    marray<double,4> dNdE_CC;
-    /// \brief Neutrino neutral current differential cross section with respect to
-    /// the outgoing lepton energy.
-    ///
-    /// The array four dimensional is constructed when InitializeInteractionVectors() is called and
-    /// its initialized when InitializeInteractions() is called. The first dimension
-    /// is number of neutrino types (neutrino/antineutrino/both), the second the neutrino flavor,
-    /// and the last two the initial and final energy node respectively.
-    marray<double,4> dNdE_NC;
+  public:
+    /// \brief Cross section and tau decay tables.
+    /// \details The tables only depend on the energy nodes, the neutrino type and
+    /// the cross sections, so objects that agree on those can share them; e.g. all
+    /// the zenith instances of a nuSQUIDSAtm do. Shared tables are never modified,
+    /// since InitializeInteractionVectors() always allocates a new structure.
+    /// @see GetInteractionStructure
+    /// @see SetInteractionStructure
+    struct InteractionStructure{
+      /// \brief Neutrino charge current differential cross section with respect to
+      /// the outgoing lepton energy.
+      ///
+      /// The first dimension
+      /// is number of neutrino types (neutrino/antineutrino/both), the second the neutrino flavor,
+      /// and the last one the pair of initial and final energy nodes (e1,e2) with e2 < e1,
+      /// packed as given by TriangularIndex().
+      marray<double,3> dNdE_CC;
+      /// \brief Neutrino neutral current differential cross section with respect to
+      /// the outgoing lepton energy.
+      ///
+      /// The first dimension
+      /// is number of neutrino types (neutrino/antineutrino/both) and the second the pair of
+      /// initial and final energy nodes packed as in dNdE_CC. The neutral current is flavor
+      /// independent, so it is stored only once and computed with the electron flavor.
+      marray<double,2> dNdE_NC;
+      /// \brief Position of the energy pair (e1,e2), e2 < e1, in the packed tables.
+      static size_t TriangularIndex(unsigned int e1, unsigned int e2){
+        return static_cast<size_t>(e1)*(e1-1)/2 + e2;
+      }
+      /// \brief Number of entries of a packed table for \c ne energy nodes.
+      static size_t TriangularSize(unsigned int ne){
+        return static_cast<size_t>(ne)*(ne > 0 ? ne-1 : 0)/2;
+      }
+      /// \brief Array that contains the neutrino charge current cross section.
+      /// \details The first dimension corresponds to the neutrino type, the second to the flavor, and
+      /// the final one to the energy node. Its contents are in natural units, i.e. eV^-2.
+      marray<double,3> sigma_CC;
+      /// \brief Array that contains the neutrino neutral current cross section.
+      /// \details The first dimension corresponds to the neutrino type, the second to the flavor, and
+      /// the final one to the energy node. Its contents are in natural units, i.e. eV^-2.
+      marray<double,3> sigma_NC;
+      /// \brief Array that contains the inverse of the tau decay length for each energy node.
+      marray<double,1> invlen_tau;
+      /// \brief Array that contains the tau decay spectrum to all particles.
+      /// \details The first dimension corresponds to initial tau energy and the
+      /// second one to the outgoing lepton.
+      marray<double,2> dNdE_tau_all;
+      /// \brief Array that contains the tau decay spectrum to leptons.
+      /// \details The first dimension corresponds to initial tau energy and the
+      /// second one to the outgoing lepton.
+      marray<double,2> dNdE_tau_lep;
+      /// \brief Tau neutrino charged current production of taus, weighted by the width of the
+      /// initial energy node.
+      /// \details The first dimension is the neutrino type, the second the tau energy and
+      /// the last one the initial neutrino energy, so each matrix is strictly upper triangular
+      /// with contiguous rows. It is filled by InitializeInteractionKernels().
+      /// @see InteractionsScalar
+      marray<double,3> tau_cc_kernel;
+      /// \brief Tau decay spectrum to all particles, weighted by the width of the tau energy node.
+      /// \details The first dimension is the outgoing neutrino energy and the second the tau
+      /// energy, i.e. it is the transpose of dNdE_tau_all and strictly upper triangular.
+      /// @see ConvertTauIntoNuTau
+      marray<double,2> tau_all_kernel;
+      /// \brief Tau decay spectrum to leptons, laid out as tau_all_kernel.
+      marray<double,2> tau_lep_kernel;
+      /// \brief Neutral current cascade per nucleon, 0.5*dNdE_NC times sigma_NC of the
+      /// initial energy node.
+      /// \details The first dimension is the neutrino type, the second the final energy and
+      /// the last one the initial energy, so each matrix is strictly upper triangular.
+      /// @see UpdateNCCascade
+      marray<double,3> nc_kernel;
+    };
+  protected:
+    /// \brief Cross section and tau decay tables.
+    /// \details It is constructed when InitializeInteractionVectors() is called and
+    /// its initialized when InitializeInteractions() is called.
+    std::shared_ptr<InteractionStructure> int_struct;
     /// \brief Array that contains the inverse of the neutrino neutral current mean free path.
     /// \details The array contents are in natural units (i.e. eV) and is update when
     /// UpdateInteractions() is called. The first dimension corresponds to the neutrino type,
@@ -138,30 +238,21 @@ class nuSQUIDS: public squids::SQuIDS {
     /// UpdateInteractions() is called. Numerically it is just nuSQUIDS::invlen_NC and nuSQUIDS::invlen_CC
     /// added together.
     marray<double,3> invlen_INT;
-    /// \brief Array that contains the neutrino charge current cross section.
-    /// \details The first dimension corresponds to the neutrino type, the second to the flavor, and
-    /// the final one to the energy node. Its contents are in natural units, i.e. eV^-2. It is
-    /// initialized by InitializeInteractions() .
-    marray<double,3> sigma_CC;
-    /// \brief Array that contains the neutrino neutral current cross section.
-    /// \details The first dimension corresponds to the neutrino type, the second to the flavor, and
-    /// the final one to the energy node. Its contents are in natural units, i.e. eV^-2. It is
-    /// initialized by InitializeInteractions() .
-    marray<double,3> sigma_NC;
+    /// \brief Neutral current cascade into each energy node.
+    /// \details For each neutrino type and energy node e1 it contains the components of
+    /// the sum over e2 > e1 of 0.5*dNdE_NC[e2][e1]*invlen_NC[e2]*state[e2], whose anticommutator
+    /// with the flavor projectors is the neutral current term of InteractionsRho(). The first
+    /// dimension corresponds to the neutrino type, the second to the energy and the last one
+    /// to the SU_vector component.
+    marray<double,3> nc_cascade;
+    /// \brief Updates nuSQUIDS#nc_cascade from the current state.
+    /// \details The sums for all energies are one triangular matrix product of
+    /// InteractionStructure::nc_kernel, scaled by the nucleon number, and the
+    /// (energy,component) state matrix.
+    void UpdateNCCascade();
 
     /// \brief Interface that calculate and interpolates tau decay spectral functions.
     TauDecaySpectra tdc;
-    /// \brief Array that contains the inverse of the tau decay length for each energy node.
-    marray<double,1> invlen_tau;
-    /// \brief Array that contains the tau decay spectrum to all particles.
-    /// \details The first dimension corresponds to initial tau energy and the
-    /// second one to the outgoing lepton.
-    marray<double,2> dNdE_tau_all;
-    /// \brief Array that contains the tau decay spectrum to leptons.
-    /// \brief Array that contains the tau decay spectrum to all particles.
-    /// \details The first dimension corresponds to initial tau energy and the
-    /// second one to the outgoing lepton.
-    marray<double,2> dNdE_tau_lep;
     /// \brief Tau branching ratio to leptons.
     double taubr_lep;
     /// \brief Tau lifetime in natural units.
@@ -182,6 +273,14 @@ class nuSQUIDS: public squids::SQuIDS {
     /// \details Stores the position within the body and its updated every evolution
     /// step.
     std::shared_ptr<Track> track;
+    /// \brief Profile of the body along nuSQUIDS#track, see Set_TrackProfile().
+    std::shared_ptr<const TrackProfile> track_profile;
+    /// \brief Boolean that signals that the body is read from nuSQUIDS#track_profile.
+    bool use_track_profile = false;
+    /// \brief Target relative difference of nuSQUIDS#track_profile, see TrackProfile.
+    double track_profile_tolerance = 1.0e-4;
+    /// \brief Maximum number of nodes of nuSQUIDS#track_profile.
+    unsigned int track_profile_max_nodes = 1u<<15;
 
     /// \brief SU_vector that represents the neutrino square mass difference matrix in the mass basis.
     ///  It is used to construct nuSQUIDS#H0_array and H0()
@@ -202,17 +301,61 @@ class nuSQUIDS: public squids::SQuIDS {
     /// The index meaning are the same as nuSQUIDS#b1_proj but for mass eigenstates,
     /// with an added third dimension that corresponds to the energy node index.
     marray<squids::SU_vector,3> evol_b0_proj;
-    /// \brief Flavor basis projectors in the interaction picture.
-    /// The index meaning are the same as nuSQUIDS#b1_proj ,
-    /// with an added third dimension that corresponds to the energy node index.
-    marray<squids::SU_vector,3> evol_b1_proj;
+    /// \brief Flavor basis projectors stored in one aligned buffer.
+    /// \details The buffer starts with the projectors in the interaction picture indexed as
+    /// [rho][flavor][component][energy], so that the loops over the energies of a component
+    /// are contiguous, see EvolvedProjectorSoA(). It is followed by the components of
+    /// nuSQUIDS#b1_proj indexed as [rho][flavor][component], which GetFlavorProj() returns views of.
+    marray<double,1,aligned_allocator<double>> proj_soa;
+    /// \brief Pairs of SU_vector components that the evolution with H0() rotates into each other.
+    /// \details The second dimension holds the two components of each pair.
+    marray<unsigned int,2> phase_pairs;
+    /// \brief Rotation frequency of each pair of nuSQUIDS#phase_pairs at each energy node.
+    marray<double,2,aligned_allocator<double>> phase_frequencies;
+    /// \brief Weight of each SU_vector component in the scalar product of two SU_vectors.
+    marray<double,1> soa_metric;
+    /// \brief Scratch storage of shape (component+1, energy) used by the structure of arrays loops.
+    marray<double,2,aligned_allocator<double>> soa_scratch;
+
+    /// \brief Returns the [component][energy] block of an evolved flavor projector in nuSQUIDS#proj_soa.
+    /// @param rho Neutrino type index.
+    /// @param flv Flavor index.
+    double* EvolvedProjectorSoA(unsigned int rho, unsigned int flv){
+      return proj_soa.get_data() + size_t(rho*numneu + flv)*nsun*nsun*ne;
+    }
+    const double* EvolvedProjectorSoA(unsigned int rho, unsigned int flv) const {
+      return proj_soa.get_data() + size_t(rho*numneu + flv)*nsun*nsun*ne;
+    }
+    /// \brief Returns a flavor projector in the interaction picture.
+    /// @param rho Neutrino type index.
+    /// @param flv Flavor index.
+    /// @param ie Energy index.
+    /// \details The components are gathered from nuSQUIDS#proj_soa.
+    squids::SU_vector EvolvedFlavorProj(unsigned int rho, unsigned int flv, unsigned int ie) const;
 
     /// \brief Evolves the flavor projectors in the interaction basis to a time t.
-    /// \details It uses H0() to evolve SQUIDS#b0_proj and SQUIDS#b1_proj into 
-    /// SQUIDS#evol_b0_proj and SQUIDS#evol_b1_proj.
+    /// \details The evolution with the diagonal H0() rotates each pair of
+    /// nuSQUIDS#phase_pairs by the phase of its frequency, so the projectors are evolved
+    /// in nuSQUIDS#proj_soa one component at a time for all the energies. When the CP
+    /// phases vanish the antineutrino projectors are copied from the neutrino ones.
+    /// Repeated calls at the same time do nothing.
     /// \warning Since the RHS of the differential equation only involves flavor projectors
     /// we do not current evolve mass projectors.
     void EvolveProjectors(double t);
+    /// \brief Reads the pairs of components and the frequencies of the evolution with
+    /// nuSQUIDS#H0_array into nuSQUIDS#phase_pairs and nuSQUIDS#phase_frequencies.
+    /// \details They are taken from SU_vector::Evolve, so EvolveProjectors() does not
+    /// depend on the ordering of the SU(N) generators.
+    void iniPhases();
+    /// \brief Copies the components of one neutrino type of the state into a [component][energy] array.
+    void GatherStateSoA(unsigned int rho, double* rho_soa) const;
+    /// \brief Copies a [component][energy] array back into one neutrino type of the state.
+    void ScatterStateSoA(unsigned int rho, const double* rho_soa);
+    /// \brief Evaluates the scalar product of an evolved flavor projector and a state for all energies.
+    /// @param proj Projector as returned by EvolvedProjectorSoA().
+    /// @param rho_soa State as filled by GatherStateSoA().
+    /// @param content Output array with one entry per energy.
+    void FlavorContentSoA(const double* proj, const double* rho_soa, double* content) const;
 
     /// \brief When called converts the flux of tau charged leptons to neutrinos. It
     /// is only called when tauregeneration = True and NeutrinoType = both.
@@ -265,12 +408,52 @@ class nuSQUIDS: public squids::SQuIDS {
     bool positivization = false;
     /// \brief Boolean that signals that a progress bar will be printed.
     bool progressbar = false;
+    /// \brief Boolean that signals that the fused evaluation of the derivative terms was requested.
+    bool fused_derivatives = false;
+    /// \brief Boolean that signals that the terms of the current step were evaluated by EvaluateFusedTerms().
+    bool fused_active = false;
     /// \brief Integer to keep track of the progress bar evolution.
     int progressbar_count = 0;
     /// \brief Number of steps upon which the progress bar will be updated.
     int progressbar_loop = 100;
     /// \brief Time offset between SQuIDS time and Track(x).
     double time_offset;
+    /// \brief True if the antineutrino flavor projectors are the neutrino ones.
+    bool cp_symmetric_projectors = false;
+    /// \brief Time at which the projectors of nuSQUIDS#proj_soa were last evolved, NaN if they have to be recomputed.
+    double evol_proj_time = std::numeric_limits<double>::quiet_NaN();
+    /// \brief Copies nuSQUIDS#b1_proj into nuSQUIDS#proj_soa and updates
+    /// nuSQUIDS#cp_symmetric_projectors after the flavor projectors have changed.
+    /// \details The projectors in the interaction picture are reset to the ones at the initial time.
+    void ProjectorsChanged();
+    /// \brief Storage of the fused terms.
+    /// \details The first dimension is the term (0 for HI(), 1 for GammaRho() and 2 for
+    /// InteractionsRho()), the second the neutrino type, the third the energy and the last
+    /// one the SU_vector component.
+    marray<double,4> fused_terms;
+    /// \brief Scratch vector used by EvaluateFusedTerms().
+    squids::SU_vector fused_scratch;
+    /// \brief Allocates nuSQUIDS#fused_terms and nuSQUIDS#fused_scratch if needed.
+    void ResizeFusedTerms();
+    /// \brief Evaluates HI(), GammaRho() and InteractionsRho() for all nodes into nuSQUIDS#fused_terms.
+    void EvaluateFusedTerms();
+    /// \brief Evaluates the hamiltonian, attenuation and neutral current terms of one node.
+    /// @param ie Energy index.
+    /// @param rho Neutrino type index.
+    /// @param hi Components of HI(), or nullptr to skip it.
+    /// @param gamma Components of GammaRho(), or nullptr to skip it.
+    /// @param nc Components of the neutral current term of InteractionsRho(), or nullptr to skip it.
+    /// @param scratch Storage for one SU_vector, only used by the neutral current term.
+    /// \details This is the only implementation of these terms, the per-node functions and
+    /// EvaluateFusedTerms() call it. Only the active flavors, at most the first three,
+    /// feel the matter potential and interact.
+    void NodeTerms(unsigned int ie, unsigned int rho, double* hi, double* gamma, double* nc, double* scratch) const;
+    /// \brief Type of the most derived class whose per-node functions are the ones
+    /// evaluated by EvaluateFusedTerms().
+    /// \details The fused terms are only used when this is the dynamic type of the object.
+    virtual const std::type_info& FusedTermsType() const { return typeid(nuSQUIDS); }
+    /// \brief Returns a view of a term stored in nuSQUIDS#fused_terms.
+    squids::SU_vector FusedTerm(unsigned int term, unsigned int irho, unsigned int ie) const;
     /// \brief Force flavor projections to be positive.
     void PositivizeFlavors();
   protected:
@@ -291,8 +474,112 @@ class nuSQUIDS: public squids::SQuIDS {
     /// \brief Changes the CP sign of the complex matrices stored in params.
     void AntineutrinoCPFix(unsigned int irho);
     /// \brief Serializes the initialization of the Body and Track objects.
+    /// \details If \c shared_body has the requested body identifier it is used
+    /// instead of constructing a new body, its parameters are assumed to match.
     /// @see ReadStateHDF5
-    void SetBodyTrack(unsigned int,unsigned int,double*,unsigned int,double*);
+    void SetBodyTrack(unsigned int,unsigned int,double*,unsigned int,double*,std::shared_ptr<Body> shared_body = nullptr);
+    /// \brief Writes the energy nodes, the basic settings and the mixing parameters.
+    /// @param group_id HDF5 location where the datasets will be created.
+    /// @see ReadParametersHDF5
+    void WriteParametersHDF5(hid_t group_id) const;
+    /// \brief Writes the interaction tables into an HDF5 group.
+    /// @param xs_group_id HDF5 location where the datasets will be created.
+    void WriteCrossSectionsHDF5(hid_t xs_group_id) const;
+    /// \brief Reads the settings written by WriteParametersHDF5().
+    /// \details Sets the number of flavors, the neutrino type, the interaction and energy scale
+    /// flags, and checks the versions the file was written with.
+    /// @param group_id HDF5 location of the datasets.
+    /// \return The energy nodes [eV].
+    std::vector<double> ReadParametersHDF5(hid_t group_id);
+    /// \brief Allocates and reads the interaction tables written by WriteCrossSectionsHDF5().
+    /// @param xs_group_id HDF5 location of the datasets.
+    void ReadCrossSectionsHDF5(hid_t xs_group_id);
+    /// \brief Rebuilds the system from serialized data.
+    /// @param group_id HDF5 location holding the mixing parameters.
+    /// @param energies Energy nodes [eV].
+    /// @param squids_time_initial Initial SQuIDS time.
+    /// @param squids_time Current SQuIDS time.
+    /// @param body_id Body identifier, see SetBodyTrack().
+    /// @param body_params Body parameters.
+    /// @param track_params Track parameters.
+    /// @param x_current Current position along the track.
+    /// @param state_data State components laid out as (energy,rho,component).
+    /// @param shared_body Body to use instead of constructing one, see SetBodyTrack().
+    /// \details Must be called after ReadParametersHDF5(). The mixing parameters are set
+    /// after the system is initialized, so they are not overwritten by the defaults.
+    void RestoreStateHDF5(hid_t group_id, const std::vector<double>& energies,
+                          double squids_time_initial, double squids_time,
+                          unsigned int body_id, std::vector<double> body_params,
+                          std::vector<double> track_params, double x_current,
+                          const double* state_data, std::shared_ptr<Body> shared_body = nullptr);
+    /// \brief Reads the object from a group of an open HDF5 file.
+    /// @param root_id Root group of the file.
+    /// @param grp Group where the object is stored.
+    /// @param cross_section_grp_loc Group where the cross sections are stored, see ReadStateHDF5().
+    /// @param read_cross_sections If \c false the interaction tables are not read; the caller
+    /// must then provide them with SetInteractionStructure() or disable the interactions.
+    /// @param shared_body Body to use instead of constructing one, see SetBodyTrack().
+    void ReadGroupHDF5(hid_t root_id, std::string grp, std::string cross_section_grp_loc,
+                       bool read_cross_sections, std::shared_ptr<Body> shared_body);
+    /// \brief Returns the state components laid out as (energy,rho,component).
+    std::vector<double> GetStateData() const;
+    /// \brief Appends the flavor and mass composition laid out as (energy,rho,flavor).
+    void GetCompositionData(std::vector<double>& flavor, std::vector<double>& mass) const;
+    /// \brief Returns the scalar components, i.e. the charged tau fluxes, laid out as (energy,scalar).
+    std::vector<double> GetScalarData() const;
+    /// \brief Overwrites the state and the position along the track.
+    /// @param squids_time SQuIDS time of the new state.
+    /// @param state_data State components laid out as in GetStateData().
+    /// @param scalar_data Scalar components laid out as in GetScalarData().
+    /// \details The energies, track and settings are kept, only the dynamical
+    /// variables are replaced. Used to continue an interrupted evolution.
+    void SetStateData(double squids_time, const double* state_data, const double* scalar_data);
+    /// \brief Evolves the system over part of the track.
+    /// @param from Distance along the track [eV^-1] already evolved since the evolution started.
+    /// @param to Distance along the track [eV^-1] up to which the system is evolved.
+    /// \details The distances are measured from the position at which the evolution was
+    /// started, and the positivization and tau regeneration steps are placed at the same
+    /// distances as in EvolveState(), so evolving [0,a] and then [a,b] applies them exactly
+    /// as evolving [0,b] does. \c to is clipped to the track length, and the steps that
+    /// close the track are only applied when it is reached.
+    /// @see EvolveState
+    void EvolveInterval(double from, double to);
+
+    /// \brief Piece of the track approximated by a constant medium in the layered evolution.
+    struct LayerSegment {
+      /// \brief Length [eV^-1].
+      double length;
+      /// \brief Charged current potential averaged over the piece.
+      double CC;
+      /// \brief Neutral current potential averaged over the piece.
+      double NC;
+    };
+    /// \brief Splits part of the track in constant medium pieces.
+    /// @param x_start Initial position along the track.
+    /// @param x_end Final position along the track.
+    /// \details The pieces never cross a Body::GetLayerBoundaries position and are at most
+    /// nuSQUIDS#layer_max_length long, except in Body::IsConstant bodies, which are one piece. The potentials are averaged with a three point
+    /// Gauss-Legendre rule.
+    std::vector<LayerSegment> LayerSegments(double x_start, double x_end);
+    /// \brief Evolves the state up to a position along the track with the layered evolution.
+    /// @param x_end Final position along the track.
+    /// \details For every energy and neutrino type the propagator of each piece is built
+    /// from the eigenvectors of its hamiltonian, the propagators are multiplied and the
+    /// product is applied to the state. The clock and the track are moved to \c x_end.
+    /// @see Set_LayeredEvolution
+    void EvolveLayers(double x_end);
+    /// \brief Returns true if the hamiltonian is constant and EvolveLayers() evolves the
+    /// state in closed form.
+    /// \details It requires a Body::IsConstant body, no interactions and no derived class
+    /// that may replace the hamiltonian, the same condition as the fused terms.
+    bool UseClosedForm() const;
+    /// \brief Returns Body::GetLayerBoundaries for the current body and track.
+    /// \details The boundaries are computed once per body and track.
+    const std::vector<double>& LayerBoundaries();
+    /// \brief Integrates the equations over a distance, stopping at the layer boundaries.
+    /// @param dt Distance to evolve [eV^-1].
+    /// \details Unless Set_StopAtDiscontinuities() was enabled it just calls Evolve().
+    void EvolveAcrossLayers(double dt);
 
     /// \brief General initilizer for the multi energy mode
     /// @param Emin Minimum neutrino energy [GeV].
@@ -305,20 +592,59 @@ class nuSQUIDS: public squids::SQuIDS {
     /// is set to \c true then InitializeInteractionVectors() and InitializeInteractions()
     /// are called.
     void init(double Emin,double Emax,unsigned int Esize,bool initialize_intereractions = true, double xini = 0.0);
+    /// \brief Initializes a default constructed object in the multiple energy mode.
+    /// \details The parameters are those of the constructor reusing existing interaction
+    /// tables. nuSQUIDSAtm uses it to set up its zenith nodes, which are default
+    /// constructed objects of a class deriving from nuSQUIDS.
+    void init(double Emin,double Emax,unsigned int Esize,unsigned int numneu,NeutrinoType NT,
+              bool elogscale,bool iinteraction, std::shared_ptr<NeutrinoCrossSections> ncs,
+              std::shared_ptr<InteractionStructure> int_struct){
+      this->numneu = numneu;
+      this->NT = NT;
+      this->elogscale = elogscale;
+      this->iinteraction = iinteraction;
+      this->ncs = ncs;
+      init(Emin,Emax,Esize,int_struct == nullptr);
+      if(iinteraction and int_struct != nullptr)
+        SetInteractionStructure(int_struct);
+    }
     /// \brief Initilizer for the single energy mode
     /// @param xini The initial position of the system. By default is set to 0.
     void init(double xini = 0.0);
     /// \brief Initilizes auxiliary cross section arrays.
-    /// \details The arrays are initialize, but not filled with contented. To fill the arrays
+    /// \details A new nuSQUIDS#int_struct is allocated, but not filled with contented. To fill the arrays
     /// call InitializeInteractions().
     void InitializeInteractionVectors();
+    /// \brief Initilizes the interaction length arrays.
+    /// \details They are owned by each object, since they depend on the position along the track.
+    void InitializeInteractionLengthVectors();
     /// \brief Fills in auxiliary cross section arrays.
     /// \details It uses nuSQUIDS#ncs and nuSQUIDS#tdc to fill in the values of
-    /// nuSQUIDS#dNdE_CC , nuSQUIDS#dNdE_NC , nuSQUIDS#sigma_CC , nuSQUIDS#sigma_NC ,
-    /// nuSQUIDS#invlen_CC , nuSQUIDS#invlen_NC , nuSQUIDS#invlen_INT ,
-    /// nuSQUIDS#dNdE_tau_all , nuSQUIDS#dNdE_tau_lep , nuSQUIDS#invlen_tau
+    /// nuSQUIDS#int_struct.
     /// @see InitializeInteractionVectors
     void InitializeInteractions();
+    /// \brief Returns the file of the interaction cache that corresponds to this object.
+    /// \details It is empty if the cache is disabled or the cross sections have no key.
+    /// @see Set_InteractionCacheDirectory
+    std::string InteractionCacheFile() const;
+    /// \brief Fills nuSQUIDS#int_struct from a cache file.
+    /// @param filename Cache file.
+    /// @return \c false if the file does not exist or does not match this object.
+    bool ReadInteractionCache(const std::string& filename);
+    /// \brief Writes nuSQUIDS#int_struct to a cache file.
+    /// \details The file is written under a temporary name and then renamed, so concurrent
+    /// writers and readers never see partial files. Failures are ignored.
+    /// @param filename Cache file.
+    void WriteInteractionCache(const std::string& filename) const;
+    /// \brief Builds the neutral current and weighted tau kernels of nuSQUIDS#int_struct from its tables.
+    /// \details Called once the tables have been computed or read.
+    void InitializeInteractionKernels();
+    /// \brief Tau production rate at each energy node, indexed by scalar and energy.
+    /// \details Updated by UpdateTauProduction() and returned by InteractionsScalar().
+    marray<double,2> tau_production;
+    /// \brief Updates nuSQUIDS#tau_production from the current state.
+    /// \details One triangular matrix-vector product per neutrino type.
+    void UpdateTauProduction();
   private:
 
     /// \brief Sets all scalar arrays to zero.
@@ -344,6 +670,37 @@ class nuSQUIDS: public squids::SQuIDS {
   public:
     /// \brief Incorporated const object useful to evaluate units.
     const squids::Const units;
+  private:
+    /// \brief Boolean that signals that the state is evolved with EvolveLayers().
+    bool layered_evolution = false;
+    /// \brief Maximum length of the constant medium pieces of the layered evolution.
+    double layer_max_length = 100.0*units.km;
+    /// \brief Boolean that signals that constant bodies are evolved in closed form.
+    bool closed_form_evolution = true;
+    /// \brief Boolean that signals that the integration is stopped at the layer boundaries.
+    bool stop_at_discontinuities = false;
+    /// \brief Layer boundaries of the body along the track, see LayerBoundaries().
+    std::vector<double> layer_boundaries;
+    /// \brief Boolean that signals that nuSQUIDS#layer_boundaries belong to the current body and track.
+    bool layer_boundaries_current = false;
+    /// \brief Positions at which PreDerive() is called while integrating up to a layer boundary.
+    /// \details The largest advance of the evaluation position over the second half of the
+    /// piece is a fraction of the steps taken there, so twice it is used as the initial step
+    /// of the next piece. For the default Runge-Kutta-Fehlberg stepper, which evaluates a step
+    /// h at the offsets 0, h/4, 3h/8, 12h/13, h and h/2, the largest advance is
+    /// (12/13 - 3/8)h, about 0.55h, so twice it is about the last step. Other steppers
+    /// give a different fraction of it, which the step control then corrects.
+    struct StepProbe {
+      /// \brief Boolean that signals that the positions are being recorded.
+      bool active = false;
+      /// \brief Position after which the advances are recorded.
+      double from = 0;
+      /// \brief Largest position evaluated.
+      double x_max = 0;
+      /// \brief Largest advance of the position evaluated.
+      double advance = 0;
+    } step_probe;
+  public:
     /************************************************************************************
      * CONSTRUCTORS
     *************************************************************************************/
@@ -369,6 +726,16 @@ class nuSQUIDS: public squids::SQuIDS {
     numneu(numneu),ncs(ncs),iinteraction(iinteraction),elogscale(elogscale),NT(NT)
     {init(Emin,Emax,Esize);}
 
+    /// \brief Multiple energy mode constructor reusing existing interaction tables.
+    /// @param int_struct Interaction tables of an object constructed with the same
+    /// energy range, number of flavors, neutrino type and cross sections.
+    /// \details The other parameters are those of the multiple energy mode constructor.
+    /// The tables are shared rather than computed again, see SetInteractionStructure().
+    nuSQUIDS(double Emin,double Emax,unsigned int Esize,unsigned int numneu,NeutrinoType NT,
+       bool elogscale,bool iinteraction, std::shared_ptr<NeutrinoCrossSections> ncs,
+       std::shared_ptr<InteractionStructure> int_struct)
+    {init(Emin,Emax,Esize,numneu,NT,elogscale,iinteraction,ncs,int_struct);}
+
     /// \brief Single energy mode constructor.
     /// @param numneu Number of neutrino flavors.
     /// @param NT NeutrinoType: neutrino or antineutrino.
@@ -589,6 +956,76 @@ class nuSQUIDS: public squids::SQuIDS {
     /// @param opt If \c true tau regeneration will be considered.
     void Set_TauRegeneration(bool opt);
 
+    /// \brief Toggles the fused evaluation of the derivative terms.
+    /// @param opt If \c true the hamiltonian, attenuation and interaction terms of all the
+    /// nodes are evaluated in one pass at the beginning of each step into preallocated
+    /// storage, and the per-node functions return views of it, so no memory is allocated
+    /// while evolving.
+    /// \details Only objects of type nuSQUIDS use it: derived classes may override the
+    /// per-node functions, so they always use them.
+    void Set_FusedDerivatives(bool opt);
+
+    /// \brief Sets the directory of the interaction table cache.
+    /// @param directory Existing directory, or an empty string to disable the cache.
+    /// \details When set, objects built with interactions look for their cross section
+    /// and tau decay tables in a file whose name is a hash of the energy nodes, the
+    /// neutrino type, the number of flavors and the cross sections, and write it after
+    /// computing them if it does not exist. The file is a flat array of doubles that is
+    /// memory mapped when read. Only cross sections that provide a
+    /// NeutrinoCrossSections::CacheKey are cached. The setting is global, and it is
+    /// disabled by default.
+    static void Set_InteractionCacheDirectory(const std::string& directory);
+    /// \brief Returns the directory of the interaction table cache.
+    static std::string Get_InteractionCacheDirectory();
+
+    /// \brief Sets the number of threads used to compute the interaction tables.
+    /// @param n Number of threads. If \c n is zero the number of hardware threads is used.
+    /// \details Only cross sections that report
+    /// NeutrinoCrossSections::ThreadSafeDifferentialCrossSections are computed concurrently.
+    /// The setting is global, since the tables are computed by the constructors, and it
+    /// defaults to zero.
+    static void Set_InteractionThreads(unsigned int n);
+    /// \brief Returns the number of threads used to compute the interaction tables, zero
+    /// meaning the number of hardware threads.
+    static unsigned int Get_InteractionThreads();
+
+    /// \brief Toggles the evaluation of the body from a profile sampled along the track.
+    /// @param opt If \c true the density and electron fraction are sampled once along the
+    /// track into a TrackProfile, and every step interpolates it instead of evaluating the body.
+    /// @param tolerance Target largest difference between the profile and the body, relative
+    /// to the largest value along the track, see TrackProfile.
+    /// @param max_nodes Maximum number of nodes of the profile, each taking 16 bytes.
+    /// \details The profile is built when the evolution reaches the body for the first time
+    /// after Set_Body() or Set_Track(). It is disabled by default.
+    void Set_TrackProfile(bool opt, double tolerance = 1.0e-4, unsigned int max_nodes = 1u<<15);
+    /// \brief Returns the profile of the body along the track, or \c nullptr if it has not been built.
+    std::shared_ptr<const TrackProfile> GetTrackProfile() const { return track_profile; }
+
+    /// \brief Toggles the layered evolution.
+    /// @param opt If \c true EvolveState() does not integrate the equations, but splits the
+    /// track in pieces of constant density and applies the exact propagator of each piece.
+    /// @param max_length Maximum length of the pieces [eV^-1], or zero to keep the current one,
+    /// which is 100 km by default.
+    /// \details The pieces end at the layer boundaries of the body, see Body::GetLayerBoundaries,
+    /// and the density and electron fraction of each piece are averaged over it. Only the
+    /// coherent evolution is described, so it cannot be used with interactions.
+    void Set_LayeredEvolution(bool opt, double max_length = 0.);
+
+    /// \brief Toggles the closed form evolution in constant bodies.
+    /// @param opt If \c true, which is the default, EvolveState() evolves each energy node
+    /// with one matrix exponential when the body is constant (Body::IsConstant) and
+    /// interactions are disabled, instead of integrating the equations.
+    /// \details Derived classes are always integrated, since they may change the hamiltonian.
+    void Set_ClosedFormEvolution(bool opt);
+
+    /// \brief Toggles stopping the integration at the density discontinuities.
+    /// @param opt If \c true the integration is split at the positions returned by
+    /// Body::GetLayerBoundaries, so the adaptive stepper never steps across a density jump.
+    /// \details Each piece starts with a step estimated from the last steps of the previous
+    /// piece instead of the step given to Set_h(), which is restored afterwards. It is
+    /// meant for the adaptive stepper, and it is disabled by default.
+    void Set_StopAtDiscontinuities(bool opt);
+
     /// \brief Toggles positivization of the flux.
     /// @param opt If \c true the flux will be forced to be positive every \c positivization_step.
     void Set_PositivityConstrain(bool opt);
@@ -610,11 +1047,17 @@ class nuSQUIDS: public squids::SQuIDS {
     /// \brief Returns the number of neutrino flavors.
     unsigned int GetNumNeu() const;
 
+    /// \brief Returns the number of density matrices per energy node, two when
+    /// NeutrinoType is \c both and one otherwise.
+    unsigned int GetNumRho() const;
+
     /// \brief Return the Hamiltonian at the current time
     squids::SU_vector GetHamiltonian(unsigned int ei, unsigned int rho = 0);
     /// \brief Returns the state
     squids::SU_vector GetState(unsigned int,unsigned int rho = 0) const;
     /// \brief Returns the flavor projector
+    /// \details The SU_vector is a view of the projector storage of the object, copy it
+    /// to modify it or to keep it after the object is destroyed.
     squids::SU_vector GetFlavorProj(unsigned int,unsigned int rho = 0) const;
     /// \brief Returns the mass projector
     squids::SU_vector GetMassProj(unsigned int,unsigned int rho = 0) const;
@@ -624,6 +1067,17 @@ class nuSQUIDS: public squids::SQuIDS {
     /// \brief Returns the body object.
     std::shared_ptr<Body> GetBody() const;
 
+    /// \brief Returns the cross section and tau decay tables.
+    /// \details Returns \c nullptr if interactions are not considered.
+    std::shared_ptr<InteractionStructure> GetInteractionStructure() const;
+    /// \brief Uses the given cross section and tau decay tables.
+    /// @param int_struct Tables of an object with the same energy nodes, neutrino type
+    /// and cross sections, as returned by its GetInteractionStructure().
+    /// \details The tables are shared, not copied, and are not modified afterwards.
+    /// Interactions must be enabled, and the table dimensions must match the ones
+    /// of this object.
+    void SetInteractionStructure(std::shared_ptr<InteractionStructure> int_struct);
+
     /// \brief Writes the object into an HDF5 file.
     /// @param hdf5_filename Filename of the HDF5 to use for construction.
     /// @param group Path to the group where the nuSQUIDS content will be saved.
@@ -737,10 +1191,61 @@ class nuSQUIDSAtm {
   private:
     /// \brief Boolean that signals that a progress bar will be printed.
     bool progressbar = false;
+    /// \brief Number of threads used to evolve the zenith bins.
+    unsigned int nthreads = 1;
+    /// \brief User supplied cost of evolving each zenith bin.
+    /// @see Set_ZenithCostEstimates
+    std::vector<double> zenith_cost_estimates;
+    /// \brief Wall time in seconds spent evolving each zenith bin by the last EvolveState().
+    std::vector<double> zenith_evolution_times;
     /// \brief Bilinear interpolator.
     double LinInter(double x,double xM, double xP, double yM, double yP) const {
       return yM + (yP-yM)*(x-xM)/(xP-xM);
     }
+    /// \brief Returns the spacing of a grid if it is uniform and zero otherwise.
+    static double UniformStep(const marray<double,1>& grid){
+      size_t n = grid.extent(0);
+      if(n < 2)
+        return 0;
+      double step = (grid[n-1]-grid[0])/(n-1);
+      for(size_t i = 0; i < n; i++){
+        if(std::abs(grid[0] + i*step - grid[i]) > 1.0e-6*step)
+          return 0;
+      }
+      return step;
+    }
+    /// \brief Returns the index of the first interval [grid[i],grid[i+1]] that contains x.
+    /// @param grid Increasing grid with at least two nodes.
+    /// @param x Value within the grid.
+    /// @param step Grid spacing as returned by UniformStep(). If it is zero a binary search is used.
+    static size_t FindInterval(const marray<double,1>& grid, double x, double step){
+      size_t n = grid.extent(0);
+      size_t i;
+      if(step > 0){
+        i = static_cast<size_t>(std::min<double>(std::max(0.0,std::floor((x-grid[0])/step)),n-2));
+      } else {
+        const double* data = grid.get_data();
+        i = std::upper_bound(data,data+n,x) - data;
+        i = std::min<size_t>(i == 0 ? 0 : i-1,n-2);
+      }
+      // corrects rounding in the uniform guess, and picks the lower interval when x is a node
+      while(i+2 < n and x > grid[i+1])
+        i++;
+      while(i > 0 and x <= grid[i])
+        i--;
+      return i;
+    }
+    /// \brief Throws if (costh,enu) is outside of the table.
+    void CheckEvalBounds(double costh,double enu) const {
+      if( costh < *costh_array.begin() or costh > *costh_array.rbegin())
+        throw std::runtime_error("nuSQUIDSAtm::Error::EvalFlavor::cos(th) out of bounds.");
+      if( enu < *enu_array.begin() or enu > *enu_array.rbegin() )
+        throw std::runtime_error("nuSQUIDSAtm::Error::EvalFlavor::neutrino energy out of bounds.(Emin = " +
+                                 std::to_string(*enu_array.begin()) +
+                                 ",Emax = " +
+                                 std::to_string(*enu_array.rbegin()) +
+                                 ", Enu = " + std::to_string(enu) + ")");
+    }
     /// \brief Boolean that signals that an initial state has being set.
     bool iinistate;
     /// \brief Boolean that signals the object correct initialization.
@@ -752,14 +1257,563 @@ class nuSQUIDSAtm {
     /// \brief Contains the log of energy nodes.
     marray<double,1> log_enu_array;
     /// \brief Contains the nuSQUIDS objects for each zenith.
-    std::vector<BaseSQUIDS> nusq_array;
+    /// \details Mutable since zenith nodes read in lazy mode are filled in on first access.
+    mutable std::vector<BaseSQUIDS> nusq_array;
 
     /// \brief Contains the Earth in atmospheric configuration.
-    std::shared_ptr<EarthAtm> earth_atm;
+    mutable std::shared_ptr<EarthAtm> earth_atm;
+
+    /// \brief HDF5 file from which the zenith nodes are read in lazy mode.
+    std::string lazy_filename;
+    /// \brief True if nuSQUIDSAtm#lazy_filename uses the consolidated layout.
+    bool lazy_consolidated = false;
+    /// \brief True if the cross sections are read along with the zenith nodes.
+    bool lazy_cross_sections = true;
+    /// \brief Flags the zenith nodes which have already been read.
+    mutable std::vector<bool> materialized;
+    /// \brief Number of zenith nodes which have not been read yet.
+    mutable std::atomic<size_t> pending_zenith{0};
+    /// \brief Serializes the reading of zenith nodes.
+    mutable std::mutex lazy_mutex;
     /// \brief Contains the trajectories for each nuSQUIDS object, i.e. zenith.
     std::vector<std::shared_ptr<EarthAtm::Track>> track_array;
     /// \brief Contains the neutrino cross section object
     std::shared_ptr<NeutrinoCrossSections> ncs;
+    /// \brief GSL stepper given to Set_GSL_step(), used for zenith nodes added later.
+    gsl_odeiv2_step_type const * gsl_step = nullptr;
+    /// \brief HDF5 file where EvolveState() records its progress, empty if checkpointing is disabled.
+    /// @see Set_Checkpoint
+    std::string checkpoint_filename;
+    /// \brief Length [eV^-1] of the pieces in which the zenith bins are evolved when checkpointing.
+    double checkpoint_segment = 0;
+    /// \brief Distance [eV^-1] that each zenith bin has been evolved by the current evolution.
+    std::vector<double> zenith_progress;
+    /// \brief Serializes the writing of checkpoints.
+    std::mutex checkpoint_mutex;
+
+    /// \brief Writes the per-zenith contents in the consolidated layout.
+    /// @param root_id HDF5 location where the datasets will be created.
+    /// @see WriteStateHDF5
+    void WriteConsolidatedHDF5(hid_t root_id) const{
+      const nuSQUIDS& first = nusq_array[0];
+      const hsize_t ncosth = nusq_array.size();
+      const hsize_t ntrack = first.GetTrack()->GetTrackParams().size();
+      const hsize_t nbody = first.GetBody()->GetBodyParams().size();
+
+      std::vector<double> state, flavor, mass, t, t_ini, tracks, track_x, bodies;
+      std::vector<unsigned int> body_ids;
+      for(const nuSQUIDS& nsq : nusq_array){
+        if(nsq.GetTrack()->GetTrackParams().size() != ntrack or nsq.GetBody()->GetBodyParams().size() != nbody)
+          throw std::runtime_error("nuSQUIDSAtm::Error::All zenith nodes must use the same kind of body and track.");
+        std::vector<double> nsq_state = nsq.GetStateData();
+        state.insert(state.end(),nsq_state.begin(),nsq_state.end());
+        nsq.GetCompositionData(flavor,mass);
+        t.push_back(nsq.Get_t());
+        t_ini.push_back(nsq.Get_t_initial());
+        std::vector<double> track_params = nsq.GetTrack()->GetTrackParams();
+        tracks.insert(tracks.end(),track_params.begin(),track_params.end());
+        track_x.push_back(nsq.GetTrack()->GetInitialX());
+        track_x.push_back(nsq.GetTrack()->GetFinalX());
+        track_x.push_back(nsq.GetTrack()->GetX());
+        std::vector<double> body_params = nsq.GetBody()->GetBodyParams();
+        bodies.insert(bodies.end(),body_params.begin(),body_params.end());
+        body_ids.push_back(nsq.GetBody()->GetId());
+      }
+
+      H5LTset_attribute_string(root_id, ".", "layout", "consolidated");
+
+      // energies, basic settings and mixing parameters are common to all nodes
+      first.WriteParametersHDF5(root_id);
+
+      hsize_t statedims[4] {ncosth, first.ne, first.nrhos, static_cast<hsize_t>(first.numneu)*first.numneu};
+      H5LTmake_dataset(root_id,"state",4,statedims,H5T_NATIVE_DOUBLE,state.data());
+      hsize_t compdims[4] {ncosth, first.ne, first.nrhos, first.numneu};
+      H5LTmake_dataset(root_id,"flavorcomp",4,compdims,H5T_NATIVE_DOUBLE,flavor.data());
+      H5LTmake_dataset(root_id,"masscomp",4,compdims,H5T_NATIVE_DOUBLE,mass.data());
+
+      hsize_t timedims[1] {ncosth};
+      H5LTmake_dataset(root_id,"squids_time",1,timedims,H5T_NATIVE_DOUBLE,t.data());
+      H5LTmake_dataset(root_id,"squids_time_initial",1,timedims,H5T_NATIVE_DOUBLE,t_ini.data());
+
+      hsize_t trackdims[2] {ncosth, ntrack};
+      H5LTmake_dataset(root_id,"tracks",2,trackdims,H5T_NATIVE_DOUBLE,tracks.data());
+      hsize_t xdims[2] {ncosth, 3};
+      H5LTmake_dataset(root_id,"track_x",2,xdims,H5T_NATIVE_DOUBLE,track_x.data());
+      hsize_t bodydims[2] {ncosth, nbody};
+      H5LTmake_dataset(root_id,"bodies",2,bodydims,H5T_NATIVE_DOUBLE,bodies.data());
+      H5LTmake_dataset(root_id,"body_ids",1,timedims,H5T_NATIVE_UINT,body_ids.data());
+
+      hid_t xs_group_id = H5Gcreate(root_id, "crosssections", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+      if(first.iinteraction)
+        first.WriteCrossSectionsHDF5(xs_group_id);
+      H5Gclose(xs_group_id);
+
+      // user parameters, one group per zenith node
+      hid_t user_parameters_id = H5Gcreate(root_id, "user_parameters", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+      for(unsigned int i = 0; i < ncosth; i++){
+        hid_t node_id = H5Gcreate(user_parameters_id, ("costh_"+std::to_string(costh_array[i])).c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        nusq_array[i].AddToWriteHDF5(node_id);
+        H5Gclose(node_id);
+      }
+      H5Gclose(user_parameters_id);
+    }
+
+    /// \brief Reads or writes one row, i.e. the entries of one zenith node, of a consolidated dataset.
+    /// @param root_id HDF5 location of the dataset.
+    /// @param name Name of the dataset.
+    /// @param row Index of the zenith node.
+    /// @param type HDF5 memory type of the entries.
+    /// @param data Buffer large enough to hold one row.
+    /// @param write If \c true \c data is written to the row, otherwise the row is read into \c data.
+    /// \return The number of entries in the row.
+    static size_t TransferZenithRow(hid_t root_id, const std::string& name, size_t row, hid_t type, void* data, bool write){
+      hid_t dset_id = H5Dopen(root_id, name.c_str(), H5P_DEFAULT);
+      if(dset_id < 0)
+        throw std::runtime_error("nuSQUIDSAtm::Error::Dataset '" + name + "' does not exist in HDF5.");
+      hid_t file_space = H5Dget_space(dset_id);
+      int rank = H5Sget_simple_extent_ndims(file_space);
+      std::vector<hsize_t> dims(rank), start(rank,0);
+      H5Sget_simple_extent_dims(file_space, dims.data(), NULL);
+      if(row >= dims[0]){
+        H5Sclose(file_space);
+        H5Dclose(dset_id);
+        throw std::runtime_error("nuSQUIDSAtm::Error::Dataset '" + name + "' has no row for zenith node " + std::to_string(row) + ".");
+      }
+      start[0] = row;
+      dims[0] = 1;
+      hsize_t size = 1;
+      for(hsize_t dim : dims)
+        size *= dim;
+      if(size != 0 and data != nullptr){
+        H5Sselect_hyperslab(file_space, H5S_SELECT_SET, start.data(), NULL, dims.data(), NULL);
+        hid_t mem_space = H5Screate_simple(rank, dims.data(), NULL);
+        if(write)
+          H5Dwrite(dset_id, type, mem_space, file_space, H5P_DEFAULT, data);
+        else
+          H5Dread(dset_id, type, mem_space, file_space, H5P_DEFAULT, data);
+        H5Sclose(mem_space);
+      }
+      H5Sclose(file_space);
+      H5Dclose(dset_id);
+      return size;
+    }
+
+    /// \brief Reads one row of a consolidated dataset, see TransferZenithRow().
+    static size_t ReadZenithRow(hid_t root_id, const std::string& name, size_t row, hid_t type, void* data){
+      return TransferZenithRow(root_id,name,row,type,data,false);
+    }
+
+    /// \brief Writes one row of a consolidated dataset, see TransferZenithRow().
+    static void WriteZenithRow(hid_t root_id, const std::string& name, size_t row, hid_t type, const void* data){
+      TransferZenithRow(root_id,name,row,type,const_cast<void*>(data),true);
+    }
+
+    /// \brief Returns the number of entries per zenith node of a consolidated dataset.
+    static size_t ZenithRowSize(hid_t root_id, const std::string& name){
+      return ReadZenithRow(root_id,name,0,H5T_NATIVE_DOUBLE,nullptr);
+    }
+
+    /// \brief Reads one zenith node written by WriteConsolidatedHDF5().
+    /// @param root_id HDF5 location of the datasets.
+    /// @param i Index of the zenith node.
+    /// @param read_cross_sections Whether to read the interaction tables.
+    void ReadConsolidatedZenith(hid_t root_id, unsigned int i, bool read_cross_sections) const{
+      nuSQUIDS& nsq = nusq_array[i];
+      std::vector<double> energies = nsq.ReadParametersHDF5(root_id);
+
+      std::vector<double> state(ZenithRowSize(root_id,"state"));
+      if(state.size() != energies.size()*(nsq.NT == both ? 2 : 1)*nsq.numneu*nsq.numneu)
+        throw std::runtime_error("nuSQUIDSAtm::Error::State dimensions do not match the stored settings.");
+      ReadZenithRow(root_id,"state",i,H5T_NATIVE_DOUBLE,state.data());
+
+      double t, t_ini, track_x[3];
+      unsigned int body_id;
+      ReadZenithRow(root_id,"squids_time",i,H5T_NATIVE_DOUBLE,&t);
+      ReadZenithRow(root_id,"squids_time_initial",i,H5T_NATIVE_DOUBLE,&t_ini);
+      ReadZenithRow(root_id,"track_x",i,H5T_NATIVE_DOUBLE,track_x);
+      ReadZenithRow(root_id,"body_ids",i,H5T_NATIVE_UINT,&body_id);
+      std::vector<double> track_params(ZenithRowSize(root_id,"tracks"));
+      ReadZenithRow(root_id,"tracks",i,H5T_NATIVE_DOUBLE,track_params.data());
+      std::vector<double> body_params(ZenithRowSize(root_id,"bodies"));
+      ReadZenithRow(root_id,"bodies",i,H5T_NATIVE_DOUBLE,body_params.data());
+
+      nsq.RestoreStateHDF5(root_id,energies,t_ini,t,body_id,body_params,track_params,
+                           track_x[2],state.data(),earth_atm);
+
+      if(nsq.iinteraction and read_cross_sections){
+        hid_t xs_group_id = H5Gopen(root_id, "crosssections", H5P_DEFAULT);
+        nsq.ReadCrossSectionsHDF5(xs_group_id);
+        H5Gclose(xs_group_id);
+      }
+
+      std::string node_name = "user_parameters/costh_"+std::to_string(costh_array[i]);
+      if(H5Lexists(root_id,"user_parameters",H5P_DEFAULT) > 0 and
+         H5Lexists(root_id,node_name.c_str(),H5P_DEFAULT) > 0){
+        hid_t node_id = H5Gopen(root_id, node_name.c_str(), H5P_DEFAULT);
+        nsq.AddToReadHDF5(node_id);
+        H5Gclose(node_id);
+      }
+    }
+
+    /// \brief Reads a zenith node from nuSQUIDSAtm#lazy_filename.
+    /// @param root_id Root group of the open file.
+    /// @param i Index of the zenith node.
+    /// \details The node reuses nuSQUIDSAtm#earth_atm and the interaction tables of the
+    /// nodes already read, so the Earth model and the cross sections are read only once.
+    void MaterializeZenith(hid_t root_id, unsigned int i) const{
+      nuSQUIDS& nsq = nusq_array[i];
+      std::shared_ptr<nuSQUIDS::InteractionStructure> tables = nullptr;
+      for(unsigned int j = 0; j < nusq_array.size() and tables == nullptr; j++){
+        if(materialized[j])
+          tables = nusq_array[j].GetInteractionStructure();
+      }
+      bool read_cross_sections = lazy_cross_sections and tables == nullptr;
+
+      if(lazy_consolidated)
+        ReadConsolidatedZenith(root_id,i,read_cross_sections);
+      else
+        nsq.ReadGroupHDF5(root_id,"costh_"+std::to_string(costh_array[i]),"crosssections",read_cross_sections,earth_atm);
+
+      if(nsq.iinteraction){
+        if(not lazy_cross_sections)
+          nsq.iinteraction = false;
+        else if(not read_cross_sections)
+          nsq.SetInteractionStructure(tables);
+      }
+      if(earth_atm == nullptr)
+        earth_atm = std::dynamic_pointer_cast<EarthAtm>(nsq.GetBody());
+    }
+
+    /// \brief Makes sure that the given zenith nodes have been read.
+    /// @param zenith Indices of the zenith nodes.
+    /// \details Only does something for objects read with ReadStateHDF5() in lazy mode.
+    /// Safe to call from several threads at once.
+    void MaterializeZenith(const std::vector<size_t>& zenith) const{
+      if(pending_zenith.load(std::memory_order_acquire) == 0)
+        return;
+      std::lock_guard<std::mutex> lock(lazy_mutex);
+      std::vector<size_t> missing;
+      for(size_t i : zenith){
+        if(i < materialized.size() and not materialized[i] and
+           std::find(missing.begin(),missing.end(),i) == missing.end())
+          missing.push_back(i);
+      }
+      if(missing.empty())
+        return;
+
+      // this lines supress HDF5 error messages
+      H5Eset_auto (H5E_DEFAULT,NULL, NULL);
+      hid_t file_id = H5Fopen(lazy_filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+      if (file_id < 0)
+          throw std::runtime_error("nuSQUIDSAtm::Error::file not found : " + lazy_filename + ".");
+      hid_t root_id = H5Gopen(file_id, "/",H5P_DEFAULT);
+      try{
+        for(size_t i : missing){
+          MaterializeZenith(root_id,i);
+          materialized[i] = true;
+          pending_zenith.fetch_sub(1,std::memory_order_release);
+        }
+      } catch(...){
+        H5Gclose(root_id);
+        H5Fclose(file_id);
+        throw;
+      }
+      H5Gclose(root_id);
+      H5Fclose(file_id);
+    }
+
+    /// \brief Makes sure that a zenith node has been read.
+    void MaterializeZenith(size_t i) const{
+      MaterializeZenith(std::vector<size_t>{i});
+    }
+
+    /// \brief Makes sure that all the zenith nodes have been read.
+    void MaterializeAll() const{
+      if(pending_zenith.load(std::memory_order_acquire) == 0)
+        return;
+      std::vector<size_t> zenith(nusq_array.size());
+      std::iota(zenith.begin(),zenith.end(),0);
+      MaterializeZenith(zenith);
+    }
+
+    /// \brief Checks that the zenith bins can be evolved at the same time.
+    /// \details Tracks keep the lookup state of the body splines, so no track can be
+    /// shared between bins, and a body can only be shared if Body::IsThreadSafe().
+    bool CanEvolveConcurrently() const{
+      std::vector<const Body*> bodies;
+      std::vector<const Track*> tracks;
+      for(const nuSQUIDS& nsq : nusq_array){
+        const Track* track = nsq.GetTrack().get();
+        if(std::find(tracks.begin(),tracks.end(),track) != tracks.end())
+          return false;
+        tracks.push_back(track);
+        const Body* body = nsq.GetBody().get();
+        if(body != nullptr and body->IsThreadSafe())
+          continue;
+        if(std::find(bodies.begin(),bodies.end(),body) != bodies.end())
+          return false;
+        bodies.push_back(body);
+      }
+      return true;
+    }
+
+    /// \brief Estimates the relative cost of evolving each zenith bin.
+    /// \details The number of integration steps grows both with the length of the
+    /// path that remains to be evolved and with the amount of matter it crosses, so
+    /// the cost is taken to be the integral of (1 + density/(gr/cm^3)) along the
+    /// remaining path, in km. For bodies other than EarthAtm only the length is used.
+    std::vector<double> EstimateZenithCosts() const{
+      const unsigned int nsamples = 100;
+      std::vector<double> costs;
+      for(unsigned int i = 0; i < nusq_array.size(); i++){
+        std::shared_ptr<Track> track = nusq_array[i].GetTrack();
+        double length = track->GetFinalX() - track->GetX();
+        double cost = length;
+
+        std::shared_ptr<EarthAtm> body = std::dynamic_pointer_cast<EarthAtm>(nusq_array[i].GetBody());
+        if(body != nullptr){
+          // probe a new track so that the bin track position is left untouched
+          EarthAtm::Track probe(acos(costh_array[i]));
+          double dx = length/nsamples;
+          for(unsigned int k = 0; k < nsamples; k++){
+            probe.SetX(track->GetX() + (k+0.5)*dx);
+            cost += body->density(probe)*dx;
+          }
+        }
+        costs.push_back(cost/units.km);
+      }
+      return costs;
+    }
+
+    /// \brief Writes the checkpoint file at the start of an evolution.
+    /// \details The file has the consolidated layout of WriteStateHDF5() plus the
+    /// \c checkpoint_progress dataset, with the distance each bin has been evolved
+    /// and the length of the pieces as its \c segment attribute, and the
+    /// \c checkpoint_scalars dataset, with the charged tau fluxes of each bin.
+    void CreateCheckpoint() const{
+      WriteStateHDF5(checkpoint_filename,true);
+
+      hid_t file_id = H5Fopen(checkpoint_filename.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+      if (file_id < 0)
+          throw std::runtime_error("nuSQUIDSAtm::Error::Cannot open checkpoint at " + checkpoint_filename + ".");
+      hid_t root_id = H5Gopen(file_id, "/",H5P_DEFAULT);
+
+      std::vector<double> scalars;
+      for(const nuSQUIDS& nsq : nusq_array){
+        std::vector<double> nsq_scalars = nsq.GetScalarData();
+        scalars.insert(scalars.end(),nsq_scalars.begin(),nsq_scalars.end());
+      }
+      const hsize_t ncosth = nusq_array.size();
+      const hsize_t ne = enu_array.extent(0);
+      hsize_t scalardims[3] {ncosth, ne, scalars.size()/(ncosth*ne)};
+      H5LTmake_dataset(root_id,"checkpoint_scalars",3,scalardims,H5T_NATIVE_DOUBLE,scalars.data());
+      hsize_t progressdims[1] {ncosth};
+      H5LTmake_dataset(root_id,"checkpoint_progress",1,progressdims,H5T_NATIVE_DOUBLE,zenith_progress.data());
+      H5LTset_attribute_double(root_id,"checkpoint_progress","segment",&checkpoint_segment,1);
+
+      H5Gclose(root_id);
+      H5Fclose(file_id);
+    }
+
+    /// \brief Records the state and progress of a zenith bin in the checkpoint file.
+    /// @param i Index of the bin.
+    /// \details Only the rows of the bin are rewritten. Safe to call from the thread
+    /// evolving the bin while other bins are evolved.
+    void WriteCheckpointRow(size_t i){
+      const nuSQUIDS& nsq = nusq_array[i];
+      std::vector<double> state = nsq.GetStateData();
+      std::vector<double> scalars = nsq.GetScalarData();
+      std::vector<double> flavor, mass;
+      nsq.GetCompositionData(flavor,mass);
+      double t = nsq.Get_t();
+      double track_x[3] {nsq.GetTrack()->GetInitialX(), nsq.GetTrack()->GetFinalX(), nsq.GetTrack()->GetX()};
+
+      std::lock_guard<std::mutex> lock(checkpoint_mutex);
+      hid_t file_id = H5Fopen(checkpoint_filename.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+      if (file_id < 0)
+          throw std::runtime_error("nuSQUIDSAtm::Error::Cannot open checkpoint at " + checkpoint_filename + ".");
+      hid_t root_id = H5Gopen(file_id, "/",H5P_DEFAULT);
+      try{
+        WriteZenithRow(root_id,"state",i,H5T_NATIVE_DOUBLE,state.data());
+        WriteZenithRow(root_id,"checkpoint_scalars",i,H5T_NATIVE_DOUBLE,scalars.data());
+        WriteZenithRow(root_id,"flavorcomp",i,H5T_NATIVE_DOUBLE,flavor.data());
+        WriteZenithRow(root_id,"masscomp",i,H5T_NATIVE_DOUBLE,mass.data());
+        WriteZenithRow(root_id,"squids_time",i,H5T_NATIVE_DOUBLE,&t);
+        WriteZenithRow(root_id,"track_x",i,H5T_NATIVE_DOUBLE,track_x);
+        // the progress goes last, so that it never runs ahead of the state
+        WriteZenithRow(root_id,"checkpoint_progress",i,H5T_NATIVE_DOUBLE,&zenith_progress[i]);
+      } catch(...){
+        H5Gclose(root_id);
+        H5Fclose(file_id);
+        throw;
+      }
+      H5Gclose(root_id);
+      H5Fclose(file_id);
+    }
+
+    /// \brief Evolves one zenith bin.
+    /// @param i Index of the bin.
+    /// @param checkpoint If \c true the bin continues from the distance in
+    /// nuSQUIDSAtm#zenith_progress, in pieces of nuSQUIDSAtm#checkpoint_segment,
+    /// and its state is recorded in the checkpoint file after each piece.
+    void EvolveBin(size_t i, bool checkpoint){
+      nuSQUIDS& nsq = nusq_array[i];
+      if(not checkpoint){
+        nsq.EvolveState();
+        return;
+      }
+      std::shared_ptr<Track> track = nsq.GetTrack();
+      const double length = track->GetFinalX() - track->GetInitialX();
+      while(zenith_progress[i] < length){
+        double to = length;
+        if(checkpoint_segment > 0)
+          to = std::min(zenith_progress[i] + checkpoint_segment,length);
+        nsq.EvolveInterval(zenith_progress[i],to);
+        zenith_progress[i] = to;
+        WriteCheckpointRow(i);
+      }
+    }
+
+    /// \brief Evolves the zenith bins concurrently.
+    /// @param zenith Indices of the bins to evolve.
+    /// @param nworkers Number of threads to use.
+    /// \details The bins are handed out by a WorkStealingScheduler using the costs
+    /// given to Set_ZenithCostEstimates() or, if none were given, the ones from
+    /// EstimateZenithCosts(). Each bin is evolved exactly as in the serial path,
+    /// sharing nuSQUIDSAtm#earth_atm, since the spline lookup state lives in the
+    /// tracks. The per-zenith progress bars are suppressed, and a line is printed as
+    /// each bin finishes instead.
+    /// @param checkpoint Whether the bins are checkpointed, see EvolveBin().
+    void EvolveStateParallel(const std::vector<size_t>& zenith, unsigned int nworkers, bool checkpoint){
+      std::vector<bool> nsq_progressbar;
+      for(nuSQUIDS& nsq : nusq_array){
+        nsq_progressbar.push_back(nsq.progressbar);
+        nsq.Set_ProgressBar(false);
+      }
+      auto restore = [&](){
+        for(unsigned int i = 0; i < nusq_array.size(); i++)
+          nusq_array[i].Set_ProgressBar(nsq_progressbar[i]);
+      };
+
+      std::vector<double> all_costs = zenith_cost_estimates;
+      if(all_costs.size() != nusq_array.size())
+        all_costs = EstimateZenithCosts();
+      std::vector<double> costs;
+      for(size_t i : zenith)
+        costs.push_back(all_costs[i]);
+
+      std::mutex output_mutex;
+      auto evolve_bin = [&](unsigned int itask, unsigned int worker){
+        size_t i = zenith[itask];
+        EvolveBin(i,checkpoint);
+        if(progressbar){
+          std::lock_guard<std::mutex> lock(output_mutex);
+          std::cout << "Finished cos(th) = " + std::to_string(costh_array[i]) << std::endl;
+        }
+      };
+
+      std::vector<double> times;
+      try{
+        times = WorkStealingScheduler(nworkers).Run(costs,evolve_bin);
+      } catch(...) {
+        restore();
+        throw;
+      }
+      restore();
+      for(size_t itask = 0; itask < zenith.size(); itask++)
+        zenith_evolution_times[zenith[itask]] = times[itask];
+    }
+
+    /// \brief Evolves some of the zenith bins.
+    /// @param zenith Indices of the bins to evolve.
+    /// @param checkpoint Whether the bins are checkpointed, see EvolveBin().
+    /// \details Uses EvolveStateParallel() when more than one thread has been requested
+    /// and the bins can be evolved concurrently. The wall time of each evolved bin is
+    /// stored in nuSQUIDSAtm#zenith_evolution_times.
+    void EvolveZenith(const std::vector<size_t>& zenith, bool checkpoint = false){
+      zenith_evolution_times.resize(nusq_array.size(),0.0);
+      if(nthreads > 1 and zenith.size() > 1 and CanEvolveConcurrently()){
+        EvolveStateParallel(zenith,std::min<size_t>(nthreads,zenith.size()),checkpoint);
+        return;
+      }
+      for(size_t i : zenith){
+        nuSQUIDS& nsq = nusq_array[i];
+        if(progressbar){
+          std::cout << "Calculating cos(th) = " + std::to_string(costh_array[i]) << std::endl;
+        }
+        auto start = std::chrono::steady_clock::now();
+        EvolveBin(i,checkpoint);
+        zenith_evolution_times[i] = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        if(progressbar){
+          std::cout << std::endl;
+        }
+      }
+    }
+
+    /// \brief Builds a zenith node with the settings of the existing ones.
+    /// @param costh Cosine of the zenith of the new node.
+    /// @param nsq Node to initialize.
+    /// \details The node uses the energy grid, mixing parameters, numerical settings,
+    /// interaction tables and Earth model of the first zenith node. Its initial state
+    /// still has to be set.
+    void MakeZenithInstance(double costh, BaseSQUIDS& nsq) const{
+      const nuSQUIDS& reference = nusq_array[0];
+      // nsq is initialized in place, so that what BaseSQUIDS sets up is kept
+      nsq.init(enu_array[0],enu_array[enu_array.extent(0)-1],enu_array.extent(0),
+               reference.numneu,reference.NT,reference.elogscale,reference.iinteraction,
+               ncs,reference.GetInteractionStructure());
+      if(earth_atm == nullptr)
+        earth_atm = std::make_shared<EarthAtm>();
+      nsq.Set_Body(earth_atm);
+      nsq.Set_Track(std::make_shared<EarthAtm::Track>(acos(costh)));
+
+      for(unsigned int i = 0; i < reference.numneu; i++){
+        for(unsigned int j = i+1; j < reference.numneu; j++){
+          nsq.Set_MixingAngle(i,j,reference.Get_MixingAngle(i,j));
+          nsq.Set_CPPhase(i,j,reference.Get_CPPhase(i,j));
+        }
+      }
+      for(unsigned int i = 1; i < reference.numneu; i++)
+        nsq.Set_SquareMassDifference(i,reference.Get_SquareMassDifference(i));
+
+      nsq.Set_rel_error(reference.Get_rel_error());
+      nsq.Set_abs_error(reference.Get_abs_error());
+      if(gsl_step != nullptr)
+        nsq.Set_GSL_step(gsl_step);
+      nsq.Set_Basis(reference.basis);
+      nsq.Set_TauRegeneration(reference.tauregeneration);
+      nsq.Set_FusedDerivatives(reference.fused_derivatives);
+      nsq.Set_TrackProfile(reference.use_track_profile,reference.track_profile_tolerance,reference.track_profile_max_nodes);
+      nsq.Set_LayeredEvolution(reference.layered_evolution,reference.layer_max_length);
+      nsq.Set_StopAtDiscontinuities(reference.stop_at_discontinuities);
+      nsq.Set_ClosedFormEvolution(reference.closed_form_evolution);
+      nsq.Set_PositivityConstrain(reference.positivization);
+      nsq.Set_PositivityConstrainStep(reference.positivization_scale);
+      nsq.Set_ProgressBar(reference.progressbar);
+    }
+
+    /// \brief Sets the initial state of one zenith node.
+    /// @param nsq Zenith node.
+    /// @param ini_flux Initial state with dimensions (energy,rho,flavor).
+    /// @param basis Representation of the neutrino state either flavor or mass.
+    void SetZenithInitialState(nuSQUIDS& nsq, const marray<double,3>& ini_flux, Basis basis) const{
+      if(ini_flux.extent(0) != enu_array.extent(0))
+        throw std::runtime_error("nuSQUIDSAtm::Error::First dimension of the initial state is incorrect.");
+      if(nsq.NT == both){
+        if(ini_flux.extent(1) != 2)
+          throw std::runtime_error("nuSQUIDSAtm::Error::Second dimension of the initial state must be two.");
+        nsq.Set_initial_state(ini_flux,basis);
+        return;
+      }
+      if(ini_flux.extent(1) != 1)
+        throw std::runtime_error("nuSQUIDSAtm::Error::Second dimension of the initial state must be one.");
+      marray<double,2> slice{ini_flux.extent(0),ini_flux.extent(2)};
+      for(size_t j=0; j<ini_flux.extent(0); j++){
+        for(size_t k=0; k<ini_flux.extent(2); k++)
+          slice[j][k]=ini_flux[j][0][k];
+      }
+      nsq.Set_initial_state(slice,basis);
+    }
   public:
     /************************************************************************************
      * CONSTRUCTORS
@@ -807,7 +1861,7 @@ class nuSQUIDSAtm {
     costh_array(costh_array)
     {
 
-      nusq_array = std::vector<nuSQUIDS>(costh_array.extent(0));
+      nusq_array = std::vector<BaseSQUIDS>(costh_array.extent(0));
 
       if(elogscale){
         enu_array = logspace(energy_min,energy_max,energy_div-1);
@@ -817,35 +1871,45 @@ class nuSQUIDSAtm {
       }
       log_enu_array.resize(0,enu_array.size());
       std::transform(enu_array.begin(), enu_array.end(), log_enu_array.begin(),
-                     [](int enu) { return log(enu); });
+                     [](double enu) { return log(enu); });
 
       earth_atm = std::make_shared<EarthAtm>();
       for(double costh : costh_array)
         track_array.push_back(std::make_shared<EarthAtm::Track>(acos(costh)));
-      if (ncs == nullptr)
-        ncs = std::make_shared<NeutrinoDISCrossSectionsFromTables>();
-
+      // the cross section tables are computed once and shared by all zeniths
+      // the first one also creates the default cross sections, unless it finds its tables in the cache
+      std::shared_ptr<nuSQUIDS::InteractionStructure> int_struct = nullptr;
       unsigned int i = 0;
-      for(nuSQUIDS& nsq : nusq_array){
-        nsq = nuSQUIDS(energy_min,energy_max,energy_div,numneu,NT,elogscale,interaction,ncs);
+      for(BaseSQUIDS& nsq : nusq_array){
+        nsq.init(energy_min,energy_max,energy_div,numneu,NT,elogscale,iinteraction,ncs,int_struct);
         nsq.Set_Body(earth_atm);
         nsq.Set_Track(track_array[i]);
+        int_struct = nsq.GetInteractionStructure();
+        if(i == 0)
+          ncs = nsq.ncs;
         i++;
       }
+      this->ncs = ncs;
 
       inusquidsatm = true;
     }
 
     /// \brief Constructor from a HDF5 filepath.
     /// @param hdf5_filename Filename of the HDF5 to use for construction.
+    /// @param lazy If \c true the zenith nodes are read on first access.
+    /// @param read_cross_sections If \c false the cross sections are not read.
     /// \details Reads the HDF5 file and construct the associated nuSQUIDSAtm object
     /// restoring all properties as well as the state.
     /// @see ReadStateHDF5
-    nuSQUIDSAtm(std::string hdf5_filename) {ReadStateHDF5(hdf5_filename);}
+    nuSQUIDSAtm(std::string hdf5_filename, bool lazy = false, bool read_cross_sections = true)
+    {ReadStateHDF5(hdf5_filename,lazy,read_cross_sections);}
 
     /// \brief Move constructor.
     nuSQUIDSAtm(nuSQUIDSAtm&& other):
     progressbar(other.progressbar),
+    nthreads(other.nthreads),
+    zenith_cost_estimates(std::move(other.zenith_cost_estimates)),
+    zenith_evolution_times(std::move(other.zenith_evolution_times)),
     iinistate(other.iinistate),
     inusquidsatm(other.inusquidsatm),
     costh_array(std::move(other.costh_array)),
@@ -853,8 +1917,17 @@ class nuSQUIDSAtm {
     log_enu_array(std::move(other.log_enu_array)),
     nusq_array(std::move(other.nusq_array)),
     earth_atm(std::move(other.earth_atm)),
+    lazy_filename(std::move(other.lazy_filename)),
+    lazy_consolidated(other.lazy_consolidated),
+    lazy_cross_sections(other.lazy_cross_sections),
+    materialized(std::move(other.materialized)),
+    pending_zenith(other.pending_zenith.load()),
     track_array(std::move(other.track_array)),
-    ncs(std::move(other.ncs))
+    ncs(std::move(other.ncs)),
+    gsl_step(other.gsl_step),
+    checkpoint_filename(std::move(other.checkpoint_filename)),
+    checkpoint_segment(other.checkpoint_segment),
+    zenith_progress(std::move(other.zenith_progress))
     {
       other.inusquidsatm = false;
     }
@@ -866,6 +1939,9 @@ class nuSQUIDSAtm {
         return(*this);
 
       progressbar = other.progressbar;
+      nthreads = other.nthreads;
+      zenith_cost_estimates = std::move(other.zenith_cost_estimates);
+      zenith_evolution_times = std::move(other.zenith_evolution_times);
       iinistate = other.iinistate;
       inusquidsatm = other.inusquidsatm;
       costh_array = std::move(other.costh_array);
@@ -873,8 +1949,17 @@ class nuSQUIDSAtm {
       log_enu_array = std::move(other.log_enu_array);
       nusq_array = std::move(other.nusq_array);
       earth_atm = std::move(other.earth_atm);
+      lazy_filename = std::move(other.lazy_filename);
+      lazy_consolidated = other.lazy_consolidated;
+      lazy_cross_sections = other.lazy_cross_sections;
+      materialized = std::move(other.materialized);
+      pending_zenith.store(other.pending_zenith.load());
       track_array = std::move(other.track_array);
       ncs = std::move(other.ncs);
+      gsl_step = other.gsl_step;
+      checkpoint_filename = std::move(other.checkpoint_filename);
+      checkpoint_segment = other.checkpoint_segment;
+      zenith_progress = std::move(other.zenith_progress);
 
       // initial nusquids object render useless
       other.inusquidsatm = false;
@@ -900,6 +1985,7 @@ class nuSQUIDSAtm {
         throw std::runtime_error("nuSQUIDSAtm::Error::First dimension of input array is incorrect.");
       if(ini_flux.extent(1) != enu_array.extent(0))
         throw std::runtime_error("nuSQUIDSAtm::Error::Second dimension of input array is incorrect.");
+      MaterializeAll();
       unsigned int i = 0;
       for(nuSQUIDS& nsq : nusq_array){
         marray<double,2> slice{ini_flux.extent(1),ini_flux.extent(2)};
@@ -930,6 +2016,7 @@ class nuSQUIDSAtm {
       if(ini_flux.extent(0) != costh_array.extent(0))
         throw std::runtime_error(
             "nuSQUIDSAtm::Error::First dimension of input array is incorrect.");
+      MaterializeAll();
       unsigned int i = 0;
       for(nuSQUIDS& nsq : nusq_array){
         marray<double,3> slice{ini_flux.extent(1),ini_flux.extent(2),ini_flux.extent(3)};
@@ -948,24 +2035,286 @@ class nuSQUIDSAtm {
     }
 
     /// \brief Evolves the system.
+    /// \details If more than one thread has been requested with Set_NumThreads()
+    /// the zenith bins are evolved concurrently, otherwise they are evolved one
+    /// after the other. Both paths produce identical results. If a checkpoint file
+    /// has been given to Set_Checkpoint() the progress is recorded in it.
     void EvolveState(){
       if(not iinistate)
         throw std::runtime_error("nuSQUIDSAtm::Error::State not initialized.");
       if(not inusquidsatm)
         throw std::runtime_error("nuSQUIDSAtm::Error::nuSQUIDSAtm not initialized.");
-      unsigned int i = 0;
-      for(nuSQUIDS& nsq : nusq_array){
-      if(progressbar){
-        std::cout << "Calculating cos(th) = " + std::to_string(costh_array[i]) << std::endl;
-        i++;
+      MaterializeAll();
+      std::vector<size_t> zenith(nusq_array.size());
+      std::iota(zenith.begin(),zenith.end(),0);
+      zenith_evolution_times.assign(nusq_array.size(),0.0);
+      bool checkpoint = not checkpoint_filename.empty();
+      if(checkpoint){
+        zenith_progress.assign(nusq_array.size(),0.0);
+        CreateCheckpoint();
       }
-      nsq.EvolveState();
-      if(progressbar){
-        std::cout << std::endl;
+      EvolveZenith(zenith,checkpoint);
+    }
+
+    /// \brief Makes EvolveState() record its progress in an HDF5 file.
+    /// @param filename Checkpoint file, overwritten when EvolveState() starts. An empty
+    /// string disables checkpointing.
+    /// @param segment If positive, the zenith bins are evolved in pieces of this length
+    /// [eV^-1], e.g. 1000*units.km, and the state of a bin is recorded after each piece.
+    /// Otherwise a bin is only recorded once it is done.
+    /// \details The checkpoint is a state file in the consolidated layout of
+    /// WriteStateHDF5(), whose rows are updated as the bins progress, so once all the
+    /// bins are done it can be read with ReadStateHDF5(). Evolving in pieces restarts
+    /// the integrator after each piece, so the result agrees with an evolution without
+    /// pieces within the integration tolerance.
+    /// @see EvolveStateFromCheckpoint
+    void Set_Checkpoint(std::string filename, double segment = 0){
+      if(segment < 0)
+        throw std::runtime_error("nuSQUIDSAtm::Error::Checkpoint segment length must not be negative.");
+      checkpoint_filename = filename;
+      checkpoint_segment = segment;
+    }
+
+    /// \brief Continues an evolution that was interrupted while checkpointing.
+    /// @param filename Checkpoint file written by EvolveState(), see Set_Checkpoint().
+    /// \details The object must be set up as for the interrupted run: same zenith and
+    /// energy nodes, mixing parameters, numerical settings and initial state. The bins
+    /// that are done are skipped, the ones in progress continue from their recorded
+    /// state and the checkpoint keeps being updated. The pieces have the length used
+    /// by the interrupted run, so the result is the same as the one of an uninterrupted
+    /// run.
+    void EvolveStateFromCheckpoint(std::string filename){
+      if(not iinistate)
+        throw std::runtime_error("nuSQUIDSAtm::Error::State not initialized.");
+      if(not inusquidsatm)
+        throw std::runtime_error("nuSQUIDSAtm::Error::nuSQUIDSAtm not initialized.");
+      MaterializeAll();
+
+      // this lines supress HDF5 error messages
+      H5Eset_auto (H5E_DEFAULT,NULL, NULL);
+      hid_t file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+      if (file_id < 0)
+          throw std::runtime_error("nuSQUIDSAtm::Error::file not found : " + filename + ".");
+      hid_t root_id = H5Gopen(file_id, "/",H5P_DEFAULT);
+
+      std::vector<double> progress(nusq_array.size());
+      double segment = 0;
+      try{
+        if(H5Lexists(root_id,"checkpoint_progress",H5P_DEFAULT) <= 0)
+          throw std::runtime_error("nuSQUIDSAtm::Error::" + filename + " is not a checkpoint.");
+        std::vector<std::pair<std::string,const marray<double,1>*>> grids {{"zenith_angles",&costh_array},{"energy_range",&enu_array}};
+        for(auto& grid : grids){
+          hsize_t dims[1];
+          H5LTget_dataset_info(root_id, grid.first.c_str(), dims, NULL, NULL);
+          std::vector<double> nodes(dims[0]);
+          H5LTread_dataset_double(root_id, grid.first.c_str(), nodes.data());
+          bool match = nodes.size() == grid.second->extent(0);
+          for(unsigned int i = 0; match and i < nodes.size(); i++)
+            match = std::abs(nodes[i] - (*grid.second)[i]) <= 1.0e-12*std::abs(nodes[i]);
+          if(not match)
+            throw std::runtime_error("nuSQUIDSAtm::Error::Checkpoint " + grid.first + " do not match the object ones.");
+        }
+        H5LTread_dataset_double(root_id,"checkpoint_progress",progress.data());
+        H5LTget_attribute_double(root_id,"checkpoint_progress","segment",&segment);
+
+        for(unsigned int i = 0; i < nusq_array.size(); i++){
+          if(progress[i] == 0)
+            continue;
+          nuSQUIDS& nsq = nusq_array[i];
+          std::vector<double> state(ZenithRowSize(root_id,"state"));
+          std::vector<double> scalars(ZenithRowSize(root_id,"checkpoint_scalars"));
+          if(state.size() != nsq.GetStateData().size() or scalars.size() != nsq.GetScalarData().size())
+            throw std::runtime_error("nuSQUIDSAtm::Error::Checkpoint state dimensions do not match the object ones.");
+          double t;
+          ReadZenithRow(root_id,"state",i,H5T_NATIVE_DOUBLE,state.data());
+          ReadZenithRow(root_id,"checkpoint_scalars",i,H5T_NATIVE_DOUBLE,scalars.data());
+          ReadZenithRow(root_id,"squids_time",i,H5T_NATIVE_DOUBLE,&t);
+          nsq.SetStateData(t,state.data(),scalars.data());
+        }
+      } catch(...){
+        H5Gclose(root_id);
+        H5Fclose(file_id);
+        throw;
+      }
+      H5Gclose(root_id);
+      H5Fclose(file_id);
+
+      checkpoint_filename = filename;
+      checkpoint_segment = segment;
+      zenith_progress = progress;
+
+      std::vector<size_t> zenith;
+      for(unsigned int i = 0; i < nusq_array.size(); i++){
+        std::shared_ptr<Track> track = nusq_array[i].GetTrack();
+        if(progress[i] < track->GetFinalX() - track->GetInitialX())
+          zenith.push_back(i);
       }
+      zenith_evolution_times.assign(nusq_array.size(),0.0);
+      EvolveZenith(zenith,true);
+    }
+
+    /// \brief Evolves the system refining the zenith grid where it is needed.
+    /// @param initial_state Returns the initial state at a given cos(zenith), with
+    /// dimensions (energy,rho,flavor); the second dimension is two when NeutrinoType
+    /// is \c both and one otherwise.
+    /// @param basis Representation of the initial state either flavor or mass.
+    /// @param tolerance Largest accepted error of the interpolation in cos(zenith), in
+    /// the units of EvalFlavor.
+    /// @param max_zenith Largest number of zenith nodes.
+    /// \details The current zenith nodes are evolved first. Then, for every interval
+    /// whose error is not known to be below \c tolerance, a node is added at its midpoint
+    /// and the flavor content interpolated before adding it is compared with the evolved
+    /// one at all the energy nodes. The largest difference is the interpolation error of
+    /// the interval; if it is above \c tolerance both halves are refined in the next
+    /// round. Intervals with larger errors are refined first, and the refinement stops
+    /// when no interval is above \c tolerance or when there are \c max_zenith nodes.
+    /// The zenith grid becomes non-uniform; GetCosthRange() returns it.
+    void EvolveStateAdaptive(std::function<marray<double,3>(double)> initial_state, Basis basis,
+                             double tolerance, unsigned int max_zenith){
+      if(not inusquidsatm)
+        throw std::runtime_error("nuSQUIDSAtm::Error::nuSQUIDSAtm not initialized.");
+      if(costh_array.extent(0) < 2)
+        throw std::runtime_error("nuSQUIDSAtm::Error::At least two zenith nodes are needed.");
+      if(max_zenith < costh_array.extent(0))
+        throw std::runtime_error("nuSQUIDSAtm::Error::The zenith budget is smaller than the initial grid.");
+      if(tolerance <= 0)
+        throw std::runtime_error("nuSQUIDSAtm::Error::The tolerance must be positive.");
+      MaterializeAll();
+      // the cost estimates are given per node and the grid is going to change
+      zenith_cost_estimates.clear();
+
+      std::vector<size_t> zenith(nusq_array.size());
+      std::iota(zenith.begin(),zenith.end(),0);
+      for(size_t i : zenith)
+        SetZenithInitialState(nusq_array[i],initial_state(costh_array[i]),basis);
+      iinistate = true;
+      zenith_evolution_times.assign(nusq_array.size(),0.0);
+      EvolveZenith(zenith);
+
+      const unsigned int nrho = (nusq_array[0].NT == both) ? 2 : 1;
+      const unsigned int numneu = nusq_array[0].GetNumNeu();
+      // flavor content at all the energy nodes of a given cos(zenith)
+      auto sample = [&](double costh){
+        std::vector<double> values;
+        for(double enu : enu_array){
+          for(unsigned int rho = 0; rho < nrho; rho++){
+            for(unsigned int flv = 0; flv < numneu; flv++)
+              values.push_back(EvalFlavor(flv,costh,enu,rho));
+          }
+        }
+        return values;
+      };
+
+      // interpolation error of each interval, unknown ones are refined first
+      std::vector<double> interval_error(nusq_array.size()-1,std::numeric_limits<double>::infinity());
+      while(nusq_array.size() < max_zenith){
+        std::vector<size_t> split;
+        for(size_t i = 0; i < interval_error.size(); i++){
+          if(interval_error[i] > tolerance)
+            split.push_back(i);
+        }
+        if(split.empty())
+          break;
+        // largest error first, then widest
+        std::stable_sort(split.begin(),split.end(),[&](size_t a, size_t b){
+          if(interval_error[a] != interval_error[b])
+            return interval_error[a] > interval_error[b];
+          return costh_array[a+1]-costh_array[a] > costh_array[b+1]-costh_array[b];
+        });
+        split.resize(std::min<size_t>(split.size(),max_zenith-nusq_array.size()));
+        std::sort(split.begin(),split.end());
+
+        // new nodes, with the values interpolated from the current grid
+        std::vector<double> midpoints;
+        std::vector<std::vector<double>> interpolated;
+        std::vector<BaseSQUIDS> new_nodes(split.size());
+        for(size_t k = 0; k < split.size(); k++){
+          midpoints.push_back(0.5*(costh_array[split[k]]+costh_array[split[k]+1]));
+          interpolated.push_back(sample(midpoints[k]));
+          MakeZenithInstance(midpoints[k],new_nodes[k]);
+          SetZenithInitialState(new_nodes[k],initial_state(midpoints[k]),basis);
+        }
+
+        // insert them after the lower node of their interval
+        std::vector<BaseSQUIDS> nodes;
+        std::vector<double> costh, errors, times;
+        std::vector<size_t> new_index;
+        size_t k = 0;
+        for(size_t i = 0; i < nusq_array.size(); i++){
+          nodes.push_back(std::move(nusq_array[i]));
+          costh.push_back(costh_array[i]);
+          times.push_back(zenith_evolution_times[i]);
+          if(i+1 == nusq_array.size())
+            break;
+          errors.push_back(interval_error[i]);
+          if(k < split.size() and split[k] == i){
+            new_index.push_back(nodes.size());
+            nodes.push_back(std::move(new_nodes[k]));
+            costh.push_back(midpoints[k]);
+            times.push_back(0.0);
+            errors.push_back(interval_error[i]);
+            k++;
+          }
+        }
+        nusq_array = std::move(nodes);
+        costh_array.resize(std::vector<size_t>{costh.size()});
+        std::copy(costh.begin(),costh.end(),costh_array.begin());
+        interval_error = errors;
+        zenith_evolution_times = times;
+        materialized.assign(nusq_array.size(),true);
+        if(not track_array.empty()){
+          track_array.clear();
+          for(const nuSQUIDS& nsq : nusq_array)
+            track_array.push_back(std::static_pointer_cast<EarthAtm::Track>(nsq.GetTrack()));
+        }
+
+        EvolveZenith(new_index);
+
+        // the halves of an interval inherit the error measured at its midpoint
+        for(size_t k = 0; k < new_index.size(); k++){
+          std::vector<double> evolved = sample(midpoints[k]);
+          double error = 0;
+          for(size_t j = 0; j < evolved.size(); j++)
+            error = std::max(error,std::abs(evolved[j]-interpolated[k][j]));
+          interval_error[new_index[k]-1] = error;
+          interval_error[new_index[k]] = error;
+        }
       }
     }
 
+    /// \brief Sets the number of threads used by EvolveState().
+    /// @param n Number of threads. If \c n is zero the number of hardware threads is used.
+    /// \details By default a single thread is used.
+    void Set_NumThreads(unsigned int n){
+      if(n == 0)
+        n = std::max(1u,std::thread::hardware_concurrency());
+      nthreads = n;
+    }
+
+    /// \brief Returns the number of threads used by EvolveState().
+    unsigned int Get_NumThreads() const{
+      return nthreads;
+    }
+
+    /// \brief Sets the cost of evolving each zenith bin.
+    /// @param costs One entry per zenith bin, in arbitrary units.
+    /// \details The costs decide the order in which the bins are evolved
+    /// when more than one thread is used. Typically they are the wall times
+    /// returned by GetZenithEvolutionTimes() in a previous run. Passing an
+    /// empty vector restores the built-in estimate, which is based on the
+    /// length and column density of each track.
+    void Set_ZenithCostEstimates(std::vector<double> costs){
+      if(costs.size() != 0 and costs.size() != costh_array.extent(0))
+        throw std::runtime_error("nuSQUIDSAtm::Error::Number of cost estimates does not match the number of zenith bins.");
+      zenith_cost_estimates = costs;
+    }
+
+    /// \brief Returns the wall time in seconds spent evolving each zenith bin
+    /// by the last call to EvolveState().
+    std::vector<double> GetZenithEvolutionTimes() const{
+      return zenith_evolution_times;
+    }
+
     /// \brief Returns the flavor composition at a given energy and zenith.
     /// @param flv Neutrino flavor.
     /// @param costh Cosine of the zenith.
@@ -981,36 +2330,17 @@ class nuSQUIDSAtm {
       if(not inusquidsatm)
         throw std::runtime_error("nuSQUIDSAtm::Error::nuSQUIDSAtm not initialized.");
 
-      if( costh < *costh_array.begin() or costh > *costh_array.rbegin())
-        throw std::runtime_error("nuSQUIDSAtm::Error::EvalFlavor::cos(th) out of bounds.");
-      if( enu < *enu_array.begin() or enu > *enu_array.rbegin() )
-        throw std::runtime_error("nuSQUIDSAtm::Error::EvalFlavor::neutrino energy out of bounds.(Emin = " +
-                                 std::to_string(*enu_array.begin()) +
-                                 ",Emax = " +
-                                 std::to_string(*enu_array.rbegin()) +
-                                 ", Enu = " + std::to_string(enu) + ")");
-
-      int cth_M = -1;
-      for(int i = 0; i < costh_array.extent(0); i++){
-        if ( costh >= costh_array[i] and costh <= costh_array[i+1] ) {
-          cth_M = i;
-          break;
-        }
-      }
+      CheckEvalBounds(costh,enu);
 
-      int loge_M = -1;
+      int cth_M = FindInterval(costh_array,costh,0);
       double logE = log(enu);
-      for(int i = 0; i < log_enu_array.extent(0); i++){
-        if ( logE >= log_enu_array[i] and logE <= log_enu_array[i+1] ) {
-          loge_M = i;
-          break;
-        }
-      }
+      int loge_M = FindInterval(log_enu_array,logE,0);
+      MaterializeZenith(std::vector<size_t>{size_t(cth_M),size_t(cth_M)+1});
 
-      std::shared_ptr<EarthAtm::Track> track = std::make_shared<EarthAtm::Track>(acos(costh));
+      EarthAtm::Track track(acos(costh));
       // get the evolution generator
-      squids::SU_vector H0_at_enu = nusq_array[0].H0(enu*units.GeV,rho);
-      double delta_t_final = track->GetFinalX()-track->GetInitialX();
+      squids::SU_vector H0_at_enu = nusq_array[cth_M].H0(enu*units.GeV,rho);
+      double delta_t_final = track.GetFinalX()-track.GetInitialX();
 
       // assuming offsets are zero
       double delta_t_1 = nusq_array[cth_M].Get_t() - nusq_array[cth_M].Get_t_initial();
@@ -1019,7 +2349,7 @@ class nuSQUIDSAtm {
       double delta_t_final_2 = nusq_array[cth_M+1].GetTrack()->GetFinalX() - nusq_array[cth_M+1].GetTrack()->GetInitialX();
       double t_inter = 0.5*(delta_t_final*delta_t_1/delta_t_final_1 + delta_t_final*delta_t_2/delta_t_final_2);
       // get the evolved projector for the right distance and energy
-      squids::SU_vector evol_proj = nusq_array[0].GetFlavorProj(flv,rho).Evolve(H0_at_enu,t_inter);
+      squids::SU_vector evol_proj = nusq_array[cth_M].GetFlavorProj(flv,rho).Evolve(H0_at_enu,t_inter);
 
       double phiMM,phiMP,phiPM,phiPP;
       phiMM = nusq_array[cth_M].GetState(loge_M,rho).Evolve(nusq_array[cth_M].H0(enu_array[loge_M]*units.GeV,rho),t_inter - nusq_array[cth_M].Get_t())*evol_proj;
@@ -1032,18 +2362,165 @@ class nuSQUIDSAtm {
             LinInter(logE,log_enu_array[loge_M],log_enu_array[loge_M+1],phiPM,phiPP));
     }
 
+    /// \brief Returns the flavor composition for a batch of events.
+    /// @param nevents Number of events.
+    /// @param flv Neutrino flavor of each event.
+    /// @param costh Cosine of the zenith of each event.
+    /// @param enu Neutrino energy of each event [GeV].
+    /// @param rho Index of the equation of each event, see EvalFlavor.
+    /// @param output Array of size \c nevents where the results are written.
+    /// \details Gives the same results as calling EvalFlavor for every event, but
+    /// the interpolation nodes are found by direct index computation when the
+    /// grids are uniform, the quantities that only depend on the nodes are computed
+    /// once per call, and the events are split among Get_NumThreads() threads.
+    void EvalFlavorBatch(size_t nevents,const unsigned int* flv,const double* costh,
+                         const double* enu,const unsigned int* rho,double* output) const {
+      if(not iinistate)
+        throw std::runtime_error("nuSQUIDSAtm::Error::State not initialized.");
+      if(not inusquidsatm)
+        throw std::runtime_error("nuSQUIDSAtm::Error::nuSQUIDSAtm not initialized.");
+      if(nevents == 0)
+        return;
+
+      const double costh_step = UniformStep(costh_array);
+      const double log_enu_step = UniformStep(log_enu_array);
+
+      // zenith nodes used by the events, only the ones not read yet are of interest
+      std::vector<bool> used(nusq_array.size(),pending_zenith.load() == 0);
+      if(pending_zenith.load() != 0){
+        std::vector<size_t> zenith;
+        for(size_t i = 0; i < nevents; i++){
+          CheckEvalBounds(costh[i],enu[i]);
+          size_t cth_M = FindInterval(costh_array,costh[i],costh_step);
+          for(size_t node : {cth_M,cth_M+1}){
+            if(not used[node]){
+              used[node] = true;
+              zenith.push_back(node);
+            }
+          }
+        }
+        MaterializeZenith(zenith);
+      }
+      const nuSQUIDS& reference = nusq_array[std::find(used.begin(),used.end(),true) - used.begin()];
+
+      // zenith node quantities, assuming offsets are zero as in EvalFlavor
+      std::vector<double> t_node(nusq_array.size()), delta_t_node(nusq_array.size()), delta_t_final_node(nusq_array.size());
+      for(size_t i = 0; i < nusq_array.size(); i++){
+        if(not used[i])
+          continue;
+        const nuSQUIDS& nsq = nusq_array[i];
+        t_node[i] = nsq.Get_t();
+        delta_t_node[i] = nsq.Get_t() - nsq.Get_t_initial();
+        delta_t_final_node[i] = nsq.GetTrack()->GetFinalX() - nsq.GetTrack()->GetInitialX();
+      }
+      // evolution generators at the energy nodes, for each density matrix
+      std::vector<std::vector<squids::SU_vector>> H0_node(reference.GetNumRho());
+      for(unsigned int irho = 0; irho < H0_node.size(); irho++){
+        for(double enu_node : enu_array)
+          H0_node[irho].push_back(reference.H0(enu_node*units.GeV,irho));
+      }
+
+      auto evaluate = [&](size_t i){
+        CheckEvalBounds(costh[i],enu[i]);
+        size_t cth_M = FindInterval(costh_array,costh[i],costh_step);
+        double logE = log(enu[i]);
+        size_t loge_M = FindInterval(log_enu_array,logE,log_enu_step);
+        unsigned int r = rho[i];
+        if(r >= reference.GetNumRho())
+          throw std::runtime_error("nuSQUIDSAtm::Error::EvalFlavorBatch::rho out of bounds.");
+        if(flv[i] >= reference.GetNumNeu())
+          throw std::runtime_error("nuSQUIDSAtm::Error::EvalFlavorBatch::flavor out of bounds.");
+
+        EarthAtm::Track track(acos(costh[i]));
+        double delta_t_final = track.GetFinalX()-track.GetInitialX();
+        double t_inter = 0.5*(delta_t_final*delta_t_node[cth_M]/delta_t_final_node[cth_M] +
+                              delta_t_final*delta_t_node[cth_M+1]/delta_t_final_node[cth_M+1]);
+        squids::SU_vector evol_proj = reference.GetFlavorProj(flv[i],r).Evolve(reference.H0(enu[i]*units.GeV,r),t_inter);
+
+        double phiMM,phiMP,phiPM,phiPP;
+        phiMM = nusq_array[cth_M].GetState(loge_M,r).Evolve(H0_node[r][loge_M],t_inter - t_node[cth_M])*evol_proj;
+        phiMP = nusq_array[cth_M].GetState(loge_M+1,r).Evolve(H0_node[r][loge_M+1],t_inter - t_node[cth_M])*evol_proj;
+        phiPM = nusq_array[cth_M+1].GetState(loge_M,r).Evolve(H0_node[r][loge_M],t_inter - t_node[cth_M+1])*evol_proj;
+        phiPP = nusq_array[cth_M+1].GetState(loge_M+1,r).Evolve(H0_node[r][loge_M+1],t_inter - t_node[cth_M+1])*evol_proj;
+
+        output[i] = LinInter(costh[i],costh_array[cth_M],costh_array[cth_M+1],
+                    LinInter(logE,log_enu_array[loge_M],log_enu_array[loge_M+1],phiMM,phiMP),
+                    LinInter(logE,log_enu_array[loge_M],log_enu_array[loge_M+1],phiPM,phiPP));
+      };
+
+      // the events are handed out in blocks to keep the scheduling overhead small
+      const size_t block_size = 1024;
+      size_t nblocks = (nevents + block_size - 1)/block_size;
+      std::vector<double> costs(nblocks,1.0);
+      costs.back() = double(nevents - (nblocks-1)*block_size)/block_size;
+      WorkStealingScheduler(std::min<size_t>(nthreads,nblocks)).Run(costs,
+        [&](unsigned int iblock, unsigned int){
+          size_t end = std::min(nevents,(iblock+1)*block_size);
+          for(size_t i = iblock*block_size; i < end; i++)
+            evaluate(i);
+        });
+    }
+
+    /// \brief Samples the flavor content onto a dense table.
+    /// @param costh_min Minimum cos(th) value.
+    /// @param costh_max Maximum cos(th) value.
+    /// @param ncosth Number of cos(th) nodes.
+    /// @param enu_min Minimum neutrino energy [GeV].
+    /// @param enu_max Maximum neutrino energy [GeV].
+    /// @param nenergy Number of energy nodes, logarithmically spaced.
+    /// \details Every node of the table is evaluated with EvalFlavorBatch, using
+    /// Get_NumThreads() threads. The table holds all flavors and, when NeutrinoType
+    /// is \c both, neutrinos and antineutrinos. The ranges must be within the ones
+    /// of this object.
+    /// @see FlavorTable
+    FlavorTable FreezeFlavorTable(double costh_min,double costh_max,unsigned int ncosth,
+                                  double enu_min,double enu_max,unsigned int nenergy) const{
+      if(not iinistate)
+        throw std::runtime_error("nuSQUIDSAtm::Error::State not initialized.");
+      MaterializeZenith(0);
+      unsigned int nrho = (nusq_array[0].NT == both) ? 2 : 1;
+      unsigned int numneu = nusq_array[0].GetNumNeu();
+      FlavorTable table(costh_min,costh_max,ncosth,enu_min,enu_max,nenergy,nrho,numneu);
+
+      // one event per table entry, in the order in which the table stores them
+      size_t nevents = size_t(ncosth)*nenergy*nrho*numneu;
+      std::vector<unsigned int> flv, rho;
+      std::vector<double> costh, enu;
+      flv.reserve(nevents); rho.reserve(nevents); costh.reserve(nevents); enu.reserve(nevents);
+      for(unsigned int ic = 0; ic < ncosth; ic++){
+        for(unsigned int ie = 0; ie < nenergy; ie++){
+          for(unsigned int irho = 0; irho < nrho; irho++){
+            for(unsigned int iflv = 0; iflv < numneu; iflv++){
+              flv.push_back(iflv);
+              rho.push_back(irho);
+              costh.push_back(table.GetCosth(ic));
+              enu.push_back(table.GetEnergy(ie));
+            }
+          }
+        }
+      }
+      EvalFlavorBatch(nevents,flv.data(),costh.data(),enu.data(),rho.data(),table.GetData());
+      return table;
+    }
+
     /// \brief Writes the object into an HDF5 file.
     /// @param hdf5_filename Filename of the HDF5 into which save the object.
-    /// \details All contents are saved to the \c root of the HDF5 file.
+    /// @param consolidated If \c true the whole bundle is written through a single
+    /// file handle as a few stacked datasets; otherwise one group per zenith is written.
+    /// \details All contents are saved to the \c root of the HDF5 file. In the consolidated
+    /// layout the states of all zenith nodes are stored in the \c state dataset with shape
+    /// (zenith,energy,rho,component), and the per-zenith times, tracks and bodies are stored
+    /// as rows of \c squids_time, \c squids_time_initial, \c tracks, \c track_x, \c bodies
+    /// and \c body_ids. The energies, mixing parameters and cross sections are written once.
     /// @see ReadStateHDF5
-    void WriteStateHDF5(std::string filename) const{
+    void WriteStateHDF5(std::string filename, bool consolidated = true) const{
       if(not iinistate)
         throw std::runtime_error("nuSQUIDSAtm::Error::State not initialized.");
       if(not inusquidsatm)
         throw std::runtime_error("nuSQUIDSAtm::Error::nuSQUIDSAtm not initialized.");
+      MaterializeAll();
 
       hid_t file_id,root_id;
-      hid_t dset_id;
       // create HDF5 file
       file_id = H5Fcreate (filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
       if (file_id < 0)
@@ -1052,13 +2529,26 @@ class nuSQUIDSAtm {
 
       // write the zenith range
       hsize_t costhdims[1]={costh_array.extent(0)};
-      dset_id = H5LTmake_dataset(root_id,"zenith_angles",1,costhdims,H5T_NATIVE_DOUBLE,costh_array.get_data());
+      H5LTmake_dataset(root_id,"zenith_angles",1,costhdims,H5T_NATIVE_DOUBLE,costh_array.get_data());
       hsize_t energydims[1]={enu_array.extent(0)};
-      dset_id = H5LTmake_dataset(root_id,"energy_range",1,energydims,H5T_NATIVE_DOUBLE,enu_array.get_data());
+      H5LTmake_dataset(root_id,"energy_range",1,energydims,H5T_NATIVE_DOUBLE,enu_array.get_data());
+
+      if(consolidated){
+        try{
+          WriteConsolidatedHDF5(root_id);
+        } catch(...){
+          H5Gclose (root_id);
+          H5Fclose (file_id);
+          throw;
+        }
+      }
 
       H5Gclose (root_id);
       H5Fclose (file_id);
 
+      if(consolidated)
+        return;
+
       unsigned int i = 0;
       for(const nuSQUIDS& nsq : nusq_array){
         // use only the first one to write the cross sections on /crosssections
@@ -1069,12 +2559,23 @@ class nuSQUIDSAtm {
 
     /// \brief Reads the object from an HDF5 file.
     /// @param hdf5_filename Filename of the HDF5 to use for construction.
+    /// @param lazy If \c true only the zenith and energy grids are read now, and each
+    /// zenith node is read the first time it is needed.
+    /// @param read_cross_sections If \c false the cross section tables are not read and
+    /// the zenith nodes are restored with interactions switched off. Use it when the state
+    /// will only be evaluated, not evolved further.
     /// \details All contents are assumed to be saved to the \c root of the HDF5 file.
+    /// Both the consolidated layout and the one group per zenith layout are supported.
+    /// The Earth model and the cross sections are read once and shared by all the nodes.
+    /// In lazy mode the file must not change until all nodes have been read; EvalFlavor and
+    /// GetnuSQuIDS only read the nodes they use, while the other methods read all of them.
     /// @see WriteStateHDF5
-    void ReadStateHDF5(std::string hdf5_filename){
+    void ReadStateHDF5(std::string hdf5_filename, bool lazy = false, bool read_cross_sections = true){
       hid_t file_id,group_id,root_id;
-      // create HDF5 file
+      // open HDF5 file
       file_id = H5Fopen(hdf5_filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+      if (file_id < 0)
+          throw std::runtime_error("nuSQUIDSAtm::Error::file not found : " + hdf5_filename + ".");
       root_id = H5Gopen(file_id, "/",H5P_DEFAULT);
       group_id = root_id;
 
@@ -1082,8 +2583,8 @@ class nuSQUIDSAtm {
       hsize_t costhdims[1];
       H5LTget_dataset_info(group_id, "zenith_angles", costhdims, NULL, NULL);
 
-      double data[costhdims[0]];
-      H5LTread_dataset_double(group_id, "zenith_angles", data);
+      std::vector<double> data(costhdims[0]);
+      H5LTread_dataset_double(group_id, "zenith_angles", data.data());
       costh_array.resize(std::vector<size_t> {costhdims[0]});
       for (unsigned int i = 0; i < costhdims[0]; i ++)
         costh_array[i] = data[i];
@@ -1091,34 +2592,46 @@ class nuSQUIDSAtm {
       hsize_t energydims[1];
       H5LTget_dataset_info(group_id, "energy_range", energydims, NULL, NULL);
 
-      double enu_data[energydims[0]];
-      H5LTread_dataset_double(group_id, "energy_range", enu_data);
+      std::vector<double> enu_data(energydims[0]);
+      H5LTread_dataset_double(group_id, "energy_range", enu_data.data());
       enu_array.resize(std::vector<size_t>{energydims[0]});log_enu_array.resize(std::vector<size_t>{energydims[0]});
       for (unsigned int i = 0; i < energydims[0]; i ++){
         enu_array[i] = enu_data[i];
         log_enu_array[i] = log(enu_data[i]);
       }
 
+      lazy_consolidated = false;
+      if(H5Aexists(root_id,"layout") > 0){
+        char layout[32];
+        H5LTget_attribute_string(root_id, ".", "layout", layout);
+        lazy_consolidated = (std::string(layout) == "consolidated");
+      }
+
       H5Gclose(root_id);
       H5Fclose(file_id);
 
       // resize apropiately the nuSQUIDSAtm container vector
       nusq_array.clear();
-      nusq_array = std::vector<nuSQUIDS>(costhdims[0]);
+      nusq_array = std::vector<BaseSQUIDS>(costhdims[0]);
+      earth_atm = nullptr;
+      track_array.clear();
 
-      unsigned int i = 0;
-      for(nuSQUIDS& nsq : nusq_array){
-        // read the cross sections stored in /crosssections
-        nsq.ReadStateHDF5(hdf5_filename,"costh_"+std::to_string(costh_array[i]),"crosssections");
-        i++;
-      }
+      // the zenith nodes are filled in by MaterializeZenith
+      lazy_filename = hdf5_filename;
+      lazy_cross_sections = read_cross_sections;
+      materialized.assign(costhdims[0],false);
+      pending_zenith.store(costhdims[0]);
 
       iinistate = true;
       inusquidsatm = true;
+
+      if(not lazy)
+        MaterializeAll();
     }
 
     /// \brief Sets the mixing parameters to default.
     void Set_MixingParametersToDefault(){
+      MaterializeAll();
       for(nuSQUIDS& nsq : nusq_array){
         nsq.Set_MixingParametersToDefault();
       }
@@ -1131,6 +2644,7 @@ class nuSQUIDSAtm {
     /// @param angle Angle to use in radians.
     /// \details Sets the neutrino mixing angle. In our zero-based convention, e.g., the th_12 is i = 0, j = 1.,etc.
     void Set_MixingAngle(unsigned int i, unsigned int j,double angle){
+      MaterializeAll();
       for(nuSQUIDS& nsq : nusq_array){
         nsq.Set_MixingAngle(i,j,angle);
       }
@@ -1142,6 +2656,7 @@ class nuSQUIDSAtm {
     ///              must be larger than \c i.
     /// \details Gets the neutrino mixing angle. In our zero-based convention, e.g., the th_12 is i = 0, j = 1.,etc.
     double Get_MixingAngle(unsigned int i, unsigned int j) const{
+      MaterializeZenith(0);
       return nusq_array[0].Get_MixingAngle(i,j);
     }
 
@@ -1152,6 +2667,7 @@ class nuSQUIDSAtm {
     /// @param angle Phase to use in radians.
     /// \details Sets the CP phase for the ij-rotation. In our zero-based convention, e.g., the delta_13 = delta_CP  is i = 0, j = 2.,etc.
     void Set_CPPhase(unsigned int i, unsigned int j,double angle){
+      MaterializeAll();
       for(nuSQUIDS& nsq : nusq_array){
         nsq.Set_CPPhase(i,j,angle);
       }
@@ -1163,6 +2679,7 @@ class nuSQUIDSAtm {
     ///              must be larger than \c i.
     /// \details Gets the CP phase for the ij-rotation. In our zero-based convention, e.g., the delta_13 = delta_CP  is i = 0, j = 2.,etc.
     double Get_CPPhase(unsigned int i, unsigned int j) const{
+      MaterializeZenith(0);
       return nusq_array[0].Get_CPPhase(i,j);
     }
 
@@ -1172,6 +2689,7 @@ class nuSQUIDSAtm {
     /// @param sq Square mass difference in eV^2.
     /// \details Sets square mass difference with respect to the first mass eigenstate. In our zero-based convention, e.g., the \f$\Delta m^2_{12}\f$ corresponds to (i = 1),etc.
     void Set_SquareMassDifference(unsigned int i,double sq){
+      MaterializeAll();
       for(nuSQUIDS& nsq : nusq_array){
         nsq.Set_SquareMassDifference(i,sq);
       }
@@ -1182,12 +2700,14 @@ class nuSQUIDSAtm {
     ///              must be larger than \c i.
     /// \details Returns square mass difference with respect to the first mass eigenstate. In our zero-based convention, e.g., the \f$\Delta m^2_{12}\f$ corresponds to (i = 1),etc.
     double Get_SquareMassDifference(unsigned int i) const{
+      MaterializeZenith(0);
       return nusq_array[0].Get_SquareMassDifference(i);
     }
 
     /// \brief Sets the absolute numerical error.
     /// @param eps Error.
     void Set_abs_error(double eps){
+      MaterializeAll();
       for(nuSQUIDS& nsq : nusq_array){
         nsq.Set_abs_error(eps);
       }
@@ -1196,6 +2716,7 @@ class nuSQUIDSAtm {
     /// \brief Sets the relative numerical error.
     /// @param eps Error.
     void Set_rel_error(double eps){
+      MaterializeAll();
       for(nuSQUIDS& nsq : nusq_array){
         nsq.Set_rel_error(eps);
       }
@@ -1204,6 +2725,8 @@ class nuSQUIDSAtm {
     /// \brief Sets the GSL solver
     /// @param opt GSL stepper function.
     void Set_GSL_step(gsl_odeiv2_step_type const * opt){
+      MaterializeAll();
+      gsl_step = opt;
       for(nuSQUIDS& nsq : nusq_array){
         nsq.Set_GSL_step(opt);
       }
@@ -1216,6 +2739,7 @@ class nuSQUIDSAtm {
     /// @param opt If \c true a progress bar will be printed.
     void Set_ProgressBar(bool opt){
         progressbar = opt;
+        MaterializeAll();
         for(nuSQUIDS& nsq : nusq_array){
           nsq.Set_ProgressBar(opt);
         }
@@ -1233,6 +2757,7 @@ class nuSQUIDSAtm {
 
     /// \brief Returns the number of neutrino flavors.
     unsigned int GetNumNeu() const{
+      MaterializeZenith(0);
       return nusq_array[0].GetNumNeu();
     }
 
@@ -1245,21 +2770,69 @@ class nuSQUIDSAtm {
       return costh_array;
     }
     /// \brief Contains the nuSQUIDS objects for each zenith.
+    /// \details In lazy mode the node is read from file if needed.
     BaseSQUIDS& GetnuSQuIDS(unsigned int ci) {
+      MaterializeZenith(ci);
       return nusq_array[ci];
     }
 
     /// \brief Toggles tau regeneration on and off.
     /// @param opt If \c true tau regeneration will be considered.
     void Set_TauRegeneration(bool opt){
+      MaterializeAll();
       for(nuSQUIDS& nsq : nusq_array){
         nsq.Set_TauRegeneration(opt);
       }
     }
 
+    /// \brief Toggles the fused evaluation of the derivative terms.
+    /// @param opt If \c true the terms of all the nodes are evaluated in one pass per step.
+    /// \see nuSQUIDS::Set_FusedDerivatives
+    void Set_FusedDerivatives(bool opt){
+      MaterializeAll();
+      for(nuSQUIDS& nsq : nusq_array){
+        nsq.Set_FusedDerivatives(opt);
+      }
+    }
+
+    /// \brief Toggles the evaluation of the Earth from a profile sampled along each track.
+    /// @param opt If \c true each zenith samples the Earth once along its track.
+    /// @param tolerance Target relative difference of each profile, see TrackProfile.
+    /// @param max_nodes Maximum number of nodes of each profile.
+    /// \see nuSQUIDS::Set_TrackProfile
+    void Set_TrackProfile(bool opt, double tolerance = 1.0e-4, unsigned int max_nodes = 1u<<15){
+      MaterializeAll();
+      for(nuSQUIDS& nsq : nusq_array){
+        nsq.Set_TrackProfile(opt,tolerance,max_nodes);
+      }
+    }
+
+    /// \brief Toggles the layered evolution of every zenith.
+    /// @param opt If \c true each zenith is evolved by composing the propagators of
+    /// constant density pieces of its track.
+    /// @param max_length Maximum length of the pieces [eV^-1], or zero to keep the current one.
+    /// \see nuSQUIDS::Set_LayeredEvolution
+    void Set_LayeredEvolution(bool opt, double max_length = 0.){
+      MaterializeAll();
+      for(nuSQUIDS& nsq : nusq_array){
+        nsq.Set_LayeredEvolution(opt,max_length);
+      }
+    }
+
+    /// \brief Toggles stopping the integration of every zenith at the density discontinuities.
+    /// @param opt If \c true no integration step crosses a layer boundary of the Earth.
+    /// \see nuSQUIDS::Set_StopAtDiscontinuities
+    void Set_StopAtDiscontinuities(bool opt){
+      MaterializeAll();
+      for(nuSQUIDS& nsq : nusq_array){
+        nsq.Set_StopAtDiscontinuities(opt);
+      }
+    }
+
     /// \brief Toggles positivization of the flux.
     /// @param opt If \c true the flux will be forced to be positive every \c positivization_step.
     void Set_PositivityConstrain(bool opt){
+      MaterializeAll();
       for(nuSQUIDS& nsq : nusq_array){
         nsq.Set_PositivityConstrain(opt);
       }
@@ -1267,6 +2840,7 @@ class nuSQUIDSAtm {
     /// \brief Stes the step upon which the positivity correction would be apply.
     /// @param step The step upon which the positivization will take place.
     void Set_PositivityConstrainStep(double step){
+      MaterializeAll();
       for(nuSQUIDS& nsq : nusq_array){
         nsq.Set_PositivityConstrainStep(step);
       }
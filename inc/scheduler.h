@@ -0,0 +1,72 @@
+ /******************************************************************************
+ *    This program is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by      *
+ *   the Free Software Foundation, either version 3 of the License, or         *
+ *   (at your option) any later version.                                       *
+ *                                                                             *
+ *   This program is distributed in the hope that it will be useful,           *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ *   GNU General Public License for more details.                              *
+ *                                                                             *
+ *   You should have received a copy of the GNU General Public License         *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *                                                                             *
+ *   Authors:                                                                  *
+ *      Carlos Arguelles (University of Wisconsin Madison)                     *
+ *         carguelles@icecube.wisc.edu                                         *
+ *      Jordi Salvado (University of Wisconsin Madison)                        *
+ *         jsalvado@icecube.wisc.edu                                           *
+ *      Christopher Weaver (University of Wisconsin Madison)                   *
+ *         chris.weaver@icecube.wisc.edu                                       *
+ ******************************************************************************/
+
+
+#ifndef __SCHEDULER_H
+#define __SCHEDULER_H
+
+#if __cplusplus < 201103L
+#error C++11 compiler required. Update your compiler and use the flag -std=c++11
+#endif
+
+#include <vector>
+#include <deque>
+#include <functional>
+
+namespace nusquids{
+
+/// \class WorkStealingScheduler
+/// \brief Runs a collection of independent tasks on a pool of threads.
+/// \details Tasks are dealt to per-worker queues in order of decreasing
+/// estimated cost, so that the most expensive tasks are started first.
+/// A worker whose queue runs dry steals the next pending task from the
+/// worker that has the largest amount of estimated work left. The wall
+/// time spent on every task is measured and returned, so that it can
+/// be used as the cost estimate of a subsequent run.
+class WorkStealingScheduler{
+  private:
+    /// \brief Number of workers, the calling thread included.
+    unsigned int nworkers;
+  public:
+    /// \brief Constructor.
+    /// @param nworkers Number of workers. The calling thread is used as one of them.
+    WorkStealingScheduler(unsigned int nworkers);
+
+    /// \brief Runs all tasks.
+    /// @param costs Estimated cost of each task, in arbitrary units.
+    /// @param task Function called as task(itask,iworker) for every task.
+    /// \details All calls made by a given worker happen on the same thread, so
+    /// \c iworker can be used to index per-thread resources. If any task throws,
+    /// no further tasks are started and the first exception is rethrown once all
+    /// workers have stopped.
+    /// @return Wall time in seconds spent on each task.
+    std::vector<double> Run(const std::vector<double>& costs,
+                            std::function<void(unsigned int,unsigned int)> task) const;
+
+    /// \brief Returns the number of workers.
+    unsigned int GetNumWorkers() const {return nworkers;}
+};
+
+} // close namespace
+
+#endif
@@ -39,6 +39,8 @@
 #include <gsl/gsl_interp.h>
 #include <gsl/gsl_spline.h>
 #include <stdexcept>
+#include <cstdlib>
+#include <new>
 #include "marray.h"
 
 namespace nusquids{
@@ -64,6 +66,37 @@ marray<double,1> linspace(double min,double max,unsigned int div);
 /// @param max Maximum value in the logarithmic span.
 /// @param div Number of divisions in the span.
 marray<double,1> logspace(double min,double max,unsigned int div);
+/// \brief Allocator that aligns its storage so that loops over it can use SIMD loads.
+/// @tparam T Type of the allocated objects.
+/// @tparam Alignment Alignment in bytes, which has to be a power of two multiple of sizeof(void*).
+template<typename T, size_t Alignment = 64>
+struct aligned_allocator{
+  typedef T value_type;
+  template<typename U>
+  struct rebind{ typedef aligned_allocator<U,Alignment> other; };
+
+  aligned_allocator(){}
+  template<typename U>
+  aligned_allocator(const aligned_allocator<U,Alignment>&){}
+
+  T* allocate(size_t n){
+    void* ptr = nullptr;
+    if(n == 0)
+      return nullptr;
+    if(posix_memalign(&ptr,Alignment,n*sizeof(T)) != 0)
+      throw std::bad_alloc();
+    return static_cast<T*>(ptr);
+  }
+  void deallocate(T* ptr, size_t){
+    free(ptr);
+  }
+};
+
+template<typename T, typename U, size_t Alignment>
+bool operator==(const aligned_allocator<T,Alignment>&, const aligned_allocator<U,Alignment>&){ return true; }
+template<typename T, typename U, size_t Alignment>
+bool operator!=(const aligned_allocator<T,Alignment>&, const aligned_allocator<U,Alignment>&){ return false; }
+
 // additional GSL-like tools
 void gsl_matrix_complex_conjugate(gsl_matrix_complex*);
 void gsl_matrix_complex_print(gsl_matrix_complex*);
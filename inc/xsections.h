@@ -61,6 +61,24 @@ class NeutrinoCrossSections{
     /// @param neutype Can be either neutrino or antineutrino.
     /// @param current Can be either CC or NC.
     virtual double DifferentialCrossSection(double E1, double E2, NeutrinoFlavor flavor, NeutrinoType neutype, Current current) const = 0;
+    /// \brief Returns the differential cross sections for all pairs of energies.
+    /// \details The cross sections are returned in cm^2 GeV^-1. The default implementation
+    /// calls DifferentialCrossSection() for each pair.
+    /// @param E Energies.
+    /// @param flavor Flavor index.
+    /// @param neutype Can be either neutrino or antineutrino.
+    /// @param current Can be either CC or NC.
+    /// @param dsde Resized to (E.size,E.size) and filled with the cross section from E[e1]
+    /// to E[e2] for all e2 < e1, the other entries are zero.
+    virtual void DifferentialCrossSections(const marray<double,1>& E, NeutrinoFlavor flavor, NeutrinoType neutype, Current current, marray<double,2>& dsde) const;
+    /// \brief Returns true if DifferentialCrossSections() can be called from several threads at once.
+    virtual bool ThreadSafeDifferentialCrossSections() const { return false; }
+    /// \brief Returns a string that identifies the cross sections, used to cache the tables
+    /// computed from them.
+    /// \details Two objects with the same key must return the same cross sections. An empty
+    /// key, the default, means the tables are not cached.
+    virtual std::string CacheKey() const { return ""; }
+    virtual ~NeutrinoCrossSections(){}
 };
 
 /// \class NeutrinoDISCrossSectionsFromTables
@@ -129,6 +147,17 @@ class NeutrinoDISCrossSectionsFromTables : public NeutrinoCrossSections {
       /// @param neutype Can be either neutrino or antineutrino.
       /// @param current Can be either CC or NC.
       double DifferentialCrossSection(double E1, double E2, NeutrinoFlavor flavor, NeutrinoType neutype, Current current) const;
+      /// \brief Returns the differential cross sections for all pairs of energies.
+      /// \details Same values as DifferentialCrossSection(), but the logarithms and table
+      /// bins of each energy are computed once.
+      /// @see NeutrinoCrossSections::DifferentialCrossSections
+      void DifferentialCrossSections(const marray<double,1>& E, NeutrinoFlavor flavor, NeutrinoType neutype, Current current, marray<double,2>& dsde) const;
+      /// \brief The tables are only read, so the differential cross sections can be evaluated concurrently.
+      bool ThreadSafeDifferentialCrossSections() const { return true; }
+      /// \brief Key of the cross section tables, which does not require to read them.
+      /// \details It includes the size and modification time of each table file.
+      static std::string TablesCacheKey();
+      std::string CacheKey() const { return TablesCacheKey(); }
 
       /*
       /// \brief Returns the diferencial charge current cross section.
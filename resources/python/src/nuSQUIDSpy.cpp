@@ -163,6 +163,40 @@ static void wrap_ReadStateHDF5(nuSQUIDS* nusq, std::string path){
   nusq->ReadStateHDF5(path);
 }
 
+// nuSQUIDSAtm wrap functions
+static void wrap_nusqatm_WriteStateHDF5(nuSQUIDSAtm<>* nusq_atm, std::string path){
+  nusq_atm->WriteStateHDF5(path);
+}
+
+static void wrap_nusqatm_ReadStateHDF5(nuSQUIDSAtm<>* nusq_atm, std::string path){
+  nusq_atm->ReadStateHDF5(path);
+}
+
+static void wrap_nusqatm_Set_Checkpoint(nuSQUIDSAtm<>* nusq_atm, std::string path){
+  nusq_atm->Set_Checkpoint(path);
+}
+
+static void wrap_Set_TrackProfile(nuSQUIDS* nusq, bool opt){
+  nusq->Set_TrackProfile(opt);
+}
+
+static void wrap_nusqatm_Set_TrackProfile(nuSQUIDSAtm<>* nusq_atm, bool opt){
+  nusq_atm->Set_TrackProfile(opt);
+}
+
+static void wrap_Set_LayeredEvolution(nuSQUIDS* nusq, bool opt){
+  nusq->Set_LayeredEvolution(opt);
+}
+
+static void wrap_nusqatm_Set_LayeredEvolution(nuSQUIDSAtm<>* nusq_atm, bool opt){
+  nusq_atm->Set_LayeredEvolution(opt);
+}
+
+// FlavorTable wrap functions
+static double wrap_FlavorTable_Eval(FlavorTable* table, unsigned int flv, double costh, double enu){
+  return table->Eval(flv,costh,enu);
+}
+
 static void wrap_Set_initial_state(nuSQUIDS* nusq, PyObject * array, Basis neutype){
   if (! PyArray_Check(array) )
   {
@@ -341,6 +375,21 @@ BOOST_PYTHON_MODULE(nuSQUIDSpy)
     .def("Set_AdaptiveStep",&nuSQUIDS::Set_AdaptiveStep)
     .def("Set_GSL_step",wrap_Set_GSL_STEP)
     .def("Set_TauRegeneration",&nuSQUIDS::Set_TauRegeneration)
+    .def("Set_FusedDerivatives",&nuSQUIDS::Set_FusedDerivatives)
+    .def("Set_TrackProfile",&nuSQUIDS::Set_TrackProfile)
+    .def("Set_TrackProfile",wrap_Set_TrackProfile)
+    .def("Set_LayeredEvolution",&nuSQUIDS::Set_LayeredEvolution)
+    .def("Set_LayeredEvolution",wrap_Set_LayeredEvolution)
+    .def("Set_StopAtDiscontinuities",&nuSQUIDS::Set_StopAtDiscontinuities)
+    .def("Set_ClosedFormEvolution",&nuSQUIDS::Set_ClosedFormEvolution)
+    .def("Set_InteractionCacheDirectory",&nuSQUIDS::Set_InteractionCacheDirectory)
+    .staticmethod("Set_InteractionCacheDirectory")
+    .def("Get_InteractionCacheDirectory",&nuSQUIDS::Get_InteractionCacheDirectory)
+    .staticmethod("Get_InteractionCacheDirectory")
+    .def("Set_InteractionThreads",&nuSQUIDS::Set_InteractionThreads)
+    .staticmethod("Set_InteractionThreads")
+    .def("Get_InteractionThreads",&nuSQUIDS::Get_InteractionThreads)
+    .staticmethod("Get_InteractionThreads")
     .def("Set_ProgressBar",&nuSQUIDS::Set_ProgressBar)
     .def("Set_MixingParametersToDefault",&nuSQUIDS::Set_MixingParametersToDefault)
     .def("Set_Basis",&nuSQUIDS::Set_Basis)
@@ -355,11 +404,28 @@ BOOST_PYTHON_MODULE(nuSQUIDSpy)
 
   class_<nuSQUIDSAtm<>, boost::noncopyable, std::shared_ptr<nuSQUIDSAtm<>> >("nuSQUIDSAtm", init<double,double,unsigned int,double,double,unsigned int,unsigned int,NeutrinoType,bool,bool>())
     .def(init<std::string>())
+    .def(init<std::string,bool,bool>())
     .def("EvolveState",&nuSQUIDSAtm<>::EvolveState)
+    .def("Set_Checkpoint",&nuSQUIDSAtm<>::Set_Checkpoint)
+    .def("Set_Checkpoint",wrap_nusqatm_Set_Checkpoint)
+    .def("EvolveStateFromCheckpoint",&nuSQUIDSAtm<>::EvolveStateFromCheckpoint)
+    .def("Set_NumThreads",&nuSQUIDSAtm<>::Set_NumThreads)
+    .def("Get_NumThreads",&nuSQUIDSAtm<>::Get_NumThreads)
+    .def("Set_ZenithCostEstimates",&nuSQUIDSAtm<>::Set_ZenithCostEstimates)
+    .def("GetZenithEvolutionTimes",&nuSQUIDSAtm<>::GetZenithEvolutionTimes)
     .def("Set_TauRegeneration",&nuSQUIDSAtm<>::Set_TauRegeneration)
+    .def("Set_FusedDerivatives",&nuSQUIDSAtm<>::Set_FusedDerivatives)
+    .def("Set_TrackProfile",&nuSQUIDSAtm<>::Set_TrackProfile)
+    .def("Set_TrackProfile",wrap_nusqatm_Set_TrackProfile)
+    .def("Set_LayeredEvolution",&nuSQUIDSAtm<>::Set_LayeredEvolution)
+    .def("Set_LayeredEvolution",wrap_nusqatm_Set_LayeredEvolution)
+    .def("Set_StopAtDiscontinuities",&nuSQUIDSAtm<>::Set_StopAtDiscontinuities)
     .def("EvalFlavor",&nuSQUIDSAtm<>::EvalFlavor)
+    .def("FreezeFlavorTable",&nuSQUIDSAtm<>::FreezeFlavorTable)
     .def("WriteStateHDF5",&nuSQUIDSAtm<>::WriteStateHDF5)
+    .def("WriteStateHDF5",wrap_nusqatm_WriteStateHDF5)
     .def("ReadStateHDF5",&nuSQUIDSAtm<>::ReadStateHDF5)
+    .def("ReadStateHDF5",wrap_nusqatm_ReadStateHDF5)
     .def("Set_MixingAngle",&nuSQUIDSAtm<>::Set_MixingAngle)
     .def("Set_CPPhase",&nuSQUIDSAtm<>::Set_CPPhase)
     .def("Set_SquareMassDifference",&nuSQUIDSAtm<>::Set_SquareMassDifference)
@@ -375,6 +441,16 @@ BOOST_PYTHON_MODULE(nuSQUIDSpy)
     .def("GetCosthRange",&nuSQUIDSAtm<>::GetCosthRange)
   ;
 
+  class_<FlavorTable>("FlavorTable", init<std::string>())
+    .def("Eval",&FlavorTable::Eval)
+    .def("Eval",wrap_FlavorTable_Eval)
+    .def("Write",&FlavorTable::Write)
+    .def("GetCosth",&FlavorTable::GetCosth)
+    .def("GetEnergy",&FlavorTable::GetEnergy)
+    .def("GetNumCos",&FlavorTable::GetNumCos)
+    .def("GetNumE",&FlavorTable::GetNumE)
+  ;
+
 
   class_<squids::Const, boost::noncopyable>("Const")
     .def_readonly("TeV",&squids::Const::TeV)
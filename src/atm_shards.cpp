@@ -0,0 +1,407 @@
+ /******************************************************************************
+ *    This program is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by      *
+ *   the Free Software Foundation, either version 3 of the License, or         *
+ *   (at your option) any later version.                                       *
+ *                                                                             *
+ *   This program is distributed in the hope that it will be useful,           *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ *   GNU General Public License for more details.                              *
+ *                                                                             *
+ *   You should have received a copy of the GNU General Public License         *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *                                                                             *
+ *   Authors:                                                                  *
+ *      Carlos Arguelles (University of Wisconsin Madison)                     *
+ *         carguelles@icecube.wisc.edu                                         *
+ *      Jordi Salvado (University of Wisconsin Madison)                        *
+ *         jsalvado@icecube.wisc.edu                                           *
+ *      Christopher Weaver (University of Wisconsin Madison)                   *
+ *         chris.weaver@icecube.wisc.edu                                       *
+ ******************************************************************************/
+
+#include "atm_shards.h"
+#include "version.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+#include "H5Apublic.h"
+#include "H5Dpublic.h"
+#include "H5Epublic.h"
+#include "H5Fpublic.h"
+#include "H5Gpublic.h"
+#include "H5Lpublic.h"
+#include "H5Opublic.h"
+#include "H5Ppublic.h"
+#include "H5Tpublic.h"
+#include "H5LTpublic.h"
+
+namespace nusquids{
+
+namespace{
+
+// closes an HDF5 file when it goes out of scope, so that errors do not leak it
+struct HDF5File{
+  hid_t id;
+  HDF5File(hid_t id, const std::string& filename):id(id){
+    if(id < 0)
+      throw std::runtime_error("nuSQUIDSAtm::Error::Cannot open file " + filename + ".");
+  }
+  ~HDF5File(){ H5Fclose(id); }
+};
+
+// datasets written to the shared cross section group by nuSQUIDS::WriteStateHDF5
+const std::vector<std::string> cross_section_datasets {"sigmacc","sigmanc","dNdEcc","dNdEnc",
+                                                       "invlentau","dNdEtauall","dNdEtaulep"};
+
+// datasets common to all the zenith nodes in the consolidated layout
+const std::vector<std::string> parameter_datasets {"energies","basic","mixingangles","CPphases","massdifferences"};
+
+// datasets of the consolidated layout whose first dimension runs over the zenith nodes
+const std::vector<std::string> zenith_datasets {"state","flavorcomp","masscomp","squids_time","squids_time_initial",
+                                                "tracks","track_x","bodies","body_ids"};
+
+// whether the file was written with the consolidated layout of nuSQUIDSAtm::WriteStateHDF5
+bool IsConsolidated(hid_t file_id){
+  if(H5Aexists(file_id,"layout") <= 0)
+    return false;
+  char layout[32];
+  H5LTget_attribute_string(file_id, ".", "layout", layout);
+  return std::string(layout) == "consolidated";
+}
+
+std::vector<hsize_t> DatasetDims(hid_t loc_id, const std::string& name){
+  int rank;
+  if(H5LTget_dataset_ndims(loc_id,name.c_str(),&rank) < 0)
+    throw std::runtime_error("nuSQUIDSAtm::Error::Dataset '" + name + "' does not exist in HDF5.");
+  std::vector<hsize_t> dims(rank);
+  H5LTget_dataset_info(loc_id,name.c_str(),dims.data(),NULL,NULL);
+  return dims;
+}
+
+std::vector<double> ReadDataset(hid_t loc_id, const std::string& name){
+  hsize_t size = 1;
+  for(hsize_t dim : DatasetDims(loc_id,name))
+    size *= dim;
+  std::vector<double> data(size);
+  if(size != 0)
+    H5LTread_dataset_double(loc_id,name.c_str(),data.data());
+  return data;
+}
+
+// prints the values with enough digits to compare them exactly
+std::string ToString(const std::vector<double>& values){
+  std::ostringstream ss;
+  ss << std::setprecision(17);
+  for(double value : values)
+    ss << value << " ";
+  return ss.str();
+}
+
+std::string NodeGroupName(double costh){
+  // same naming as nuSQUIDSAtm::WriteStateHDF5
+  return "costh_"+std::to_string(costh);
+}
+
+// collects the settings of a zenith node which have to be common to all the nodes of a table
+std::map<std::string,std::string> ReadNodeSettings(hid_t file_id, const std::string& grp){
+  hid_t group_id = H5Gopen(file_id, grp.c_str(), H5P_DEFAULT);
+  if(group_id < 0)
+    throw std::runtime_error("nuSQUIDSAtm::Error::Group '" + grp + "' does not exist in HDF5.");
+
+  std::map<std::string,std::string> settings;
+  unsigned int numneu, version;
+  int auxint;
+  char auxchar[20];
+  H5LTget_attribute_uint(group_id, "basic", "numneu", &numneu);
+  settings["numneu"] = std::to_string(numneu);
+  H5LTget_attribute_int(group_id, "basic", "NT", &auxint);
+  settings["NT"] = std::to_string(auxint);
+  H5LTget_attribute_string(group_id, "basic", "interactions", auxchar);
+  settings["interactions"] = auxchar;
+  H5LTget_attribute_uint(group_id, "basic", "squids_version_number", &version);
+  settings["squids_version_number"] = std::to_string(version);
+  H5LTget_attribute_uint(group_id, "basic", "nusquids_version_number", &version);
+  settings["nusquids_version_number"] = std::to_string(version);
+
+  for( unsigned int i = 0; i < numneu; i++ ){
+    for( unsigned int j = i+1; j < numneu; j++ ){
+      double value;
+      std::string th_label = "th"+std::to_string(i+1)+std::to_string(j+1);
+      H5LTget_attribute_double(group_id, "mixingangles", th_label.c_str(), &value);
+      settings[th_label] = ToString({value});
+
+      std::string delta_label = "delta"+std::to_string(i+1)+std::to_string(j+1);
+      H5LTget_attribute_double(group_id, "CPphases", delta_label.c_str(), &value);
+      settings[delta_label] = ToString({value});
+    }
+  }
+  for( unsigned int i = 1; i < numneu; i++ ){
+    double value;
+    std::string dm2_label = "dm"+std::to_string(i+1)+"1sq";
+    H5LTget_attribute_double(group_id, "massdifferences", dm2_label.c_str(), &value);
+    settings[dm2_label] = ToString({value});
+  }
+
+  H5LTget_attribute_string(group_id, "energies", "elogscale", auxchar);
+  settings["elogscale"] = auxchar;
+  settings["energies"] = ToString(ReadDataset(group_id,"energies"));
+
+  // in the consolidated layout the body is stored per node, see ReadConsolidatedBodies
+  if(H5Lexists(group_id,"body",H5P_DEFAULT) > 0){
+    unsigned int body_id;
+    H5LTget_attribute_uint(group_id, "body", "ID", &body_id);
+    settings["body"] = std::to_string(body_id) + " " + ToString(ReadDataset(group_id,"body"));
+  }
+
+  H5Gclose(group_id);
+  return settings;
+}
+
+// returns the body of every zenith node of a consolidated file, as ReadNodeSettings does
+std::vector<std::string> ReadConsolidatedBodies(hid_t file_id){
+  std::vector<hsize_t> dims = DatasetDims(file_id,"body_ids");
+  std::vector<unsigned int> body_ids(dims[0]);
+  if(not body_ids.empty())
+    H5LTread_dataset(file_id,"body_ids",H5T_NATIVE_UINT,body_ids.data());
+  std::vector<double> bodies = ReadDataset(file_id,"bodies");
+  size_t row_size = body_ids.empty() ? 0 : bodies.size()/body_ids.size();
+  std::vector<std::string> body_settings;
+  for(size_t row = 0; row < body_ids.size(); row++){
+    std::vector<double> body(bodies.begin()+row*row_size,bodies.begin()+(row+1)*row_size);
+    body_settings.push_back(std::to_string(body_ids[row]) + " " + ToString(body));
+  }
+  return body_settings;
+}
+
+// stacks the rows of a per-zenith dataset of several consolidated files
+// @param rows For each output row, the file and the row within it.
+// Each file's dataset is read once, when its first row is needed.
+void MergeZenithDataset(const std::vector<hid_t>& file_ids, const std::vector<std::pair<unsigned int,size_t>>& rows,
+                        hid_t output_id, const std::string& name){
+  std::vector<std::vector<char>> shard_data(file_ids.size());
+  std::vector<bool> shard_read(file_ids.size(),false);
+  std::vector<hsize_t> merged_dims;
+  hid_t native_type = -1;
+  size_t row_size = 0;
+  auto read_shard = [&](unsigned int ishard){
+    hid_t file_id = file_ids[ishard];
+    std::vector<hsize_t> dims = DatasetDims(file_id,name);
+    hid_t dset_id = H5Dopen(file_id, name.c_str(), H5P_DEFAULT);
+    hid_t file_type = H5Dget_type(dset_id);
+    hid_t row_type = H5Tget_native_type(file_type, H5T_DIR_ASCEND);
+    H5Tclose(file_type);
+
+    if(native_type < 0){
+      merged_dims = dims;
+      merged_dims[0] = rows.size();
+      native_type = H5Tcopy(row_type);
+      row_size = H5Tget_size(row_type);
+      for(size_t i = 1; i < dims.size(); i++)
+        row_size *= dims[i];
+    }
+    bool same_shape = H5Tequal(row_type,native_type) > 0 and dims.size() == merged_dims.size() and
+                      std::equal(dims.begin()+1,dims.end(),merged_dims.begin()+1);
+
+    std::vector<char>& data = shard_data[ishard];
+    if(same_shape){
+      data.resize(row_size*dims[0]);
+      if(not data.empty())
+        H5Dread(dset_id, row_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, data.data());
+    }
+    H5Tclose(row_type);
+    H5Dclose(dset_id);
+    if(not same_shape){
+      H5Tclose(native_type);
+      throw std::runtime_error("nuSQUIDSAtm::Error::Dataset '" + name + "' has different shapes in the shards.");
+    }
+    shard_read[ishard] = true;
+  };
+
+  std::vector<char> merged;
+  for(const auto& row : rows){
+    if(not shard_read[row.first])
+      read_shard(row.first);
+    const std::vector<char>& data = shard_data[row.first];
+    merged.insert(merged.end(),data.begin()+row.second*row_size,data.begin()+(row.second+1)*row_size);
+  }
+  H5LTmake_dataset(output_id,name.c_str(),merged_dims.size(),merged_dims.data(),native_type,
+                   merged.empty() ? NULL : merged.data());
+  H5Tclose(native_type);
+}
+
+} // close unnamed namespace
+
+marray<double,1> GetAtmShardZenithRange(const marray<double,1>& costh_array,
+                                        unsigned int ishard, unsigned int nshards){
+  if(nshards == 0 or ishard >= nshards)
+    throw std::runtime_error("nuSQUIDSAtm::Error::Shard " + std::to_string(ishard) +
+                             " does not exist when using " + std::to_string(nshards) + " shards.");
+  size_t ncosth = costh_array.extent(0);
+  size_t begin = (ncosth*ishard)/nshards;
+  size_t end = (ncosth*(ishard+1))/nshards;
+  if(begin == end)
+    throw std::runtime_error("nuSQUIDSAtm::Error::Shard " + std::to_string(ishard) + " has no zenith nodes.");
+
+  marray<double,1> shard_costh_array{end-begin};
+  for(size_t i = begin; i < end; i++)
+    shard_costh_array[i-begin] = costh_array[i];
+  return shard_costh_array;
+}
+
+void CheckAtmShardConsistency(const std::vector<std::string>& shard_files){
+  if(shard_files.empty())
+    throw std::runtime_error("nuSQUIDSAtm::Error::No shards given.");
+
+  // this lines supress HDF5 error messages
+  H5Eset_auto (H5E_DEFAULT,NULL, NULL);
+
+  std::vector<double> energy_range;
+  std::map<std::string,std::string> settings;
+  std::map<std::string,std::string> cross_sections;
+  std::map<double,std::string> zenith_owner;
+  bool consolidated = false;
+
+  for(const std::string& filename : shard_files){
+    HDF5File file(H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT),filename);
+
+    bool shard_consolidated = IsConsolidated(file.id);
+    if(filename == shard_files.front())
+      consolidated = shard_consolidated;
+    else if(shard_consolidated != consolidated)
+      throw std::runtime_error("nuSQUIDSAtm::Error::Layout of " + filename +
+                               " differs from the one of " + shard_files.front() + ".");
+
+    std::vector<double> shard_energy_range = ReadDataset(file.id,"energy_range");
+    if(energy_range.empty())
+      energy_range = shard_energy_range;
+    else if(shard_energy_range != energy_range)
+      throw std::runtime_error("nuSQUIDSAtm::Error::Energy grid of " + filename +
+                               " differs from the one of " + shard_files.front() + ".");
+
+    std::vector<double> zenith_angles = ReadDataset(file.id,"zenith_angles");
+    if(zenith_angles.empty())
+      throw std::runtime_error("nuSQUIDSAtm::Error::" + filename + " has no zenith nodes.");
+    // the consolidated layout stores the settings once, and the bodies in one dataset
+    std::map<std::string,std::string> root_settings;
+    std::vector<std::string> bodies;
+    if(consolidated){
+      root_settings = ReadNodeSettings(file.id,"/");
+      bodies = ReadConsolidatedBodies(file.id);
+      if(bodies.size() != zenith_angles.size())
+        throw std::runtime_error("nuSQUIDSAtm::Error::" + filename + " does not have a body per zenith node.");
+    }
+    for(size_t row = 0; row < zenith_angles.size(); row++){
+      double costh = zenith_angles[row];
+      auto owner = zenith_owner.find(costh);
+      if(owner != zenith_owner.end())
+        throw std::runtime_error("nuSQUIDSAtm::Error::Zenith node " + std::to_string(costh) +
+                                 " is in both " + owner->second + " and " + filename + ".");
+      zenith_owner[costh] = filename;
+
+      std::map<std::string,std::string> node_settings;
+      if(consolidated){
+        node_settings = root_settings;
+        node_settings["body"] = bodies[row];
+      } else {
+        node_settings = ReadNodeSettings(file.id,NodeGroupName(costh));
+      }
+      if(settings.empty())
+        settings = node_settings;
+      for(const auto& setting : settings){
+        if(node_settings[setting.first] != setting.second)
+          throw std::runtime_error("nuSQUIDSAtm::Error::Setting '" + setting.first + "' of zenith node " +
+                                   std::to_string(costh) + " in " + filename + " differs from the one in " +
+                                   shard_files.front() + ".");
+      }
+    }
+
+    // the merged file stores a single copy of the cross sections
+    if(settings["interactions"] == "True"){
+      hid_t xs_grp = H5Gopen(file.id, "crosssections", H5P_DEFAULT);
+      if(xs_grp < 0)
+        throw std::runtime_error("nuSQUIDSAtm::Error::" + filename + " has no cross sections.");
+      std::map<std::string,std::string> shard_cross_sections;
+      for(const std::string& name : cross_section_datasets)
+        shard_cross_sections[name] = ToString(ReadDataset(xs_grp,name));
+      H5Gclose(xs_grp);
+      if(cross_sections.empty())
+        cross_sections = shard_cross_sections;
+      else if(shard_cross_sections != cross_sections)
+        throw std::runtime_error("nuSQUIDSAtm::Error::Cross sections of " + filename +
+                                 " differ from the ones of " + shard_files.front() + ".");
+    }
+  }
+}
+
+void MergeAtmStateHDF5(const std::vector<std::string>& shard_files, std::string output_file){
+  CheckAtmShardConsistency(shard_files);
+
+  // the shard files are kept open since the consolidated layout reads them node by node
+  std::vector<std::unique_ptr<HDF5File>> files;
+  std::vector<hid_t> file_ids;
+  for(const std::string& filename : shard_files){
+    files.emplace_back(new HDF5File(H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT),filename));
+    file_ids.push_back(files.back()->id);
+  }
+  bool consolidated = IsConsolidated(file_ids[0]);
+
+  // zenith nodes of the merged table, in increasing order, with the shard and row holding each of them
+  std::vector<std::pair<double,std::pair<unsigned int,size_t>>> nodes;
+  for(unsigned int ishard = 0; ishard < shard_files.size(); ishard++){
+    std::vector<double> shard_zenith_angles = ReadDataset(file_ids[ishard],"zenith_angles");
+    for(size_t row = 0; row < shard_zenith_angles.size(); row++)
+      nodes.push_back(std::make_pair(shard_zenith_angles[row],std::make_pair(ishard,row)));
+  }
+  std::sort(nodes.begin(),nodes.end());
+  std::vector<double> energy_range = ReadDataset(file_ids[0],"energy_range");
+
+  HDF5File output(H5Fcreate(output_file.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT),output_file);
+
+  std::vector<double> zenith_angles;
+  std::vector<std::pair<unsigned int,size_t>> rows;
+  for(const auto& node : nodes){
+    zenith_angles.push_back(node.first);
+    rows.push_back(node.second);
+  }
+  hsize_t costhdims[1]={zenith_angles.size()};
+  H5LTmake_dataset(output.id,"zenith_angles",1,costhdims,H5T_NATIVE_DOUBLE,zenith_angles.data());
+  hsize_t energydims[1]={energy_range.size()};
+  H5LTmake_dataset(output.id,"energy_range",1,energydims,H5T_NATIVE_DOUBLE,energy_range.data());
+
+  auto copy = [&](unsigned int ishard, const std::string& src, const std::string& dst){
+    if(H5Ocopy(file_ids[ishard], src.c_str(), output.id, dst.c_str(), H5P_DEFAULT, H5P_DEFAULT) < 0)
+      throw std::runtime_error("nuSQUIDSAtm::Error::Cannot copy '" + src + "' from " +
+                               shard_files[ishard] + " to " + output_file + ".");
+  };
+
+  if(consolidated){
+    H5LTset_attribute_string(output.id, ".", "layout", "consolidated");
+    for(const std::string& name : parameter_datasets)
+      copy(0,name,name);
+    for(const std::string& name : zenith_datasets)
+      MergeZenithDataset(file_ids,rows,output.id,name);
+    hid_t user_parameters_id = H5Gcreate(output.id, "user_parameters", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    H5Gclose(user_parameters_id);
+    for(const auto& node : nodes){
+      std::string grp = "user_parameters/" + NodeGroupName(node.first);
+      if(H5Lexists(file_ids[node.second.first], "user_parameters", H5P_DEFAULT) > 0 and
+         H5Lexists(file_ids[node.second.first], grp.c_str(), H5P_DEFAULT) > 0)
+        copy(node.second.first,grp,grp);
+    }
+  } else {
+    for(const auto& node : nodes){
+      std::string grp = NodeGroupName(node.first);
+      copy(node.second.first,grp,grp);
+    }
+  }
+  copy(0,"crosssections","crosssections");
+}
+
+} // close namespace
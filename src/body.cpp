@@ -31,6 +31,63 @@ namespace nusquids{
 
 static squids::Const param;
 
+namespace{
+
+// Radii, relative to the outermost one, that bound the discontinuities of a tabulated Earth model.
+// The models are tabulated on a grid, so a discontinuity shows up as an interval whose
+// density change is several times larger than that of both neighbouring intervals. The
+// spline through the table is smooth, so the jump becomes a steep ramp over that interval;
+// both of its nodes are returned, since the spline is a single cubic between two nodes
+// while its third derivative changes at the nodes. The ratio assumes a regular grid, on which
+// the changes of a smooth profile vary slowly from one interval to the next.
+std::vector<double> FindLayerRadii(const marray<double,2>& model){
+  const double jump_ratio = 3.0;
+  const size_t size = model.extent(0);
+  std::vector<double> change(size > 0 ? size - 1 : 0);
+  for (size_t i = 0; i + 1 < size; i++)
+    change[i] = std::abs(model[i+1][1] - model[i][1]);
+
+  std::vector<double> radii;
+  for (size_t i = 0; i < change.size(); i++){
+    double neighbours = 0.;
+    if ( i > 0 )
+      neighbours = std::max(neighbours,change[i-1]);
+    if ( i + 1 < change.size() )
+      neighbours = std::max(neighbours,change[i+1]);
+    if ( change[i] > 0. and change[i] > jump_ratio*neighbours ){
+      radii.push_back(model[i][0]);
+      radii.push_back(model[i+1][0]);
+    }
+  }
+  return radii;
+}
+
+// Adds the positions along a chord at which it is at distance layer_radius from the
+// center. The chord starts at distance outer_radius from the center and has length
+// chord_length, so the distance at x is sqrt(outer_radius^2 + x^2 - chord_length*x).
+void AddChordCrossings(double outer_radius, double chord_length, double layer_radius, std::vector<double>& crossings){
+  double discriminant = SQR(layer_radius) - SQR(outer_radius) + 0.25*SQR(chord_length);
+  if ( discriminant <= 0. )
+    return;
+  double half_width = sqrt(discriminant);
+  crossings.push_back(0.5*chord_length - half_width);
+  crossings.push_back(0.5*chord_length + half_width);
+}
+
+// Keeps the crossings within the track, sorts them and removes repeated ones.
+std::vector<double> ClipCrossings(std::vector<double> crossings, const GenericTrack& track){
+  std::vector<double> inside;
+  for (double x : crossings){
+    if ( x > track.GetInitialX() and x < track.GetFinalX() )
+      inside.push_back(x);
+  }
+  std::sort(inside.begin(),inside.end());
+  inside.erase(std::unique(inside.begin(),inside.end()),inside.end());
+  return inside;
+}
+
+} // close unnamed namespace
+
 /*
 ----------------------------------------------------------------------
          VACUUM CLASS DEFINITIONS
@@ -109,11 +166,9 @@ VariableDensity::VariableDensity(std::vector<double> x_input,std::vector<double>
             }
 
             inter_density = gsl_spline_alloc(gsl_interp_cspline,arraysize);
-            inter_density_accel = gsl_interp_accel_alloc ();
             gsl_spline_init (inter_density,x_arr,density_arr,arraysize);
 
             inter_ye = gsl_spline_alloc(gsl_interp_cspline,arraysize);
-            inter_ye_accel = gsl_interp_accel_alloc ();
             gsl_spline_init (inter_ye,x_arr,ye_arr,arraysize);
 
             for(double xx : x_input)
@@ -137,7 +192,7 @@ double VariableDensity::density(const GenericTrack& track_input) const
           if (x < x_min or x > x_max ){
               return 0;
           } else {
-              return gsl_spline_eval(inter_density,x,inter_density_accel);
+              return EvalSpline(inter_density,x,track_input,0);
           }
         }
 double VariableDensity::ye(const GenericTrack& track_input) const
@@ -146,7 +201,7 @@ double VariableDensity::ye(const GenericTrack& track_input) const
           if (x < x_min or x > x_max ){
               return 0;
           } else {
-              return gsl_spline_eval(inter_ye,x,inter_ye_accel);
+              return EvalSpline(inter_ye,x,track_input,1);
           }
         }
 
@@ -182,7 +237,7 @@ double Earth::density(const GenericTrack& track_input) const
               return x_rho_max;
             }
             else {
-              return gsl_spline_eval(inter_density,r/radius,inter_density_accel);
+              return EvalSpline(inter_density,r/radius,track_input,0);
             }
         }
 
@@ -200,10 +255,19 @@ double Earth::ye(const GenericTrack& track_input) const
               return x_ye_max;
             }
             else {
-              return gsl_spline_eval(inter_ye,r/radius,inter_ye_accel);
+              return EvalSpline(inter_ye,r/radius,track_input,1);
             }
         }
 
+std::vector<double> Earth::GetLayerBoundaries(const GenericTrack& track_input) const
+        {
+            const Earth::Track& track_earth = static_cast<const Earth::Track&>(track_input);
+            std::vector<double> crossings;
+            for (double layer_radius : layer_radii)
+              AddChordCrossings(radius*param.km,track_earth.GetBaseline(),layer_radius*radius*param.km,crossings);
+            return ClipCrossings(crossings,track_input);
+        }
+
 Earth::Earth(std::string filepath):Body(4,"Earth")
         {
           // The Input file should have the radius specified from 0 to 1.
@@ -231,19 +295,17 @@ Earth::Earth(std::string filepath):Body(4,"Earth")
             x_ye_max = earth_ye[arraysize-1];
 
             inter_density = gsl_spline_alloc(gsl_interp_cspline,arraysize);
-            inter_density_accel = gsl_interp_accel_alloc ();
             gsl_spline_init (inter_density,earth_radius,earth_density,arraysize);
 
             inter_ye = gsl_spline_alloc(gsl_interp_cspline,arraysize);
-            inter_ye_accel = gsl_interp_accel_alloc ();
             gsl_spline_init (inter_ye,earth_radius,earth_ye,arraysize);
+
+            layer_radii = FindLayerRadii(earth_model);
         }
 
 Earth::~Earth(){
   gsl_spline_free(inter_density);
-  gsl_interp_accel_free(inter_density_accel);
   gsl_spline_free(inter_ye);
-  gsl_interp_accel_free(inter_ye_accel);
 }
 
 /*
@@ -272,11 +334,9 @@ Sun::Sun():Body(5,"Sun")
             }
 
             inter_density = gsl_spline_alloc(gsl_interp_cspline,arraysize);
-            inter_density_accel = gsl_interp_accel_alloc ();
             gsl_spline_init (inter_density,sun_radius,sun_density,arraysize);
 
             inter_rxh = gsl_spline_alloc(gsl_interp_cspline,arraysize);
-            inter_rxh_accel = gsl_interp_accel_alloc ();
             gsl_spline_init (inter_rxh,sun_radius,sun_xh,arraysize);
         }
 // track constructor
@@ -286,37 +346,37 @@ Sun::Track::Track(double xini, double xend):Body::Track(xini,xend)
             TrackParams = {xini,xend};
         }
 
-double Sun::rdensity(double x) const{
+double Sun::rdensity(double x, const GenericTrack& track) const{
         // x is adimentional radius : x = 0 : center, x = 1 : radius
             if (x < sun_radius[0]){
                 return sun_density[0];
             } else if ( x > sun_radius[arraysize-1]){
                 return 0;
             } else {
-                return gsl_spline_eval(inter_density,x,inter_density_accel);
+                return EvalSpline(inter_density,x,track,0);
             }
         }
 
-double Sun::rxh(double x) const{
+double Sun::rxh(double x, const GenericTrack& track) const{
         // x is adimentional radius : x = 0 : center, x = 1 : radius
             if (x < sun_radius[0]){
                 return sun_xh[0];
             } else if ( x > sun_radius[arraysize-1]){
                 return 0;
             } else {
-                return gsl_spline_eval(inter_rxh,x,inter_rxh_accel);
+                return EvalSpline(inter_rxh,x,track,1);
             }
         }
 
 double Sun::density(const GenericTrack& track_input) const
         {
             double r = track_input.GetX()/(radius);
-            return rdensity(r);
+            return rdensity(r,track_input);
         }
 double Sun::ye(const GenericTrack& track_input) const
         {
             double r = track_input.GetX()/(radius);
-            return 0.5*(1.0+rxh(r));
+            return 0.5*(1.0+rxh(r,track_input));
         }
 
 Sun::~Sun(){
@@ -326,9 +386,7 @@ Sun::~Sun(){
   //free(sun_nele_radius);
   //free(sun_nele);
   gsl_spline_free(inter_density);
-  gsl_interp_accel_free(inter_density_accel);
   gsl_spline_free(inter_rxh);
-  gsl_interp_accel_free(inter_rxh_accel);
   //free(inter_nele);
   //free(inter_nele_accel);
 }
@@ -357,11 +415,9 @@ SunASnu::SunASnu():Body(6,"SunASnu")
             }
 
             inter_density = gsl_spline_alloc(gsl_interp_cspline,arraysize);
-            inter_density_accel = gsl_interp_accel_alloc ();
             gsl_spline_init (inter_density,sun_radius,sun_density,arraysize);
 
             inter_rxh = gsl_spline_alloc(gsl_interp_cspline,arraysize);
-            inter_rxh_accel = gsl_interp_accel_alloc ();
             gsl_spline_init (inter_rxh,sun_radius,sun_xh,arraysize);
         }
 // track constructor
@@ -375,25 +431,25 @@ SunASnu::Track::Track(double xini, double b_impact):
             TrackParams = {xini,xend,b_impact};
         }
 
-double SunASnu::rdensity(double x) const{
+double SunASnu::rdensity(double x, const GenericTrack& track) const{
         // x is adimentional radius : x = 0 : center, x = 1 : radius
             if (x < sun_radius[0]){
                 return sun_density[0];
             } else if ( x > sun_radius[arraysize-1]){
                 return 0;
             } else {
-                return gsl_spline_eval(inter_density,x,inter_density_accel);
+                return EvalSpline(inter_density,x,track,0);
             }
         }
 
-double SunASnu::rxh(double x) const{
+double SunASnu::rxh(double x, const GenericTrack& track) const{
         // x is adimentional radius : x = 0 : center, x = 1 : radius
             if (x < sun_radius[0]){
                 return sun_xh[0];
             } else if ( x > sun_radius[arraysize-1]){
                 return 0;
             } else {
-                return gsl_spline_eval(inter_rxh,x,inter_rxh_accel);
+                return EvalSpline(inter_rxh,x,track,1);
             }
         }
 
@@ -406,7 +462,7 @@ double SunASnu::density(const GenericTrack& track_input) const
 
             double r = sqrt(SQR(radius)+SQR(x)-2.0*x*sqrt(SQR(radius)-SQR(b)))/radius;
 
-            return rdensity(r);
+            return rdensity(r,track_input);
         }
 
 double SunASnu::ye(const GenericTrack& track_input) const
@@ -416,7 +472,7 @@ double SunASnu::ye(const GenericTrack& track_input) const
             double x = track_sunasnu.GetX();
             double b = track_sunasnu.b_impact;
             double r = sqrt(SQR(radius)+SQR(x)-2.0*x*sqrt(SQR(radius)-SQR(b)))/radius;
-            return 0.5*(1.0+rxh(r));
+            return 0.5*(1.0+rxh(r,track_input));
         }
 
 SunASnu::~SunASnu(){
@@ -424,9 +480,7 @@ SunASnu::~SunASnu(){
   free(sun_density);
   free(sun_xh);
   gsl_spline_free(inter_density);
-  gsl_interp_accel_free(inter_density_accel);
   gsl_spline_free(inter_rxh);
-  gsl_interp_accel_free(inter_rxh_accel);
 }
 
 /*
@@ -511,7 +565,7 @@ double EarthAtm::density(const GenericTrack& track_input) const
                 double h0 = 25.0;
                 return 1.05*exp(-h/h0);
             } else {
-              return gsl_spline_eval(inter_density,r/radius,inter_density_accel);
+              return EvalSpline(inter_density,r/radius,track_input,0);
             }
         }
 
@@ -531,10 +585,20 @@ double EarthAtm::ye(const GenericTrack& track_input) const
             else if ( rel_r > radius/earth_with_atm_radius ){
               return 0.494;
             }else {
-              return gsl_spline_eval(inter_ye,rel_r,inter_ye_accel);
+              return EvalSpline(inter_ye,rel_r,track_input,1);
             }
         }
 
+std::vector<double> EarthAtm::GetLayerBoundaries(const GenericTrack& track_input) const
+        {
+            const EarthAtm::Track& track_earthatm = static_cast<const EarthAtm::Track&>(track_input);
+            std::vector<double> crossings;
+            AddChordCrossings(earth_with_atm_radius*param.km,track_earthatm.L,radius*param.km,crossings);
+            for (double layer_radius : layer_radii)
+              AddChordCrossings(earth_with_atm_radius*param.km,track_earthatm.L,layer_radius*radius*param.km,crossings);
+            return ClipCrossings(crossings,track_input);
+        }
+
 EarthAtm::EarthAtm(std::string filepath):Body(7,"EarthAtm")
         {
             radius = 6371.0; // km
@@ -562,21 +626,134 @@ EarthAtm::EarthAtm(std::string filepath):Body(7,"EarthAtm")
             x_ye_max = earth_ye[arraysize-1];
 
             inter_density = gsl_spline_alloc(gsl_interp_cspline,arraysize);
-            inter_density_accel = gsl_interp_accel_alloc ();
             gsl_spline_init (inter_density,earth_radius,earth_density,arraysize);
 
             inter_ye = gsl_spline_alloc(gsl_interp_cspline,arraysize);
-            inter_ye_accel = gsl_interp_accel_alloc ();
             gsl_spline_init (inter_ye,earth_radius,earth_ye,arraysize);
+
+            layer_radii = FindLayerRadii(earth_model);
         }
 
 EarthAtm::~EarthAtm(void)
         {
             gsl_spline_free(inter_density);
-            gsl_interp_accel_free(inter_density_accel);
             gsl_spline_free(inter_ye);
-            gsl_interp_accel_free(inter_ye_accel);
         }
 
 
+/*
+----------------------------------------------------------------------
+         TrackProfile CLASS DEFINITIONS
+----------------------------------------------------------------------
+*/
+
+TrackProfile::TrackProfile(const Body& body, Track& track, double tolerance, unsigned int max_nodes):error(0.)
+        {
+            const double x_saved = track.GetX();
+            const double xini = track.GetInitialX();
+            const double xend = track.GetFinalX();
+
+            // pieces of the track, split at the discontinuities if the budget allows it
+            std::vector<double> edges {xini};
+            if ( xend > xini ){
+              std::vector<double> layer_boundaries = body.GetLayerBoundaries(track);
+              if ( 2*(layer_boundaries.size() + 1) <= max_nodes )
+                edges.insert(edges.end(),layer_boundaries.begin(),layer_boundaries.end());
+            }
+            edges.push_back(xend);
+            const unsigned int nsegments = edges.size() - 1;
+
+            if ( not (xend > xini) or max_nodes < 2 ){
+              // a single node, evaluated at the start of the track
+              nodes.resize(2);
+              track.SetX(xini);
+              nodes[0] = body.density(track);
+              nodes[1] = body.ye(track);
+              segments.push_back(Segment{xini,0.,0,0});
+              track.SetX(x_saved);
+              return;
+            }
+
+            // samples a piece, keeping its ends just inside it so that a jump at
+            // either end is not picked up from the neighbouring piece
+            auto sample = [&](unsigned int s, unsigned int i, unsigned int ncells, double* node){
+              const double a = edges[s], b = edges[s+1];
+              const double margin = 1.0e-9*(b - a);
+              track.SetX(std::min(std::max(a + (b - a)*i/ncells,a + margin),b - margin));
+              node[0] = body.density(track);
+              node[1] = body.ye(track);
+            };
+
+            unsigned int initial_cells = 16;
+            while ( initial_cells > 1 and nsegments*(initial_cells + 1) > max_nodes )
+              initial_cells /= 2;
+
+            // node values of each piece, and values at the cell midpoints, sampled on a grid twice as fine
+            std::vector<unsigned int> ncells(nsegments,initial_cells);
+            std::vector<std::vector<double>> grid(nsegments), midpoints(nsegments);
+            unsigned int total_nodes = 0;
+            for (unsigned int s = 0; s < nsegments; s++){
+              grid[s].resize(2*(ncells[s] + 1));
+              for (unsigned int i = 0; i <= ncells[s]; i++)
+                sample(s,i,ncells[s],&grid[s][2*i]);
+              total_nodes += ncells[s] + 1;
+            }
+            // the differences are relative to the largest values along the track
+            double scale[2] = {0.,0.};
+            for (unsigned int s = 0; s < nsegments; s++){
+              for (unsigned int i = 0; i <= ncells[s]; i++){
+                for (unsigned int k = 0; k < 2; k++)
+                  scale[k] = std::max(scale[k],std::abs(grid[s][2*i+k]));
+              }
+            }
+
+            // compares the interpolation of a piece to the body at the cell midpoints
+            std::vector<double> segment_error(nsegments,0.);
+            auto estimate = [&](unsigned int s){
+              midpoints[s].resize(2*ncells[s]);
+              segment_error[s] = 0.;
+              for (unsigned int i = 0; i < ncells[s]; i++){
+                sample(s,2*i + 1,2*ncells[s],&midpoints[s][2*i]);
+                for (unsigned int k = 0; k < 2; k++){
+                  if ( scale[k] > 0. ){
+                    double difference = std::abs(midpoints[s][2*i+k] - 0.5*(grid[s][2*i+k] + grid[s][2*i+2+k]));
+                    segment_error[s] = std::max(segment_error[s],difference/scale[k]);
+                  }
+                }
+              }
+            };
+            for (unsigned int s = 0; s < nsegments; s++)
+              estimate(s);
+
+            while ( true ){
+              unsigned int worst = std::max_element(segment_error.begin(),segment_error.end()) - segment_error.begin();
+              if ( segment_error[worst] <= tolerance or total_nodes + ncells[worst] > max_nodes )
+                break;
+
+              // the midpoints become the odd nodes of the finer grid
+              std::vector<double> refined(2*(2*ncells[worst] + 1));
+              for (unsigned int i = 0; i < ncells[worst]; i++){
+                for (unsigned int k = 0; k < 2; k++){
+                  refined[4*i+k] = grid[worst][2*i+k];
+                  refined[4*i+2+k] = midpoints[worst][2*i+k];
+                }
+              }
+              refined[4*ncells[worst]] = grid[worst][2*ncells[worst]];
+              refined[4*ncells[worst]+1] = grid[worst][2*ncells[worst]+1];
+              grid[worst].swap(refined);
+              total_nodes += ncells[worst];
+              ncells[worst] *= 2;
+              estimate(worst);
+            }
+            error = *std::max_element(segment_error.begin(),segment_error.end());
+
+            for (unsigned int s = 0; s < nsegments; s++){
+              if ( s > 0 )
+                boundaries.push_back(edges[s]);
+              segments.push_back(Segment{edges[s],ncells[s]/(edges[s+1] - edges[s]),ncells[s],nodes.size()/2});
+              nodes.insert(nodes.end(),grid[s].begin(),grid[s].end());
+            }
+            track.SetX(x_saved);
+        }
+
 }
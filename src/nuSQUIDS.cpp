@@ -24,6 +24,16 @@
 
 
 #include "nuSQUIDS.h"
+#include <gsl/gsl_cblas.h>
+#include <gsl/gsl_eigen.h>
+#include <typeinfo>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace nusquids{
 
@@ -185,23 +195,29 @@ void nuSQUIDS::init(double Emin,double Emax,unsigned int Esize, bool initialize_
   positivization_scale = 300.0*params.km;
 
   if(iinteraction and initialize_intereractions){
-    //===============================
-    // init XS and TDecay objects  //
-    //===============================
-
-    // initialize cross section object
-    if ( ncs == nullptr) {
-      ncs = std::make_shared<NeutrinoDISCrossSectionsFromTables>();
-    } // else we assume the user has already inintialized the object if not throw error.
-
-    // initialize tau decay spectra object
-    tdc.Init(E_range[0],E_range[ne-1],ne-1);
-    // initialize cross section and interaction arrays
-    InitializeInteractionVectors();
-    //===============================
-    // Fill in arrays              //
-    //===============================
-    InitializeInteractions();
+    // the tables may have been computed already by another object
+    const std::string cache_file = InteractionCacheFile();
+    if(cache_file.empty() or not ReadInteractionCache(cache_file)){
+      //===============================
+      // init XS and TDecay objects  //
+      //===============================
+
+      // initialize cross section object
+      if ( ncs == nullptr) {
+        ncs = std::make_shared<NeutrinoDISCrossSectionsFromTables>();
+      } // else we assume the user has already inintialized the object if not throw error.
+
+      // initialize tau decay spectra object
+      tdc.Init(E_range[0],E_range[ne-1],ne-1);
+      // initialize cross section and interaction arrays
+      InitializeInteractionVectors();
+      //===============================
+      // Fill in arrays              //
+      //===============================
+      InitializeInteractions();
+      if(not cache_file.empty())
+        WriteInteractionCache(cache_file);
+    }
   }
 
   if(iinteraction){
@@ -221,28 +237,66 @@ void nuSQUIDS::init(double Emin,double Emax,unsigned int Esize, bool initialize_
 void nuSQUIDS::InitializeInteractionVectors(){
 
     // initialize cross section and interaction arrays
-    dNdE_NC.resize(std::vector<size_t>{nrhos,numneu,ne,ne});
-    dNdE_CC.resize(std::vector<size_t>{nrhos,numneu,ne,ne});
+    // a new structure is always allocated, since the current one may be shared
+    int_struct = std::make_shared<InteractionStructure>();
+    int_struct->dNdE_NC.resize(std::vector<size_t>{nrhos,InteractionStructure::TriangularSize(ne)});
+    int_struct->dNdE_CC.resize(std::vector<size_t>{nrhos,numneu,InteractionStructure::TriangularSize(ne)});
+    // initialize cross section arrays
+    int_struct->sigma_CC.resize(std::vector<size_t>{nrhos,numneu,ne});
+    int_struct->sigma_NC.resize(std::vector<size_t>{nrhos,numneu,ne});
+    // initialize the tau decay and interaction array
+    int_struct->invlen_tau.resize(std::vector<size_t>{ne});
+    int_struct->dNdE_tau_all.resize(std::vector<size_t>{ne,ne});
+    int_struct->dNdE_tau_lep.resize(std::vector<size_t>{ne,ne});
     // inverse interaction lenghts
+    InitializeInteractionLengthVectors();
+}
+
+void nuSQUIDS::InitializeInteractionLengthVectors(){
     invlen_NC.resize(std::vector<size_t>{nrhos,numneu,ne});
     invlen_CC.resize(std::vector<size_t>{nrhos,numneu,ne});
     invlen_INT.resize(std::vector<size_t>{nrhos,numneu,ne});
-    // initialize cross section arrays
-    sigma_CC.resize(std::vector<size_t>{nrhos,numneu,ne});
-    sigma_NC.resize(std::vector<size_t>{nrhos,numneu,ne});
-    // initialize the tau decay and interaction array
-    invlen_tau.resize(std::vector<size_t>{ne});
-    dNdE_tau_all.resize(std::vector<size_t>{ne,ne});
-    dNdE_tau_lep.resize(std::vector<size_t>{ne,ne});
+}
+
+std::shared_ptr<nuSQUIDS::InteractionStructure> nuSQUIDS::GetInteractionStructure() const{
+  if(not iinteraction)
+    return nullptr;
+  return int_struct;
+}
+
+void nuSQUIDS::SetInteractionStructure(std::shared_ptr<InteractionStructure> int_struct_in){
+  if(not iinteraction)
+    throw std::runtime_error("nuSQUIDS::Error::Interactions are not enabled.");
+  if(int_struct_in == nullptr)
+    throw std::runtime_error("nuSQUIDS::Error::InteractionStructure is a NULL pointer.");
+  if(int_struct_in->dNdE_CC.extent(0) != nrhos or int_struct_in->dNdE_CC.extent(1) != numneu or
+     int_struct_in->dNdE_CC.extent(2) != InteractionStructure::TriangularSize(ne) or int_struct_in->invlen_tau.extent(0) != ne)
+    throw std::runtime_error("nuSQUIDS::Error::InteractionStructure dimensions do not match.");
+  int_struct = int_struct_in;
+  InitializeInteractionLengthVectors();
 }
 
 void nuSQUIDS::PreDerive(double x){
+  if(step_probe.active and x > step_probe.x_max){
+    if(x >= step_probe.from)
+      step_probe.advance = std::max(step_probe.advance,x - step_probe.x_max);
+    step_probe.x_max = x;
+  }
   track->SetX(x-time_offset);
+  UpdateMediumState();
   if( basis != mass){
     EvolveProjectors(x);
   }
   if(iinteraction){
     UpdateInteractions();
+    UpdateNCCascade();
+    if(nscalars > 0)
+      UpdateTauProduction();
+  }
+  // derived classes may override the per-node terms
+  fused_active = fused_derivatives and typeid(*this) == FusedTermsType();
+  if(fused_active){
+    EvaluateFusedTerms();
   }
   if(progressbar and progressbar_count%progressbar_loop ==0 ){
     ProgressBar();
@@ -252,93 +306,337 @@ void nuSQUIDS::PreDerive(double x){
 }
 
 void nuSQUIDS::EvolveProjectors(double x){
+  if(x == evol_proj_time)
+    return;
+  const double t = x - Get_t_initial();
+  const unsigned int npairs = phase_pairs.extent(0);
+  // antineutrino projectors equal to the neutrino ones are copied
+  const unsigned int nrhos_evolved = cp_symmetric_projectors ? 1 : nrhos;
+  double* cosine = &soa_scratch[0][0];
+  double* sine = &soa_scratch[1][0];
+  // the components that are not in a pair do not evolve and keep their initial value
+  for(unsigned int p = 0; p < npairs; p++){
+    const unsigned int a = phase_pairs[p][0];
+    const unsigned int b = phase_pairs[p][1];
+    const double* frequency = &phase_frequencies[p][0];
+    for(unsigned int ei = 0; ei < ne; ei++){
+      cosine[ei] = cos(frequency[ei]*t);
+      sine[ei] = sin(frequency[ei]*t);
+    }
+    for(unsigned int rho = 0; rho < nrhos_evolved; rho++){
+      for(unsigned int flv = 0; flv < numneu; flv++){
+        const double pa = b1_proj[rho][flv][a];
+        const double pb = b1_proj[rho][flv][b];
+        double* proj_a = EvolvedProjectorSoA(rho,flv) + a*ne;
+        double* proj_b = EvolvedProjectorSoA(rho,flv) + b*ne;
+        for(unsigned int ei = 0; ei < ne; ei++){
+          proj_a[ei] = cosine[ei]*pa - sine[ei]*pb;
+          proj_b[ei] = sine[ei]*pa + cosine[ei]*pb;
+        }
+      }
+    }
+  }
+  const size_t block = size_t(numneu)*nsun*nsun*ne;
+  for(unsigned int rho = nrhos_evolved; rho < nrhos; rho++)
+    std::copy(EvolvedProjectorSoA(0,0),EvolvedProjectorSoA(0,0) + block,EvolvedProjectorSoA(rho,0));
+  evol_proj_time = x;
+}
+
+void nuSQUIDS::iniPhases(){
+  const unsigned int ncomp = nsun*nsun;
+  // a diagonal hamiltonian rotates the two components of each off-diagonal entry
+  // into each other, over a time short enough for the angle to stay below pi/2
+  // the rotation of a unit vector gives both the pair and the frequency
+  std::vector<double> times(ne,0.0);
+  for(unsigned int ei = 0; ei < ne; ei++){
+    double norm = 0;
+    for(unsigned int c = 0; c < ncomp; c++)
+      norm += std::abs(H0_array[ei][c]);
+    if(norm > 0)
+      times[ei] = 0.25/norm;
+  }
+
+  squids::SU_vector unit(nsun);
+  std::vector<unsigned int> pairs;
+  for(unsigned int a = 0; a < ncomp; a++){
+    unit[a] = 1.0;
+    unsigned int partner = ncomp;
+    for(unsigned int ei = 0; ei < ne and partner == ncomp; ei++){
+      if(times[ei] == 0)
+        continue;
+      squids::SU_vector evolved = unit.Evolve(H0_array[ei],times[ei]);
+      double largest = 1.0e-12;
+      for(unsigned int b = 0; b < ncomp; b++){
+        if(b != a and std::abs(evolved[b]) > largest){
+          largest = std::abs(evolved[b]);
+          partner = b;
+        }
+      }
+    }
+    unit[a] = 0.0;
+    if(partner < ncomp and a < partner){
+      pairs.push_back(a);
+      pairs.push_back(partner);
+    }
+  }
+
+  const unsigned int npairs = pairs.size()/2;
+  phase_pairs.resize(std::vector<size_t>{npairs,2});
+  std::copy(pairs.begin(),pairs.end(),phase_pairs.begin());
+  phase_frequencies.resize(std::vector<size_t>{npairs,ne});
+  for(unsigned int p = 0; p < npairs; p++){
+    const unsigned int a = phase_pairs[p][0];
+    const unsigned int b = phase_pairs[p][1];
+    unit[a] = 1.0;
+    for(unsigned int ei = 0; ei < ne; ei++){
+      phase_frequencies[p][ei] = 0.0;
+      if(times[ei] == 0)
+        continue;
+      squids::SU_vector evolved = unit.Evolve(H0_array[ei],times[ei]);
+      phase_frequencies[p][ei] = atan2(evolved[b],evolved[a])/times[ei];
+    }
+    unit[a] = 0.0;
+  }
+}
+
+void nuSQUIDS::ProjectorsChanged(){
+  const unsigned int ncomp = nsun*nsun;
+  const size_t evolved_size = size_t(nrhos)*numneu*ncomp*ne;
+  const size_t initial_size = size_t(nrhos)*numneu*ncomp;
+  if(proj_soa.extent(0) != evolved_size + initial_size)
+    proj_soa.resize(std::vector<size_t>{evolved_size + initial_size});
+  if(soa_scratch.extent(0) != ncomp + 1 or soa_scratch.extent(1) != ne)
+    soa_scratch.resize(std::vector<size_t>{ncomp + 1,ne});
+
+  double* initial = proj_soa.get_data() + evolved_size;
   for(unsigned int rho = 0; rho < nrhos; rho++){
     for(unsigned int flv = 0; flv < numneu; flv++){
-      for(unsigned int ei = 0; ei < ne; ei++){
-        // will only evolve the flavor projectors
-        //evol_b0_proj[rho][flv][ei] = b0_proj[flv].Evolve(h0,(x-t_ini));
-        evol_b1_proj[rho][flv][ei] = b1_proj[rho][flv].Evolve(H0_array[ei],(x-Get_t_initial()));
+      double* proj = EvolvedProjectorSoA(rho,flv);
+      for(unsigned int c = 0; c < ncomp; c++){
+        initial[(rho*numneu + flv)*ncomp + c] = b1_proj[rho][flv][c];
+        std::fill(proj + c*ne,proj + (c + 1)*ne,b1_proj[rho][flv][c]);
       }
     }
   }
+
+  // the basis is orthogonal, so the scalar product is a weighted sum of the components
+  soa_metric.resize(std::vector<size_t>{ncomp});
+  squids::SU_vector unit(nsun);
+  for(unsigned int c = 0; c < ncomp; c++){
+    unit[c] = 1.0;
+    soa_metric[c] = unit*unit;
+    unit[c] = 0.0;
+  }
+
+  cp_symmetric_projectors = (nrhos == 2);
+  for(unsigned int flv = 0; cp_symmetric_projectors and flv < numneu; flv++){
+    for(unsigned int i = 0; cp_symmetric_projectors and i < b1_proj[0][flv].Size(); i++)
+      cp_symmetric_projectors = (b1_proj[0][flv][i] == b1_proj[1][flv][i]);
+  }
+
+  evol_proj_time = std::numeric_limits<double>::quiet_NaN();
+}
+
+squids::SU_vector nuSQUIDS::EvolvedFlavorProj(unsigned int rho, unsigned int flv, unsigned int ie) const{
+  squids::SU_vector proj(nsun);
+  const double* components = EvolvedProjectorSoA(rho,flv) + ie;
+  for(unsigned int c = 0; c < nsun*nsun; c++)
+    proj[c] = components[c*ne];
+  return proj;
+}
+
+void nuSQUIDS::GatherStateSoA(unsigned int rho, double* rho_soa) const{
+  const unsigned int ncomp = nsun*nsun;
+  for(unsigned int ie = 0; ie < ne; ie++){
+    const squids::SU_vector& node = state[ie].rho[rho];
+    for(unsigned int c = 0; c < ncomp; c++)
+      rho_soa[c*ne + ie] = node[c];
+  }
+}
+
+void nuSQUIDS::ScatterStateSoA(unsigned int rho, const double* rho_soa){
+  const unsigned int ncomp = nsun*nsun;
+  for(unsigned int ie = 0; ie < ne; ie++){
+    squids::SU_vector& node = state[ie].rho[rho];
+    for(unsigned int c = 0; c < ncomp; c++)
+      node[c] = rho_soa[c*ne + ie];
+  }
+}
+
+void nuSQUIDS::FlavorContentSoA(const double* proj, const double* rho_soa, double* content) const{
+  std::fill(content,content + ne,0.0);
+  for(unsigned int c = 0; c < nsun*nsun; c++){
+    const double w = soa_metric[c];
+    const double* p = proj + c*ne;
+    const double* r = rho_soa + c*ne;
+    for(unsigned int ie = 0; ie < ne; ie++)
+      content[ie] += w*p[ie]*r[ie];
+  }
 }
 
 squids::SU_vector nuSQUIDS::H0(double Enu, unsigned int irho) const{
   return DM2*(0.5/Enu);
 }
 
-squids::SU_vector nuSQUIDS::HI(unsigned int ie, unsigned int irho) const{
-    double ye = body->ye(*track);
-    double density = body->density(*track);
+void nuSQUIDS::UpdateMediumState(){
+    if(use_track_profile){
+      if(track_profile == nullptr)
+        track_profile = std::make_shared<TrackProfile>(*body,*track,track_profile_tolerance,track_profile_max_nodes);
+      track_profile->Evaluate(track->GetX(),medium.density,medium.ye);
+    }
+    else {
+      medium.density = body->density(*track);
+      medium.ye = body->ye(*track);
+    }
+    medium.nucleon_number = NucleonNumber(medium.density);
 
-    double CC = params.sqrt2*params.GF*params.Na*pow(params.cm,-3)*density*ye;
-    double NC;
+    double potential = params.sqrt2*params.GF*params.Na*pow(params.cm,-3)*medium.density;
+    medium.CC = potential*medium.ye;
 
-    if (ye < 1.0e-10){
-      NC = params.sqrt2*params.GF*params.Na*pow(params.cm,-3)*density;
+    if (medium.ye < 1.0e-10){
+      medium.NC = potential;
     }
     else {
-      NC = CC*(-0.5*(1.0-ye)/ye);
+      medium.NC = medium.CC*(-0.5*(1.0-medium.ye)/medium.ye);
     }
+}
+
+void nuSQUIDS::ResizeFusedTerms(){
+  const unsigned int ncomp = nsun*nsun;
+  if(fused_terms.extent(0) != 3 or fused_terms.extent(1) != nrhos or
+     fused_terms.extent(2) != ne or fused_terms.extent(3) != ncomp){
+    fused_terms.resize(std::vector<size_t>{3,nrhos,ne,ncomp});
+    std::fill(fused_terms.begin(),fused_terms.end(),0.0);
+  }
+  if(fused_scratch.Dim() != nsun)
+    fused_scratch = squids::SU_vector(nsun);
+}
 
-    // construct potential in flavor basis
-    //std::cout << CC << " " << NC << std::endl;
-    //std::cout << irho << " " << ie << std::endl;
-    //std::cout << evol_b1_proj[irho][0][ie] << std::endl;
-    squids::SU_vector potential = (CC+NC)*evol_b1_proj[irho][0][ie];
-    potential += (NC)*(evol_b1_proj[irho][1][ie]);
-    potential += (NC)*(evol_b1_proj[irho][2][ie]);
+void nuSQUIDS::EvaluateFusedTerms(){
+  const unsigned int ncomp = nsun*nsun;
+  ResizeFusedTerms();
+  const size_t term_size = size_t(nrhos)*ne*ncomp;
+  for(unsigned int rho = 0; rho < nrhos; rho++){
+    for(unsigned int ie = 0; ie < ne; ie++){
+      double* hi = fused_terms.get_data() + (rho*ne + ie)*ncomp;
+      if(iinteraction)
+        NodeTerms(ie,rho,hi,hi + term_size,hi + 2*term_size,&fused_scratch[0]);
+      else
+        NodeTerms(ie,rho,hi,nullptr,nullptr,nullptr);
+    }
+  }
+}
 
-    if (basis == mass){
-      potential += H0_array[ie];
+void nuSQUIDS::NodeTerms(unsigned int ie, unsigned int rho, double* hi, double* gamma, double* nc, double* scratch) const{
+  const unsigned int ncomp = nsun*nsun;
+  const unsigned int nactive = std::min(numneu,3u);
+  if(hi != nullptr){
+    const double CC = medium.CC;
+    const double NC = medium.NC;
+    const double sign = ((NT == antineutrino) or (NT == both and rho == 1)) ? -1.0 : 1.0;
+    // potential in the flavor basis, component c of a projector is at c*ne
+    std::fill(hi,hi + ncomp,0.0);
+    for(unsigned int flv = 0; flv < nactive; flv++){
+      const double potential = (flv == 0) ? CC+NC : NC;
+      const double* proj = EvolvedProjectorSoA(rho,flv) + ie;
+      for(unsigned int c = 0; c < ncomp; c++)
+        hi[c] += potential*proj[c*ne];
+    }
+    if(basis == mass){
+      const squids::SU_vector& h0 = H0_array[ie];
+      for(unsigned int c = 0; c < ncomp; c++)
+        hi[c] += h0[c];
     }
+    for(unsigned int c = 0; c < ncomp; c++)
+      hi[c] *= sign;
+  }
+  if(gamma != nullptr){
+    std::fill(gamma,gamma + ncomp,0.0);
+    for(unsigned int flv = 0; flv < nactive; flv++){
+      const double rate = 0.5*invlen_INT[rho][flv][ie];
+      const double* proj = EvolvedProjectorSoA(rho,flv) + ie;
+      for(unsigned int c = 0; c < ncomp; c++)
+        gamma[c] += proj[c*ne]*rate;
+    }
+  }
+  if(nc != nullptr){
+    // the cross section is the same for all flavors, and since the anticommutator
+    // is bilinear the sum over the initial energies is done in UpdateNCCascade
+    std::fill(scratch,scratch + ncomp,0.0);
+    for(unsigned int flv = 0; flv < nactive; flv++){
+      const double* proj = EvolvedProjectorSoA(rho,flv) + ie;
+      for(unsigned int c = 0; c < ncomp; c++)
+        scratch[c] += proj[c*ne];
+    }
+    squids::SU_vector projectors(nsun,scratch);
+    squids::SU_vector cascade(nsun,const_cast<double*>(nc_cascade.get_data()) + (rho*ne + ie)*ncomp);
+    squids::SU_vector term(nsun,nc);
+    term = ACommutator(projectors,cascade);
+  }
+}
+
+squids::SU_vector nuSQUIDS::FusedTerm(unsigned int term, unsigned int irho, unsigned int ie) const{
+  const unsigned int ncomp = nsun*nsun;
+  return squids::SU_vector(nsun,const_cast<double*>(fused_terms.get_data()) + ((term*nrhos + irho)*ne + ie)*ncomp);
+}
 
-    if ((irho == 0 and NT==both) or NT==neutrino){
-        // neutrino potential
-        return potential;
-    } else if ((irho == 1 and NT==both) or NT==antineutrino){
-        // antineutrino potential
-        return (-1.0)*std::move(potential);
-    } else{
+squids::SU_vector nuSQUIDS::HI(unsigned int ie, unsigned int irho) const{
+    if (fused_active){
+      return FusedTerm(0,irho,ie);
+    }
+    if (NT == both and irho > 1){
         throw std::runtime_error("nuSQUIDS::HI : unknown particle or antiparticle");
     }
+    squids::SU_vector potential(nsun);
+    NodeTerms(ie,irho,&potential[0],nullptr,nullptr,nullptr);
+    return potential;
 }
 
 squids::SU_vector nuSQUIDS::GammaRho(unsigned int ei,unsigned int index_rho) const{
+    if (fused_active and iinteraction){
+      return FusedTerm(1,index_rho,ei);
+    }
     squids::SU_vector V(nsun);
     if (not iinteraction){
       return V;
     }
-
-    V = evol_b1_proj[index_rho][0][ei]*(0.5*invlen_INT[index_rho][0][ei]);
-    V += evol_b1_proj[index_rho][1][ei]*(0.5*invlen_INT[index_rho][1][ei]);
-    V += evol_b1_proj[index_rho][2][ei]*(0.5*invlen_INT[index_rho][2][ei]);
-
+    NodeTerms(ei,index_rho,nullptr,&V[0],nullptr,nullptr);
     return V;
 }
 
 squids::SU_vector nuSQUIDS::InteractionsRho(unsigned int e1,unsigned int index_rho) const{
-  squids::SU_vector nc_term(nsun);
-
   if (not iinteraction){
-    return nc_term;
+    return squids::SU_vector(nsun);
+  }
+  if (fused_active){
+    return FusedTerm(2,index_rho,e1);
   }
 
   // this implements the NC interactinos
   // the tau regeneration terms are implemented at the end
-  squids::SU_vector temp1, temp2;
-  for(unsigned int e2 = e1 + 1; e2 < ne; e2++){
-    // here we assume the cross section to be the same for all flavors
-    //std::cout << dNdE_NC[index_rho][0][e2][e1] << " " << invlen_NC[index_rho][0][e2] << std::endl;
-    temp1 = evol_b1_proj[index_rho][0][e1] + evol_b1_proj[index_rho][1][e1];
-    temp1 += evol_b1_proj[index_rho][2][e1];
-    temp2 = ACommutator(temp1,state[e2].rho[index_rho]);
-    nc_term += temp2*(0.5*dNdE_NC[index_rho][0][e2][e1]*invlen_NC[index_rho][0][e2]);
-  }
-
+  squids::SU_vector nc_term(nsun);
+  squids::SU_vector projectors(nsun);
+  NodeTerms(e1,index_rho,nullptr,nullptr,&nc_term[0],&projectors[0]);
   return nc_term;
 }
 
+void nuSQUIDS::UpdateNCCascade(){
+  const unsigned int ncomp = nsun*nsun;
+  if(nc_cascade.extent(0) != nrhos or nc_cascade.extent(1) != ne or nc_cascade.extent(2) != ncomp)
+    nc_cascade.resize(std::vector<size_t>{nrhos,ne,ncomp});
+
+  // invlen_NC is sigma_NC times the nucleon number, which scales the kernel
+  for(unsigned int rho = 0; rho < nrhos; rho++){
+    double* cascade = nc_cascade.get_data() + rho*ne*ncomp;
+    for(unsigned int e2 = 0; e2 < ne; e2++){
+      for(unsigned int i = 0; i < ncomp; i++)
+        cascade[e2*ncomp + i] = state[e2].rho[rho][i];
+    }
+    cblas_dtrmm(CblasRowMajor,CblasLeft,CblasUpper,CblasNoTrans,CblasNonUnit,
+                ne,ncomp,medium.nucleon_number,int_struct->nc_kernel.get_data() + rho*ne*ne,ne,cascade,ncomp);
+  }
+}
+
 double nuSQUIDS::GammaScalar(unsigned int ei, unsigned int iscalar) const{
   // we will just keep all the taus and convert them at the end
   return 0.0;
@@ -348,16 +646,33 @@ double nuSQUIDS::InteractionsScalar(unsigned int ei, unsigned int iscalar) const
   if (not iinteraction){
     return 0.0;
   }
+  return tau_production[iscalar][ei];
+}
 
-  double nutautoleptau = 0.0;
-  for(unsigned int e2 = ei + 1; e2 < ne; e2++)
-    nutautoleptau += (evol_b1_proj[iscalar][2][e2]*state[e2].rho[iscalar])*
-                     (invlen_CC[iscalar][2][e2])*(dNdE_CC[iscalar][2][e2][ei])*delE[e2];
-  return nutautoleptau;
+void nuSQUIDS::UpdateTauProduction(){
+  if(tau_production.extent(0) != nscalars or tau_production.extent(1) != ne)
+    tau_production.resize(std::vector<size_t>{nscalars,ne});
+
+  for(unsigned int iscalar = 0; iscalar < nscalars; iscalar++){
+    double* production = tau_production.get_data() + iscalar*ne;
+    double* rho_soa = &soa_scratch[1][0];
+    GatherStateSoA(iscalar,rho_soa);
+    FlavorContentSoA(EvolvedProjectorSoA(iscalar,2),rho_soa,production);
+    for(unsigned int e2 = 0; e2 < ne; e2++)
+      production[e2] *= invlen_CC[iscalar][2][e2];
+    // production[ei] = sum_{e2 > ei} kernel[ei][e2]*production[e2]
+    cblas_dtrmv(CblasRowMajor,CblasUpper,CblasNoTrans,CblasNonUnit,ne,
+                int_struct->tau_cc_kernel.get_data() + iscalar*ne*ne,ne,production,1);
+  }
 }
 
 double nuSQUIDS::GetNucleonNumber() const{
-    double density = body->density(*track);
+    if(use_track_profile and track_profile != nullptr)
+      return NucleonNumber(track_profile->density(track->GetX()));
+    return NucleonNumber(body->density(*track));
+}
+
+double nuSQUIDS::NucleonNumber(double density) const{
     double num_nuc = (params.gr*pow(params.cm,-3))*density*2.0/(params.proton_mass+params.neutron_mass);
 
     #ifdef UpdateInteractions_DEBUG
@@ -373,7 +688,7 @@ double nuSQUIDS::GetNucleonNumber() const{
 }
 
 void nuSQUIDS::UpdateInteractions(){
-    double num_nuc = GetNucleonNumber();
+    double num_nuc = medium.nucleon_number;
     for(unsigned int rho = 0; rho < nrhos; rho++){
       for(unsigned int flv = 0; flv < numneu; flv++){
               #ifdef UpdateInteractions_DEBUG
@@ -383,11 +698,11 @@ void nuSQUIDS::UpdateInteractions(){
               #ifdef UpdateInteractions_DEBUG
                   cout << "== CC NC Terms x = " << track->x/params.km << " [km] ";
                   cout << "E = " << x[e1] << " [eV] ==" << endl;
-                  cout << "CC : " << sigma_CC[rho][flv][e1]*num_nuc << " NC : " << sigma_NC[rho][flv][e1]*num_nuc << endl;
+                  cout << "CC : " << int_struct->sigma_CC[rho][flv][e1]*num_nuc << " NC : " << int_struct->sigma_NC[rho][flv][e1]*num_nuc << endl;
                   cout << "==" << endl;
               #endif
-              invlen_NC[rho][flv][e1] = sigma_NC[rho][flv][e1]*num_nuc;
-              invlen_CC[rho][flv][e1] = sigma_CC[rho][flv][e1]*num_nuc;
+              invlen_NC[rho][flv][e1] = int_struct->sigma_NC[rho][flv][e1]*num_nuc;
+              invlen_CC[rho][flv][e1] = int_struct->sigma_CC[rho][flv][e1]*num_nuc;
               invlen_INT[rho][flv][e1] = invlen_NC[rho][flv][e1] + invlen_CC[rho][flv][e1];
           }
       }
@@ -396,15 +711,18 @@ void nuSQUIDS::UpdateInteractions(){
 
 void nuSQUIDS::InitializeInteractions(){
 
+    InteractionStructure& tables = *int_struct;
+
     //units
     double cm2GeV = pow(params.cm,2)*pow(params.GeV,-1);
     double cm2 = pow(params.cm,2);
     double GeVm1 = pow(params.GeV,-1);
 
     // load cross sections
-    // initializing cross section arrays temporary array
-    marray<double,4> dsignudE_CC{nrhos,numneu,ne,ne};
-    marray<double,4> dsignudE_NC{nrhos,numneu,ne,ne};
+    // initializing cross section arrays temporary array, packed as the tables
+    const size_t npairs = InteractionStructure::TriangularSize(ne);
+    marray<double,3> dsignudE_CC{nrhos,numneu,npairs};
+    marray<double,2> dsignudE_NC{nrhos,npairs};
 
     // filling cross section arrays
     std::map<unsigned int,NeutrinoCrossSections::NeutrinoType> neutype_xs_dict;
@@ -420,40 +738,73 @@ void nuSQUIDS::InitializeInteractions(){
     for(unsigned int neutype = 0; neutype < nrhos; neutype++){
       for(unsigned int flv = 0; flv < numneu; flv++){
           for(unsigned int e1 = 0; e1 < ne; e1++){
-              // differential cross sections
-              for(unsigned int e2 = 0; e2 < e1; e2++){
-                  dsignudE_NC[neutype][flv][e1][e2] = ncs->DifferentialCrossSection(E_range[e1],E_range[e2],static_cast<NeutrinoCrossSections::NeutrinoFlavor>(flv),neutype_xs_dict[neutype],NeutrinoCrossSections::NC)*cm2GeV;
-                  dsignudE_CC[neutype][flv][e1][e2] = ncs->DifferentialCrossSection(E_range[e1],E_range[e2],static_cast<NeutrinoCrossSections::NeutrinoFlavor>(flv),neutype_xs_dict[neutype],NeutrinoCrossSections::CC)*cm2GeV;
-              }
               // total cross sections
-              sigma_CC[neutype][flv][e1] = ncs->TotalCrossSection(E_range[e1],static_cast<NeutrinoCrossSections::NeutrinoFlavor>(flv),neutype_xs_dict[neutype],NeutrinoCrossSections::CC)*cm2;
-              sigma_NC[neutype][flv][e1] = ncs->TotalCrossSection(E_range[e1],static_cast<NeutrinoCrossSections::NeutrinoFlavor>(flv),neutype_xs_dict[neutype],NeutrinoCrossSections::NC)*cm2;
+              tables.sigma_CC[neutype][flv][e1] = ncs->TotalCrossSection(E_range[e1],static_cast<NeutrinoCrossSections::NeutrinoFlavor>(flv),neutype_xs_dict[neutype],NeutrinoCrossSections::CC)*cm2;
+              tables.sigma_NC[neutype][flv][e1] = ncs->TotalCrossSection(E_range[e1],static_cast<NeutrinoCrossSections::NeutrinoFlavor>(flv),neutype_xs_dict[neutype],NeutrinoCrossSections::NC)*cm2;
           }
       }
     }
 
+    // differential cross sections, one matrix per (type, flavor, current)
+    // the neutral current is the same for all flavors, so only the electron one is computed
+    struct DifferentialTask{
+      unsigned int neutype;
+      unsigned int flv;
+      NeutrinoCrossSections::Current current;
+    };
+    std::vector<DifferentialTask> dxs_tasks;
+    for(unsigned int neutype = 0; neutype < nrhos; neutype++){
+      dxs_tasks.push_back({neutype,0,NeutrinoCrossSections::NC});
+      for(unsigned int flv = 0; flv < numneu; flv++)
+        dxs_tasks.push_back({neutype,flv,NeutrinoCrossSections::CC});
+    }
+    unsigned int nworkers = 1;
+    if(ncs->ThreadSafeDifferentialCrossSections()){
+      nworkers = Get_InteractionThreads();
+      if(nworkers == 0)
+        nworkers = std::max(1u,std::thread::hardware_concurrency());
+      nworkers = std::min<unsigned int>(nworkers,dxs_tasks.size());
+    }
+    std::vector<marray<double,2>> dsde(nworkers);
+    WorkStealingScheduler scheduler(nworkers);
+    scheduler.Run(std::vector<double>(dxs_tasks.size(),1.0),[&](unsigned int itask, unsigned int iworker){
+      const DifferentialTask& task = dxs_tasks[itask];
+      marray<double,2>& matrix = dsde[iworker];
+      ncs->DifferentialCrossSections(E_range,static_cast<NeutrinoCrossSections::NeutrinoFlavor>(task.flv),
+                                     neutype_xs_dict.at(task.neutype),task.current,matrix);
+      double* packed = (task.current == NeutrinoCrossSections::NC) ?
+        dsignudE_NC.get_data() + task.neutype*npairs : dsignudE_CC.get_data() + (task.neutype*numneu + task.flv)*npairs;
+      for(unsigned int e1 = 0; e1 < ne; e1++){
+        for(unsigned int e2 = 0; e2 < e1; e2++)
+          packed[InteractionStructure::TriangularIndex(e1,e2)] = matrix[e1][e2]*cm2GeV;
+      }
+    });
+
     #ifdef FixCrossSections
     // fix charge current and neutral current differential cross sections
     for(unsigned int neutype = 0; neutype < nrhos; neutype++){
       double XCC_MIN,XNC_MIN,XCC_int,XNC_int,CC_rescale,NC_rescale;
       for(unsigned int flv = 0; flv < numneu; flv++){
-          XCC_MIN = sigma_CC[neutype][flv][0];
-          XNC_MIN = sigma_CC[neutype][flv][0];
+          XCC_MIN = tables.sigma_CC[neutype][flv][0];
+          XNC_MIN = tables.sigma_CC[neutype][flv][0];
           for(unsigned int e1 = 0; e1 < ne; e1++){
               XCC_int = 0.0;
               XNC_int = 0.0;
               for(unsigned int e2 = 0; e2 < e1; e2++){
-                  XCC_int += dsignudE_CC[neutype][flv][e1][e2]*delE[e2];
-                  XNC_int += dsignudE_NC[neutype][flv][e1][e2]*delE[e2];
+                  XCC_int += dsignudE_CC[neutype][flv][InteractionStructure::TriangularIndex(e1,e2)]*delE[e2];
+                  XNC_int += dsignudE_NC[neutype][InteractionStructure::TriangularIndex(e1,e2)]*delE[e2];
               }
 
               if(e1 != 0 ){
-                  CC_rescale = (sigma_CC[neutype][flv][e1] - XCC_MIN)/XCC_int;
-                  NC_rescale = (sigma_NC[neutype][flv][e1] - XNC_MIN)/XNC_int;
+                  CC_rescale = (tables.sigma_CC[neutype][flv][e1] - XCC_MIN)/XCC_int;
+                  NC_rescale = (tables.sigma_NC[neutype][flv][e1] - XNC_MIN)/XNC_int;
 
                   for(unsigned int e2 = 0; e2 < e1; e2++){
-                      dsignudE_CC[neutype][flv][e1][e2] = dsignudE_CC[neutype][flv][e1][e2]*CC_rescale;
-                      dsignudE_NC[neutype][flv][e1][e2] = dsignudE_NC[neutype][flv][e1][e2]*NC_rescale;
+                      const size_t e12 = InteractionStructure::TriangularIndex(e1,e2);
+                      dsignudE_CC[neutype][flv][e12] = dsignudE_CC[neutype][flv][e12]*CC_rescale;
+                      // the shared neutral current table is rescaled with the electron flavor
+                      if(flv == 0)
+                        dsignudE_NC[neutype][e12] = dsignudE_NC[neutype][e12]*NC_rescale;
                   }
               }
           }
@@ -466,15 +817,18 @@ void nuSQUIDS::InitializeInteractions(){
       for(unsigned int flv = 0; flv < numneu; flv++){
           for(unsigned int e1 = 0; e1 < ne; e1++){
               for(unsigned int e2 = 0; e2 < e1; e2++){
-                  if (dsignudE_NC[rho][flv][e1][e2] < 1.0e-50 or (dsignudE_NC[rho][flv][e1][e2] != dsignudE_NC[rho][flv][e1][e2])){
-                      dNdE_NC[rho][flv][e1][e2] = 0.0;
-                  } else {
-                      dNdE_NC[rho][flv][e1][e2] = (dsignudE_NC[rho][flv][e1][e2])/(sigma_NC[rho][flv][e1]);
+                  const size_t e12 = InteractionStructure::TriangularIndex(e1,e2);
+                  if (flv == 0){
+                    if (dsignudE_NC[rho][e12] < 1.0e-50 or (dsignudE_NC[rho][e12] != dsignudE_NC[rho][e12])){
+                        tables.dNdE_NC[rho][e12] = 0.0;
+                    } else {
+                        tables.dNdE_NC[rho][e12] = (dsignudE_NC[rho][e12])/(tables.sigma_NC[rho][flv][e1]);
+                    }
                   }
-                  if (dsignudE_CC[rho][flv][e1][e2] < 1.0e-50 or (dsignudE_CC[rho][flv][e1][e2] != dsignudE_CC[rho][flv][e1][e2])){
-                      dNdE_CC[rho][flv][e1][e2] = 0.0;
+                  if (dsignudE_CC[rho][flv][e12] < 1.0e-50 or (dsignudE_CC[rho][flv][e12] != dsignudE_CC[rho][flv][e12])){
+                      tables.dNdE_CC[rho][flv][e12] = 0.0;
                   } else {
-                      dNdE_CC[rho][flv][e1][e2] = (dsignudE_CC[rho][flv][e1][e2])/(sigma_CC[rho][flv][e1]);
+                      tables.dNdE_CC[rho][flv][e12] = (dsignudE_CC[rho][flv][e12])/(tables.sigma_CC[rho][flv][e1]);
                   }
               }
           }
@@ -484,7 +838,7 @@ void nuSQUIDS::InitializeInteractions(){
     // initialize interaction lenghts to zero
     // tau decay length array
     for(unsigned int e1 = 0; e1 < ne; e1++){
-        invlen_tau[e1] = 1.0/(tau_lifetime*E_range[e1]*tau_mass);
+        tables.invlen_tau[e1] = 1.0/(tau_lifetime*E_range[e1]*tau_mass);
     }
 
     // load tau decay spectra
@@ -492,8 +846,8 @@ void nuSQUIDS::InitializeInteractions(){
     // constructing dNdE_tau_lep/dNdE_tau_all
     for(unsigned int e1 = 0; e1 < ne; e1++){
         for(unsigned int e2 = 0; e2 < e1; e2++){
-            dNdE_tau_all[e1][e2] = tdc.dNdEnu_All(e1,e2)*GeVm1;
-            dNdE_tau_lep[e1][e2] = tdc.dNdEnu_Lep(e1,e2)*GeVm1;
+            tables.dNdE_tau_all[e1][e2] = tdc.dNdEnu_All(e1,e2)*GeVm1;
+            tables.dNdE_tau_lep[e1][e2] = tdc.dNdEnu_Lep(e1,e2)*GeVm1;
         }
     }
 
@@ -504,26 +858,212 @@ void nuSQUIDS::InitializeInteractions(){
         tau_all_int = 0.0;
         tau_lep_int = 0.0;
         for(unsigned int e2 = 0; e2 < e1; e2++){
-             tau_all_int += dNdE_tau_all[e1][e2]*delE[e2];
-             tau_lep_int += dNdE_tau_lep[e1][e2]*delE[e2];
+             tau_all_int += tables.dNdE_tau_all[e1][e2]*delE[e2];
+             tau_lep_int += tables.dNdE_tau_lep[e1][e2]*delE[e2];
         }
 
-        if( dNdE_tau_all[e1][0]*E_range[0] < 0.25 ) {
-            tau_all_rescale = (1.0 - dNdE_tau_all[e1][0]*E_range[0])/tau_all_int;
-            tau_lep_rescale = (taubr_lep - dNdE_tau_lep[e1][0]*E_range[0])/tau_lep_int;
+        if( tables.dNdE_tau_all[e1][0]*E_range[0] < 0.25 ) {
+            tau_all_rescale = (1.0 - tables.dNdE_tau_all[e1][0]*E_range[0])/tau_all_int;
+            tau_lep_rescale = (taubr_lep - tables.dNdE_tau_lep[e1][0]*E_range[0])/tau_lep_int;
 
             for(unsigned int e2 = 0; e2 < e1; e2++){
-                dNdE_tau_all[e1][e2] = dNdE_tau_all[e1][e2]*tau_all_rescale;
-                dNdE_tau_lep[e1][e2] = dNdE_tau_lep[e1][e2]*tau_lep_rescale;
+                tables.dNdE_tau_all[e1][e2] = tables.dNdE_tau_all[e1][e2]*tau_all_rescale;
+                tables.dNdE_tau_lep[e1][e2] = tables.dNdE_tau_lep[e1][e2]*tau_lep_rescale;
             }
         }
     }
     #endif
+
+    InitializeInteractionKernels();
+}
+
+namespace{
+// directory of the interaction table cache, empty if disabled
+std::string interaction_cache_directory;
+std::mutex interaction_cache_mutex;
+
+// threads used to compute the interaction tables, zero for the number of hardware threads
+std::atomic<unsigned int> interaction_threads{0};
+
+// version of the cache files, to be increased when the tables or the file change
+const uint64_t interaction_cache_version = 1;
+
+// 64 bit FNV-1a hash
+void hash_bytes(uint64_t& hash, const void* data, size_t size){
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for(size_t i = 0; i < size; i++){
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+}
+
+// header of the cache files, followed by the energy nodes and the tables as doubles
+struct InteractionCacheHeader{
+  char magic[8];
+  uint64_t version;
+  uint64_t nrhos;
+  uint64_t numneu;
+  uint64_t ne;
+};
+const char interaction_cache_magic[8] = {'N','S','Q','X','S','T','B','L'};
+} // close namespace
+
+void nuSQUIDS::Set_InteractionCacheDirectory(const std::string& directory){
+  std::lock_guard<std::mutex> lock(interaction_cache_mutex);
+  interaction_cache_directory = directory;
+}
+
+std::string nuSQUIDS::Get_InteractionCacheDirectory(){
+  std::lock_guard<std::mutex> lock(interaction_cache_mutex);
+  return interaction_cache_directory;
+}
+
+void nuSQUIDS::Set_InteractionThreads(unsigned int n){
+  interaction_threads = n;
+}
+
+unsigned int nuSQUIDS::Get_InteractionThreads(){
+  return interaction_threads;
+}
+
+std::string nuSQUIDS::InteractionCacheFile() const{
+  const std::string directory = Get_InteractionCacheDirectory();
+  if(directory.empty())
+    return "";
+  // the default cross sections are only created if the tables are not cached
+  const std::string xs_key = (ncs == nullptr) ? NeutrinoDISCrossSectionsFromTables::TablesCacheKey() : ncs->CacheKey();
+  if(xs_key.empty())
+    return "";
+
+  uint64_t hash = 14695981039346656037ULL;
+  hash_bytes(hash,&interaction_cache_version,sizeof(interaction_cache_version));
+  hash_bytes(hash,xs_key.data(),xs_key.size());
+  const uint64_t dims[3] = {nrhos,numneu,static_cast<uint64_t>(NT)};
+  hash_bytes(hash,dims,sizeof(dims));
+  hash_bytes(hash,E_range.get_data(),ne*sizeof(double));
+  const double tau_parameters[3] = {taubr_lep,tau_lifetime,tau_mass};
+  hash_bytes(hash,tau_parameters,sizeof(tau_parameters));
+  #ifdef FixCrossSections
+  hash_bytes(hash,"FixCrossSections",16);
+  #endif
+
+  char name[64];
+  snprintf(name,sizeof(name),"nusquids_xs_%016llx.bin",static_cast<unsigned long long>(hash));
+  return directory + "/" + name;
+}
+
+bool nuSQUIDS::ReadInteractionCache(const std::string& filename){
+  const size_t npairs = InteractionStructure::TriangularSize(ne);
+  const size_t ndoubles = ne + 2*nrhos*numneu*ne + nrhos*numneu*npairs + nrhos*npairs + ne + 2*ne*ne;
+  const size_t size = sizeof(InteractionCacheHeader) + ndoubles*sizeof(double);
+
+  int fd = open(filename.c_str(),O_RDONLY);
+  if(fd < 0)
+    return false;
+  struct stat file_stat;
+  if(fstat(fd,&file_stat) != 0 or static_cast<size_t>(file_stat.st_size) != size){
+    close(fd);
+    return false;
+  }
+  void* map = mmap(nullptr,size,PROT_READ,MAP_PRIVATE,fd,0);
+  close(fd);
+  if(map == MAP_FAILED)
+    return false;
+
+  const InteractionCacheHeader* header = static_cast<const InteractionCacheHeader*>(map);
+  const double* data = reinterpret_cast<const double*>(static_cast<const char*>(map) + sizeof(InteractionCacheHeader));
+  // the energy nodes are compared as well, in case of a hash collision
+  bool valid = std::memcmp(header->magic,interaction_cache_magic,sizeof(interaction_cache_magic)) == 0 and
+               header->version == interaction_cache_version and
+               header->nrhos == nrhos and header->numneu == numneu and header->ne == ne and
+               std::memcmp(data,E_range.get_data(),ne*sizeof(double)) == 0;
+  if(valid){
+    InitializeInteractionVectors();
+    InteractionStructure& tables = *int_struct;
+    data += ne;
+    for(marray<double,3>* table : {&tables.sigma_CC,&tables.sigma_NC,&tables.dNdE_CC}){
+      std::copy(data,data + table->size(),table->begin());
+      data += table->size();
+    }
+    std::copy(data,data + tables.dNdE_NC.size(),tables.dNdE_NC.begin());
+    data += tables.dNdE_NC.size();
+    std::copy(data,data + ne,tables.invlen_tau.begin());
+    data += ne;
+    for(marray<double,2>* table : {&tables.dNdE_tau_all,&tables.dNdE_tau_lep}){
+      std::copy(data,data + table->size(),table->begin());
+      data += table->size();
+    }
+    InitializeInteractionKernels();
+  }
+  munmap(map,size);
+  return valid;
+}
+
+void nuSQUIDS::WriteInteractionCache(const std::string& filename) const{
+  const InteractionStructure& tables = *int_struct;
+  const std::string tmp_filename = filename + ".tmp" + std::to_string(getpid()) + "_" +
+    std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  FILE* file = fopen(tmp_filename.c_str(),"wb");
+  if(file == nullptr)
+    return;
+
+  InteractionCacheHeader header;
+  std::memcpy(header.magic,interaction_cache_magic,sizeof(interaction_cache_magic));
+  header.version = interaction_cache_version;
+  header.nrhos = nrhos;
+  header.numneu = numneu;
+  header.ne = ne;
+  bool ok = fwrite(&header,sizeof(header),1,file) == 1;
+  ok = ok and fwrite(E_range.get_data(),sizeof(double),ne,file) == ne;
+  for(const marray<double,3>* table : {&tables.sigma_CC,&tables.sigma_NC,&tables.dNdE_CC})
+    ok = ok and fwrite(table->get_data(),sizeof(double),table->size(),file) == table->size();
+  ok = ok and fwrite(tables.dNdE_NC.get_data(),sizeof(double),tables.dNdE_NC.size(),file) == tables.dNdE_NC.size();
+  ok = ok and fwrite(tables.invlen_tau.get_data(),sizeof(double),ne,file) == ne;
+  for(const marray<double,2>* table : {&tables.dNdE_tau_all,&tables.dNdE_tau_lep})
+    ok = ok and fwrite(table->get_data(),sizeof(double),table->size(),file) == table->size();
+  ok = (fclose(file) == 0) and ok;
+
+  if(not ok or rename(tmp_filename.c_str(),filename.c_str()) != 0)
+    remove(tmp_filename.c_str());
+}
+
+void nuSQUIDS::InitializeInteractionKernels(){
+    InteractionStructure& tables = *int_struct;
+
+    // width of each initial energy node, the last node takes the one of the last interval
+    std::vector<double> width(ne,0.0);
+    for(unsigned int e2 = 0; e2 + 1 < ne; e2++)
+      width[e2] = delE[e2];
+    if(ne > 1)
+      width[ne-1] = delE[ne-2];
+
+    tables.tau_cc_kernel.resize(std::vector<size_t>{nrhos,ne,ne});
+    tables.tau_all_kernel.resize(std::vector<size_t>{ne,ne});
+    tables.tau_lep_kernel.resize(std::vector<size_t>{ne,ne});
+    tables.nc_kernel.resize(std::vector<size_t>{nrhos,ne,ne});
+    std::fill(tables.tau_cc_kernel.begin(),tables.tau_cc_kernel.end(),0.0);
+    std::fill(tables.tau_all_kernel.begin(),tables.tau_all_kernel.end(),0.0);
+    std::fill(tables.tau_lep_kernel.begin(),tables.tau_lep_kernel.end(),0.0);
+    std::fill(tables.nc_kernel.begin(),tables.nc_kernel.end(),0.0);
+
+    // the cascades only go to lower energies, so the kernels are strictly upper triangular
+    for(unsigned int e1 = 0; e1 < ne; e1++){
+      for(unsigned int e2 = e1 + 1; e2 < ne; e2++){
+        for(unsigned int rho = 0; rho < nrhos; rho++)
+          tables.nc_kernel[rho][e1][e2] = 0.5*tables.dNdE_NC[rho][InteractionStructure::TriangularIndex(e2,e1)]*tables.sigma_NC[rho][0][e2];
+        for(unsigned int rho = 0; rho < nrhos and numneu > 2; rho++)
+          tables.tau_cc_kernel[rho][e1][e2] = tables.dNdE_CC[rho][2][InteractionStructure::TriangularIndex(e2,e1)]*width[e2];
+        tables.tau_all_kernel[e1][e2] = tables.dNdE_tau_all[e2][e1]*width[e2];
+        tables.tau_lep_kernel[e1][e2] = tables.dNdE_tau_lep[e2][e1]*width[e2];
+      }
+    }
 }
 
 void nuSQUIDS::Set_Body(std::shared_ptr<Body> body_in){
   body = body_in;
   ibody = true;
+  track_profile.reset();
+  layer_boundaries_current = false;
 }
 
 void nuSQUIDS::Set_Track(std::shared_ptr<Track> track_in){
@@ -534,19 +1074,33 @@ void nuSQUIDS::Set_Track(std::shared_ptr<Track> track_in){
   // set track
   track = track_in;
   itrack = true;
+  track_profile.reset();
+  layer_boundaries_current = false;
 }
 
 void nuSQUIDS::PositivizeFlavors(){
+  // the flavor content is the one at the current time
+  if(basis != mass)
+    EvolveProjectors(Get_t());
+  const unsigned int ncomp = nsun*nsun;
+  double* content = &soa_scratch[0][0];
+  double* rho_soa = &soa_scratch[1][0];
   // advance positivity correction
   for(unsigned int rho = 0; rho < nrhos; rho++){
-    for(unsigned int ie = 0; ie < ne; ie++){
-      for(unsigned int flv = 0; flv < numneu; flv++){
-        double quantity = EvalFlavorAtNode(flv,ie,rho);
-        if( quantity < 0){
-          state[ie].rho[rho] -= evol_b1_proj[rho][flv][ie]*quantity;
-        }
+    GatherStateSoA(rho,rho_soa);
+    for(unsigned int flv = 0; flv < numneu; flv++){
+      const double* proj = EvolvedProjectorSoA(rho,flv);
+      FlavorContentSoA(proj,rho_soa,content);
+      for(unsigned int ie = 0; ie < ne; ie++)
+        content[ie] = std::min(content[ie],0.0);
+      for(unsigned int c = 0; c < ncomp; c++){
+        const double* p = proj + c*ne;
+        double* r = rho_soa + c*ne;
+        for(unsigned int ie = 0; ie < ne; ie++)
+          r[ie] -= p[ie]*content[ie];
       }
     }
+    ScatterStateSoA(rho,rho_soa);
   }
 }
 
@@ -559,6 +1113,10 @@ void nuSQUIDS::Set_PositivityConstrainStep(double step){
 }
 
 void nuSQUIDS::EvolveState(){
+  EvolveInterval(0,std::numeric_limits<double>::infinity());
+}
+
+void nuSQUIDS::EvolveInterval(double from, double to){
   // check for BODY and TRACK status
   if ( body == NULL )
     throw std::runtime_error("nuSQUIDS::Error::BODY is a NULL pointer");
@@ -573,37 +1131,207 @@ void nuSQUIDS::EvolveState(){
   if ( not ienergy )
     throw std::runtime_error("nuSQUIDS::Error::Energy not set.");
 
-  if( not tauregeneration ){
-    if(positivization){
-      int positivization_steps = static_cast<int>((track->GetFinalX() - track->GetInitialX())/positivization_scale);
-      for (int i = 0; i < positivization_steps; i++){
-        Evolve(positivization_scale);
-        PositivizeFlavors();
-      }
-      Evolve(track->GetFinalX()-positivization_scale*positivization_steps);
-      PositivizeFlavors();
-    } else {
-      Evolve(track->GetFinalX()-track->GetInitialX());
-    }
+  const double length = track->GetFinalX() - track->GetInitialX();
+  to = std::min(to,length);
+
+  if(layered_evolution or UseClosedForm()){
+    if(iinteraction)
+      throw std::runtime_error("nuSQUIDS::Error::The layered evolution cannot be used with interactions.");
+    if(from < to)
+      EvolveLayers(std::min(Get_t() - time_offset + (to - from),track->GetFinalX()));
+    return;
   }
-  else {
-    double scale;
-    if(positivization)
-      scale = std::min(tau_reg_scale,positivization_scale);
-    else
-      scale = tau_reg_scale;
-    int tau_steps = static_cast<int>((track->GetFinalX() - track->GetInitialX())/scale);
-    for (int i = 0; i < tau_steps; i++){
-      Evolve(scale);
-      if(positivization)
-        PositivizeFlavors();
-      ConvertTauIntoNuTau();
+
+  // the track is split in steps after which the positivization
+  // and tau regeneration are applied
+  double scale = length;
+  if(tauregeneration and positivization)
+    scale = std::min(tau_reg_scale,positivization_scale);
+  else if(tauregeneration)
+    scale = tau_reg_scale;
+  else if(positivization)
+    scale = positivization_scale;
+  int steps = (tauregeneration or positivization) ? static_cast<int>(length/scale) : 0;
+
+  double x = from;
+  if(x >= to)
+    return;
+  // a new evolution starts with the step given to Set_h()
+  if(from == 0)
+    step_probe = StepProbe();
+  for (int i = 0; i <= steps; i++){
+    // the last step closes the track
+    double start = scale*i;
+    double step = (i < steps) ? scale : length - scale*steps;
+    double end = (i < steps) ? start + step : length;
+    if(end <= from and i < steps)
+      continue;
+    if(end > to){
+      EvolveAcrossLayers(to - x);
+      return;
     }
-    Evolve(track->GetFinalX()-scale*tau_steps);
+    EvolveAcrossLayers((x == start) ? step : end - x);
+    x = end;
     if(positivization)
       PositivizeFlavors();
-    ConvertTauIntoNuTau();
+    if(tauregeneration)
+      ConvertTauIntoNuTau();
+  }
+}
+
+bool nuSQUIDS::UseClosedForm() const{
+  return closed_form_evolution and not iinteraction and body->IsConstant() and typeid(*this) == FusedTermsType();
+}
+
+const std::vector<double>& nuSQUIDS::LayerBoundaries(){
+  if(not layer_boundaries_current){
+    layer_boundaries = body->GetLayerBoundaries(*track);
+    layer_boundaries_current = true;
+  }
+  return layer_boundaries;
+}
+
+void nuSQUIDS::EvolveAcrossLayers(double dt){
+  if(not stop_at_discontinuities){
+    Evolve(dt);
+    return;
+  }
+  const std::vector<double>& boundaries = LayerBoundaries();
+  const double h_initial = Get_h();
+  // boundaries closer than this to the current position have been reached already
+  const double margin = 1.0e-12*std::abs(track->GetFinalX() - track->GetInitialX());
+  const double t_end = Get_t() + dt;
+  while(Get_t() < t_end){
+    const double x_now = Get_t() - time_offset;
+    auto next = std::upper_bound(boundaries.begin(),boundaries.end(),x_now + margin);
+    double t_stop = t_end;
+    if(next != boundaries.end())
+      t_stop = std::min(t_end,*next + time_offset);
+    const double piece = t_stop - Get_t();
+    if(not (piece > 0))
+      break;
+    // start the piece with the step the previous one ended with
+    if(step_probe.advance > 0)
+      Set_h(std::max(Get_h_min(),std::min(Get_h_max(),std::min(piece,2.0*step_probe.advance))));
+    step_probe.from = Get_t() + 0.5*piece;
+    step_probe.x_max = Get_t();
+    step_probe.advance = 0;
+    step_probe.active = true;
+    Evolve(piece);
+    step_probe.active = false;
+    if(t_stop >= t_end)
+      break;
+  }
+  Set_h(h_initial);
+}
+
+std::vector<nuSQUIDS::LayerSegment> nuSQUIDS::LayerSegments(double x_start, double x_end){
+  std::vector<double> edges{x_start};
+  for(double x : LayerBoundaries()){
+    if(x > x_start and x < x_end)
+      edges.push_back(x);
+  }
+  edges.push_back(x_end);
+
+  const double gl_nodes[3] = {-sqrt(0.6),0.0,sqrt(0.6)};
+  const double gl_weights[3] = {5.0/9.0,8.0/9.0,5.0/9.0};
+  const double x_saved = track->GetX();
+  std::vector<LayerSegment> segments;
+  for(unsigned int i = 0; i + 1 < edges.size(); i++){
+    const double layer_length = edges[i+1] - edges[i];
+    if(not (layer_length > 0))
+      continue;
+    // constant bodies are evolved in one piece
+    const unsigned int pieces = body->IsConstant() ? 1 : std::max(1.0,std::ceil(layer_length/layer_max_length));
+    for(unsigned int p = 0; p < pieces; p++){
+      const double a = edges[i] + layer_length*p/pieces;
+      const double b = edges[i] + layer_length*(p+1)/pieces;
+      LayerSegment segment{b - a,0.0,0.0};
+      for(unsigned int k = 0; k < 3; k++){
+        track->SetX(0.5*(a + b) + 0.5*(b - a)*gl_nodes[k]);
+        UpdateMediumState();
+        segment.CC += 0.5*gl_weights[k]*medium.CC;
+        segment.NC += 0.5*gl_weights[k]*medium.NC;
+      }
+      segments.push_back(segment);
+    }
   }
+  track->SetX(x_saved);
+  return segments;
+}
+
+void nuSQUIDS::EvolveLayers(double x_end){
+  const double x_start = Get_t() - time_offset;
+  if(not (x_end > x_start))
+    return;
+  const std::vector<LayerSegment> segments = LayerSegments(x_start,x_end);
+  // interaction picture times at both ends
+  const double t_start = Get_t() - Get_t_initial();
+  const double t_end = t_start + (x_end - x_start);
+
+  gsl_matrix_complex* propagator = gsl_matrix_complex_alloc(numneu,numneu);
+  gsl_matrix_complex* segment_propagator = gsl_matrix_complex_alloc(numneu,numneu);
+  gsl_matrix_complex* product = gsl_matrix_complex_alloc(numneu,numneu);
+  gsl_matrix_complex* eigenvectors = gsl_matrix_complex_alloc(numneu,numneu);
+  gsl_vector* eigenvalues = gsl_vector_alloc(numneu);
+  gsl_eigen_hermv_workspace* workspace = gsl_eigen_hermv_alloc(numneu);
+
+  for(unsigned int rho = 0; rho < nrhos; rho++){
+    const bool antineutrino_rho = (NT == antineutrino) or (NT == both and rho == 1);
+    const double sign = antineutrino_rho ? -1.0 : 1.0;
+    for(unsigned int ie = 0; ie < ne; ie++){
+      gsl_matrix_complex_set_identity(propagator);
+      for(const LayerSegment& segment : segments){
+        // same hamiltonian as H0 plus HI, in the mass basis
+        squids::SU_vector hamiltonian = (segment.CC + segment.NC)*b1_proj[rho][0];
+        hamiltonian += segment.NC*b1_proj[rho][1];
+        hamiltonian += segment.NC*b1_proj[rho][2];
+        if(basis == mass){
+          hamiltonian += H0_array[ie];
+          hamiltonian *= sign;
+        }
+        else {
+          hamiltonian *= sign;
+          hamiltonian += H0_array[ie];
+        }
+        auto hamiltonian_matrix = hamiltonian.GetGSLMatrix();
+        gsl_eigen_hermv(hamiltonian_matrix.get(),eigenvalues,eigenvectors,workspace);
+
+        // exp(-i H L) = V exp(-i D L) V^dagger
+        gsl_matrix_complex_set_zero(segment_propagator);
+        for(unsigned int i = 0; i < numneu; i++)
+          gsl_matrix_complex_set(segment_propagator,i,i,gsl_complex_polar(1.0,-gsl_vector_get(eigenvalues,i)*segment.length));
+        gsl_matrix_complex_change_basis_UMUC(eigenvectors,segment_propagator);
+
+        gsl_blas_zgemm(CblasNoTrans,CblasNoTrans,gsl_complex_rect(1.0,0.0),segment_propagator,
+                       propagator,gsl_complex_rect(0.0,0.0),product);
+        std::swap(propagator,product);
+      }
+
+      // the state is propagated in the Schrodinger picture
+      squids::SU_vector state_rho = state[ie].rho[rho];
+      if(basis != mass)
+        state_rho = state_rho.Evolve(H0_array[ie],-t_start);
+      auto state_matrix = state_rho.GetGSLMatrix();
+      gsl_matrix_complex_change_basis_UMUC(propagator,state_matrix.get());
+      state_rho = squids::SU_vector(state_matrix.get());
+      if(basis != mass)
+        state_rho = state_rho.Evolve(H0_array[ie],t_end);
+      state[ie].rho[rho] = state_rho;
+    }
+  }
+
+  gsl_eigen_hermv_free(workspace);
+  gsl_vector_free(eigenvalues);
+  gsl_matrix_complex_free(eigenvectors);
+  gsl_matrix_complex_free(product);
+  gsl_matrix_complex_free(segment_propagator);
+  gsl_matrix_complex_free(propagator);
+
+  Set_t(Get_t() + (x_end - x_start));
+  track->SetX(x_end);
+  if(basis != mass)
+    EvolveProjectors(Get_t());
 }
 
 void nuSQUIDS::SetScalarsToZero(void){
@@ -615,29 +1343,40 @@ void nuSQUIDS::SetScalarsToZero(void){
 }
 
 void nuSQUIDS::ConvertTauIntoNuTau(){
+  // tau and antitau fluxes as the two columns of an (energy,2) matrix
+  std::vector<double> tau_all(2*ne), tau_lep(2*ne);
+  for(unsigned int e2 = 0; e2 < ne; e2++){
+    tau_all[2*e2] = state[e2].scalar[0];
+    tau_all[2*e2 + 1] = state[e2].scalar[1];
+  }
+  tau_lep = tau_all;
+
+  // integrate the decay spectra over the higher tau energies for both columns at once
+  cblas_dtrmm(CblasRowMajor,CblasLeft,CblasUpper,CblasNoTrans,CblasNonUnit,
+              ne,2,1.0,int_struct->tau_all_kernel.get_data(),ne,tau_all.data(),2);
+  cblas_dtrmm(CblasRowMajor,CblasLeft,CblasUpper,CblasNoTrans,CblasNonUnit,
+              ne,2,1.0,int_struct->tau_lep_kernel.get_data(),ne,tau_lep.data(),2);
 
+  const unsigned int ncomp = nsun*nsun;
+  const double* nu_proj[3] = {EvolvedProjectorSoA(0,0),EvolvedProjectorSoA(0,1),EvolvedProjectorSoA(0,2)};
+  const double* aneu_proj[3] = {EvolvedProjectorSoA(1,0),EvolvedProjectorSoA(1,1),EvolvedProjectorSoA(1,2)};
   for(unsigned int e1 = 0; e1 < ne; e1++){
-      double tau_neu_all  = 0.0;
-      double tau_neu_lep  = 0.0;
-      double tau_aneu_all = 0.0;
-      double tau_aneu_lep = 0.0;
-
-      for(unsigned int e2 = e1 +1; e2 < ne; e2++){
-          //std::cout << dNdE_tau_all[e2][e1] << " " << delE[e2] << " " << state[e2].scalar[0] << std::endl;
-          tau_neu_all  += dNdE_tau_all[e2][e1]*delE[e2]*state[e2].scalar[0];
-          tau_neu_lep  += dNdE_tau_lep[e2][e1]*delE[e2]*state[e2].scalar[0];
-          tau_aneu_all += dNdE_tau_all[e2][e1]*delE[e2]*state[e2].scalar[1];
-          tau_aneu_lep += dNdE_tau_lep[e2][e1]*delE[e2]*state[e2].scalar[1];
-      }
+      double tau_neu_all  = tau_all[2*e1];
+      double tau_neu_lep  = tau_lep[2*e1];
+      double tau_aneu_all = tau_all[2*e1 + 1];
+      double tau_aneu_lep = tau_lep[2*e1 + 1];
+
       // note that the br_lepton is already included in dNdE_tau_lep
       // adding new fluxes
-      //std::cout << tau_neu_all << " " << tau_aneu_all << " " << tau_neu_lep << " " << tau_aneu_lep << std::endl;
-      state[e1].rho[0]  += tau_neu_all*evol_b1_proj[0][2][e1] +
-                            tau_aneu_lep*evol_b1_proj[0][0][e1] +
-                            tau_aneu_lep*evol_b1_proj[0][1][e1];
-      state[e1].rho[1]  += tau_aneu_all*evol_b1_proj[1][2][e1] +
-                            tau_neu_lep*evol_b1_proj[1][0][e1] +
-                            tau_neu_lep*evol_b1_proj[1][1][e1];
+      for(unsigned int c = 0; c < ncomp; c++){
+        const size_t i = size_t(c)*ne + e1;
+        state[e1].rho[0][c] += tau_neu_all*nu_proj[2][i] +
+                               tau_aneu_lep*nu_proj[0][i] +
+                               tau_aneu_lep*nu_proj[1][i];
+        state[e1].rho[1][c] += tau_aneu_all*aneu_proj[2][i] +
+                               tau_neu_lep*aneu_proj[0][i] +
+                               tau_neu_lep*aneu_proj[1][i];
+      }
   }
 
   // clean all lepton arrays
@@ -897,7 +1636,10 @@ void nuSQUIDS::iniH0(){
       // else we will need two H0_array.
       H0_array[ei] = H0(E_range[ei],0);
     }
+    iniPhases();
   }
+  // the projectors have to be evolved with the new hamiltonian
+  evol_proj_time = std::numeric_limits<double>::quiet_NaN();
 }
 
 void nuSQUIDS::AntineutrinoCPFix(unsigned int rho){
@@ -929,32 +1671,20 @@ void nuSQUIDS::iniProjectors(){
   }
 
   evol_b0_proj.resize(std::vector<size_t>{nrhos,numneu,ne});
-  evol_b1_proj.resize(std::vector<size_t>{nrhos,numneu,ne});
   for(unsigned int rho = 0; rho < nrhos; rho++){
     for(unsigned int flv = 0; flv < numneu; flv++){
       for(unsigned int e1 = 0; e1 < ne; e1++){
         evol_b0_proj[rho][flv][e1] = squids::SU_vector::Projector(nsun,flv);
-        evol_b1_proj[rho][flv][e1] = squids::SU_vector::Projector(nsun,flv);
-
-        AntineutrinoCPFix(rho);
-        evol_b1_proj[rho][flv][e1].RotateToB1(params);
-        AntineutrinoCPFix(rho);
       }
     }
   }
-
+  // the flavor projectors in the interaction picture start as nuSQUIDS#b1_proj
+  ProjectorsChanged();
 }
 
 void nuSQUIDS::SetIniFlavorProyectors(){
   for(unsigned int rho = 0; rho < nrhos; rho++){
     for(unsigned int flv = 0; flv < numneu; flv++){
-      for(unsigned int e1 = 0; e1 < ne; e1++){
-        evol_b1_proj[rho][flv][e1] = b0_proj[flv];
-
-        AntineutrinoCPFix(rho);
-        evol_b1_proj[rho][flv][e1].RotateToB1(params);
-        AntineutrinoCPFix(rho);
-      }
       b1_proj[rho][flv] = b0_proj[flv];
 
       AntineutrinoCPFix(rho);
@@ -962,6 +1692,7 @@ void nuSQUIDS::SetIniFlavorProyectors(){
       AntineutrinoCPFix(rho);
     }
   }
+  ProjectorsChanged();
 }
 
 squids::SU_vector nuSQUIDS::GetState(unsigned int ie, unsigned int rho) const{
@@ -969,7 +1700,9 @@ squids::SU_vector nuSQUIDS::GetState(unsigned int ie, unsigned int rho) const{
 }
 
 squids::SU_vector nuSQUIDS::GetFlavorProj(unsigned int flv,unsigned int rho) const{
-  return b1_proj[rho][flv];
+  const unsigned int ncomp = nsun*nsun;
+  const size_t offset = size_t(nrhos)*numneu*ncomp*ne + (rho*numneu + flv)*ncomp;
+  return squids::SU_vector(nsun,const_cast<double*>(proj_soa.get_data()) + offset);
 }
 
 squids::SU_vector nuSQUIDS::GetMassProj(unsigned int flv,unsigned int rho) const{
@@ -983,47 +1716,10 @@ squids::SU_vector nuSQUIDS::GetHamiltonian(unsigned int ei, unsigned int rho){
   return H0(E_range[ei],rho)+HI(ei,rho,Get_t());
 }
 
-void nuSQUIDS::WriteStateHDF5(std::string str,std::string grp,bool save_cross_section, std::string cross_section_grp_loc) const{
-  if ( body == NULL )
-    throw std::runtime_error("nuSQUIDS::Error::BODY is a NULL pointer");
-  if (not ibody )
-    throw std::runtime_error("nuSQUIDS::Error::Body not initialized");
-  if ( track == NULL )
-    throw std::runtime_error("nuSQUIDS::Error::TRACK is a NULL pointer");
-  if ( not itrack )
-    throw std::runtime_error("nuSQUIDS::Error::TRACK is not initialized");
-  if ( not istate )
-    throw std::runtime_error("nuSQUIDS::Error::Initial state not initialized");
-  if ( not ienergy )
-    throw std::runtime_error("nuSQUIDS::Error::Energy not set.");
-
-  if (!iinteraction)
-    save_cross_section = iinteraction;
-
-  // this lines supress HDF5 error messages
-  H5Eset_auto (H5E_DEFAULT,NULL, NULL);
-
-  hid_t file_id,group_id,root_id;
-  hid_t dset_id;
-  // create HDF5 file
-  //std::cout << "writing to hdf5 file" << std::endl;
-  // H5F_ACC_TRUNC : overwrittes file
-  // H5F_ACC_EXCL  : files if file exists
-  file_id = H5Fopen(str.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
-  if (file_id < 0 ) {// file already exists
-    file_id = H5Fcreate(str.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
-    if (file_id < 0)
-        throw std::runtime_error("nuSQUIDS::Error::Cannot create file at " + str + ".");
-  }
-  root_id = H5Gopen(file_id, "/",H5P_DEFAULT);
-  if ( grp != "/" )
-    group_id = H5Gcreate(root_id, grp.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-  else
-    group_id = root_id;
-
+void nuSQUIDS::WriteParametersHDF5(hid_t group_id) const{
   // write the energy range
   hsize_t Edims[1]={E_range.extent(0)};
-  dset_id = H5LTmake_dataset(group_id,"energies",1,Edims,H5T_NATIVE_DOUBLE,E_range.get_data());
+  H5LTmake_dataset(group_id,"energies",1,Edims,H5T_NATIVE_DOUBLE,E_range.get_data());
   H5LTset_attribute_string(group_id, "energies", "elogscale", (elogscale) ? "True":"False");
 
   // write mixing parameters
@@ -1037,10 +1733,6 @@ void nuSQUIDS::WriteStateHDF5(std::string str,std::string grp,bool save_cross_se
   int auxint = static_cast<int>(NT);
   H5LTset_attribute_int(group_id, "basic","NT",&auxint,1);
   H5LTset_attribute_string(group_id, "basic", "interactions", (iinteraction) ? "True":"False");
-  double auxt = Get_t();
-  H5LTset_attribute_double(group_id, "basic", "squids_time", &auxt,1);
-  double auxt_ini = Get_t_initial();
-  H5LTset_attribute_double(group_id, "basic", "squids_time_initial", &auxt_ini,1);
 
   // version numbers
   H5LTset_attribute_string(group_id, "basic", "squids_version", SQUIDS_VERSION_STR);
@@ -1069,19 +1761,186 @@ void nuSQUIDS::WriteStateHDF5(std::string str,std::string grp,bool save_cross_se
     double dm2_value = params.GetEnergyDifference(i);
     H5LTset_attribute_double(group_id, "massdifferences",dm2_label.c_str(),&dm2_value, 1);
   }
+}
 
-  //writing state
+std::vector<double> nuSQUIDS::GetStateData() const{
   const unsigned int numneusq = numneu*numneu;
-  hsize_t statedim[2] {E_range.size(),(hsize_t)numneu*numneu};
-  std::vector<double> neustate(numneusq*ne), aneustate(numneusq*ne);
+  std::vector<double> data(ne*nrhos*numneusq);
+  for(unsigned int ie = 0; ie < ne; ie++){
+    for(unsigned int rho = 0; rho < nrhos; rho++){
+      for(unsigned int i = 0; i < numneusq; i++)
+        data[(ie*nrhos + rho)*numneusq + i] = state[ie].rho[rho][i];
+    }
+  }
+  return data;
+}
 
+void nuSQUIDS::GetCompositionData(std::vector<double>& flavor, std::vector<double>& mass) const{
   for(unsigned int ie = 0; ie < ne; ie++){
-    for(unsigned int i = 0; i < numneu*numneu; i ++){
-      if (NT == both){
-        neustate[ie*numneusq + i] = state[ie].rho[0][i];
-        aneustate[ie*numneusq + i] = state[ie].rho[1][i];
+    for(unsigned int rho = 0; rho < nrhos; rho++){
+      for(unsigned int i = 0; i < numneu; i++){
+        flavor.push_back(EvalFlavorAtNode(i,ie,rho));
+        mass.push_back(EvalMassAtNode(i,ie,rho));
       }
-      else if (NT == neutrino){
+    }
+  }
+}
+
+std::vector<double> nuSQUIDS::GetScalarData() const{
+  std::vector<double> data(ne*nscalars);
+  for(unsigned int ie = 0; ie < ne; ie++){
+    for(unsigned int i = 0; i < nscalars; i++)
+      data[ie*nscalars + i] = state[ie].scalar[i];
+  }
+  return data;
+}
+
+void nuSQUIDS::SetStateData(double squids_time, const double* state_data, const double* scalar_data){
+  if( not istate )
+    throw std::runtime_error("nuSQUIDS::Error::Initial state needs to be set before it is overwritten.");
+
+  // move the clock, the track and the projectors to the new time
+  Set_t(squids_time);
+  track->SetX(squids_time - time_offset);
+  EvolveProjectors(squids_time);
+
+  const unsigned int numneusq = numneu*numneu;
+  for(unsigned int ie = 0; ie < ne; ie++){
+    for(unsigned int rho = 0; rho < nrhos; rho++){
+      for(unsigned int j = 0; j < numneusq; j++)
+        state[ie].rho[rho][j] = state_data[(ie*nrhos + rho)*numneusq + j];
+    }
+    for(unsigned int i = 0; i < nscalars; i++)
+      state[ie].scalar[i] = scalar_data[ie*nscalars + i];
+  }
+}
+
+void nuSQUIDS::WriteCrossSectionsHDF5(hid_t xs_group_id) const{
+  const InteractionStructure& tables = *int_struct;
+  // sigma_CC and sigma_NC
+  hsize_t XSdim[3] {static_cast<hsize_t>(nrhos),
+                    static_cast<hsize_t>(numneu),
+                    static_cast<hsize_t>(ne)};
+  std::vector<double> xsCC(nrhos*numneu*ne),xsNC(nrhos*numneu*ne);
+  for ( unsigned int rho = 0; rho < nrhos; rho ++){
+    for ( unsigned int flv = 0; flv < numneu; flv ++){
+        for ( unsigned int ie = 0; ie < ne; ie ++){
+          xsCC[rho*(numneu*ne) +  flv*ne + ie] = tables.sigma_CC[rho][flv][ie];
+          xsNC[rho*(numneu*ne) +  flv*ne + ie] = tables.sigma_NC[rho][flv][ie];
+        }
+    }
+  }
+  H5LTmake_dataset(xs_group_id,"sigmacc",3,XSdim,H5T_NATIVE_DOUBLE,static_cast<void*>(xsCC.data()));
+  H5LTmake_dataset(xs_group_id,"sigmanc",3,XSdim,H5T_NATIVE_DOUBLE,static_cast<void*>(xsNC.data()));
+
+  // dNdE_CC and dNdE_NC
+  hsize_t dXSdim[4] {static_cast<hsize_t>(nrhos),
+                     static_cast<hsize_t>(numneu),
+                     static_cast<hsize_t>(ne),
+                     static_cast<hsize_t>(ne)};
+  std::vector<double> dxsCC(nrhos*numneu*ne*ne),dxsNC(nrhos*numneu*ne*ne);
+
+  for(unsigned int rho = 0; rho < nrhos; rho++){
+    for(unsigned int flv = 0; flv < numneu; flv++){
+        for(unsigned int e1 = 0; e1 < ne; e1++){
+            for(unsigned int e2 = 0; e2 < ne; e2++){
+              // the file keeps the full tables, with the neutral current repeated for each flavor
+              if (e2 < e1) {
+                dxsCC[rho*(numneu*ne*ne) +  flv*ne*ne + e1*ne + e2] = tables.dNdE_CC[rho][flv][InteractionStructure::TriangularIndex(e1,e2)];
+                dxsNC[rho*(numneu*ne*ne) +  flv*ne*ne + e1*ne + e2] = tables.dNdE_NC[rho][InteractionStructure::TriangularIndex(e1,e2)];
+              } else {
+                dxsCC[rho*(numneu*ne*ne) +  flv*ne*ne + e1*ne + e2] = 0.0;
+                dxsNC[rho*(numneu*ne*ne) +  flv*ne*ne + e1*ne + e2] = 0.0;
+              }
+            }
+        }
+    }
+  }
+  H5LTmake_dataset(xs_group_id,"dNdEcc",4,dXSdim,H5T_NATIVE_DOUBLE,static_cast<void*>(dxsCC.data()));
+  H5LTmake_dataset(xs_group_id,"dNdEnc",4,dXSdim,H5T_NATIVE_DOUBLE,static_cast<void*>(dxsNC.data()));
+
+  // invlen_tau
+  hsize_t iltdim[1] {static_cast<hsize_t>(ne)};
+  H5LTmake_dataset(xs_group_id,"invlentau",1,iltdim,H5T_NATIVE_DOUBLE,static_cast<const void*>(tables.invlen_tau.get_data()));
+
+  // dNdE_tau_all,dNdE_tau_lep
+  hsize_t dNdEtaudim[2] {static_cast<hsize_t>(ne),
+                         static_cast<hsize_t>(ne)};
+  std::vector<double> dNdEtauall(ne*ne),dNdEtaulep(ne*ne);
+  for(unsigned int e1 = 0; e1 < ne; e1++){
+      for(unsigned int e2 = 0; e2 < ne; e2++){
+        if ( e2 < e1 ) {
+          dNdEtauall[e1*ne + e2] = tables.dNdE_tau_all[e1][e2];
+          dNdEtaulep[e1*ne + e2] = tables.dNdE_tau_lep[e1][e2];
+        } else  {
+          dNdEtauall[e1*ne + e2] = 0.0;
+          dNdEtaulep[e1*ne + e2] = 0.0;
+        }
+      }
+  }
+
+  H5LTmake_dataset(xs_group_id,"dNdEtauall",2,dNdEtaudim,H5T_NATIVE_DOUBLE,static_cast<void*>(dNdEtauall.data()));
+  H5LTmake_dataset(xs_group_id,"dNdEtaulep",2,dNdEtaudim,H5T_NATIVE_DOUBLE,static_cast<void*>(dNdEtaulep.data()));
+}
+
+void nuSQUIDS::WriteStateHDF5(std::string str,std::string grp,bool save_cross_section, std::string cross_section_grp_loc) const{
+  if ( body == NULL )
+    throw std::runtime_error("nuSQUIDS::Error::BODY is a NULL pointer");
+  if (not ibody )
+    throw std::runtime_error("nuSQUIDS::Error::Body not initialized");
+  if ( track == NULL )
+    throw std::runtime_error("nuSQUIDS::Error::TRACK is a NULL pointer");
+  if ( not itrack )
+    throw std::runtime_error("nuSQUIDS::Error::TRACK is not initialized");
+  if ( not istate )
+    throw std::runtime_error("nuSQUIDS::Error::Initial state not initialized");
+  if ( not ienergy )
+    throw std::runtime_error("nuSQUIDS::Error::Energy not set.");
+
+  if (!iinteraction)
+    save_cross_section = iinteraction;
+
+  // this lines supress HDF5 error messages
+  H5Eset_auto (H5E_DEFAULT,NULL, NULL);
+
+  hid_t file_id,group_id,root_id;
+  hid_t dset_id;
+  // create HDF5 file
+  //std::cout << "writing to hdf5 file" << std::endl;
+  // H5F_ACC_TRUNC : overwrittes file
+  // H5F_ACC_EXCL  : files if file exists
+  file_id = H5Fopen(str.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+  if (file_id < 0 ) {// file already exists
+    file_id = H5Fcreate(str.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (file_id < 0)
+        throw std::runtime_error("nuSQUIDS::Error::Cannot create file at " + str + ".");
+  }
+  root_id = H5Gopen(file_id, "/",H5P_DEFAULT);
+  if ( grp != "/" )
+    group_id = H5Gcreate(root_id, grp.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+  else
+    group_id = root_id;
+
+  // write energies, mixing parameters and versions
+  WriteParametersHDF5(group_id);
+
+  double auxt = Get_t();
+  H5LTset_attribute_double(group_id, "basic", "squids_time", &auxt,1);
+  double auxt_ini = Get_t_initial();
+  H5LTset_attribute_double(group_id, "basic", "squids_time_initial", &auxt_ini,1);
+
+  //writing state
+  const unsigned int numneusq = numneu*numneu;
+  hsize_t statedim[2] {E_range.size(),(hsize_t)numneu*numneu};
+  std::vector<double> neustate(numneusq*ne), aneustate(numneusq*ne);
+
+  for(unsigned int ie = 0; ie < ne; ie++){
+    for(unsigned int i = 0; i < numneu*numneu; i ++){
+      if (NT == both){
+        neustate[ie*numneusq + i] = state[ie].rho[0][i];
+        aneustate[ie*numneusq + i] = state[ie].rho[1][i];
+      }
+      else if (NT == neutrino){
         neustate[ie*numneusq + i] = state[ie].rho[0][i];
         aneustate[ie*numneusq + i] = 0.0;
       }
@@ -1096,32 +1955,15 @@ void nuSQUIDS::WriteStateHDF5(std::string str,std::string grp,bool save_cross_se
   dset_id = H5LTmake_dataset(group_id,"aneustate",2,statedim,H5T_NATIVE_DOUBLE,static_cast<void*>(aneustate.data()));
 
   // writing state flavor and mass composition
-  hsize_t pdim[2] {E_range.size(), static_cast<hsize_t>(numneu)};
-  if ( NT == both )
-    pdim[1] *= 2;
+  hsize_t pdim[2] {E_range.size(), static_cast<hsize_t>(numneu*nrhos)};
   std::vector<double> flavor,mass;
-
-  for(unsigned int ie = 0; ie < ne; ie++){
-    // neutrino
-    if (NT == both or NT == neutrino){
-      for(unsigned int i = 0; i < numneu; i++){
-          flavor.push_back(EvalFlavorAtNode(i,ie,0));
-          mass.push_back(EvalMassAtNode(i,ie,0));
-        }
-    }
-      // antineutrino
-    if (NT == both or NT == antineutrino){
-      for(unsigned int i = 0; i < numneu; i++){
-          flavor.push_back(EvalFlavorAtNode(i,ie,0));
-          mass.push_back(EvalMassAtNode(i,ie,0));
-      }
-    }
-  }
+  GetCompositionData(flavor,mass);
 
   dset_id = H5LTmake_dataset(group_id,"flavorcomp",2,pdim,H5T_NATIVE_DOUBLE,static_cast<void*>(flavor.data()));
   dset_id = H5LTmake_dataset(group_id,"masscomp",2,pdim,H5T_NATIVE_DOUBLE,static_cast<void*>(mass.data()));
 
   // writing body and track information
+  hsize_t dim[1]{1};
   hsize_t trackparamdim[1] {track->GetTrackParams().size()};
   if ( trackparamdim[0] == 0 ) {
     H5LTmake_dataset(group_id,"track",1,dim,H5T_NATIVE_DOUBLE,0);
@@ -1154,82 +1996,19 @@ void nuSQUIDS::WriteStateHDF5(std::string str,std::string grp,bool save_cross_se
     xs_group_id = H5Gcreate(root_id, cross_section_grp_loc.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
   }
 
-  if (iinteraction and save_cross_section) {
-    // sigma_CC and sigma_NC
-    hsize_t XSdim[3] {static_cast<hsize_t>(nrhos),
-                      static_cast<hsize_t>(numneu),
-                      static_cast<hsize_t>(ne)};
-    std::vector<double> xsCC(nrhos*numneu*ne),xsNC(nrhos*numneu*ne);
-    for ( unsigned int rho = 0; rho < nrhos; rho ++){
-      for ( unsigned int flv = 0; flv < numneu; flv ++){
-          for ( unsigned int ie = 0; ie < ne; ie ++){
-            xsCC[rho*(numneu*ne) +  flv*ne + ie] = sigma_CC[rho][flv][ie];
-            xsNC[rho*(numneu*ne) +  flv*ne + ie] = sigma_NC[rho][flv][ie];
-          }
-      }
-    }
-    dset_id = H5LTmake_dataset(xs_group_id,"sigmacc",3,XSdim,H5T_NATIVE_DOUBLE,static_cast<void*>(xsCC.data()));
-    dset_id = H5LTmake_dataset(xs_group_id,"sigmanc",3,XSdim,H5T_NATIVE_DOUBLE,static_cast<void*>(xsNC.data()));
-
-    // dNdE_CC and dNdE_NC
-    hsize_t dXSdim[4] {static_cast<hsize_t>(nrhos),
-                       static_cast<hsize_t>(numneu),
-                       static_cast<hsize_t>(ne),
-                       static_cast<hsize_t>(ne)};
-    std::vector<double> dxsCC(nrhos*numneu*ne*ne),dxsNC(nrhos*numneu*ne*ne);
-
-    for(unsigned int rho = 0; rho < nrhos; rho++){
-      for(unsigned int flv = 0; flv < numneu; flv++){
-          for(unsigned int e1 = 0; e1 < ne; e1++){
-              for(unsigned int e2 = 0; e2 < ne; e2++){
-                if (e2 < e1) {
-                  dxsCC[rho*(numneu*ne*ne) +  flv*ne*ne + e1*ne + e2] = dNdE_CC[rho][flv][e1][e2];
-                  dxsNC[rho*(numneu*ne*ne) +  flv*ne*ne + e1*ne + e2] = dNdE_NC[rho][flv][e1][e2];
-                } else {
-                  dxsCC[rho*(numneu*ne*ne) +  flv*ne*ne + e1*ne + e2] = 0.0;
-                  dxsNC[rho*(numneu*ne*ne) +  flv*ne*ne + e1*ne + e2] = 0.0;
-                }
-              }
-          }
-      }
-    }
-    dset_id = H5LTmake_dataset(xs_group_id,"dNdEcc",4,dXSdim,H5T_NATIVE_DOUBLE,static_cast<void*>(dxsCC.data()));
-    dset_id = H5LTmake_dataset(xs_group_id,"dNdEnc",4,dXSdim,H5T_NATIVE_DOUBLE,static_cast<void*>(dxsNC.data()));
-
-    // invlen_tau
-    hsize_t iltdim[1] {static_cast<hsize_t>(ne)};
-    dset_id = H5LTmake_dataset(xs_group_id,"invlentau",1,iltdim,H5T_NATIVE_DOUBLE,static_cast<void*>(invlen_tau.get_data()));
-
-    // dNdE_tau_all,dNdE_tau_lep
-    hsize_t dNdEtaudim[2] {static_cast<hsize_t>(ne),
-                           static_cast<hsize_t>(ne)};
-    std::vector<double> dNdEtauall(ne*ne),dNdEtaulep(ne*ne);
-    for(unsigned int e1 = 0; e1 < ne; e1++){
-        for(unsigned int e2 = 0; e2 < ne; e2++){
-          if ( e2 < e1 ) {
-            dNdEtauall[e1*ne + e2] = dNdE_tau_all[e1][e2];
-            dNdEtaulep[e1*ne + e2] = dNdE_tau_lep[e1][e2];
-          } else  {
-            dNdEtauall[e1*ne + e2] = 0.0;
-            dNdEtaulep[e1*ne + e2] = 0.0;
-          }
-        }
-    }
-
-    dset_id = H5LTmake_dataset(xs_group_id,"dNdEtauall",2,dNdEtaudim,H5T_NATIVE_DOUBLE,static_cast<void*>(dNdEtauall.data()));
-    dset_id = H5LTmake_dataset(xs_group_id,"dNdEtaulep",2,dNdEtaudim,H5T_NATIVE_DOUBLE,static_cast<void*>(dNdEtaulep.data()));
-  }
+  if (iinteraction and save_cross_section)
+    WriteCrossSectionsHDF5(xs_group_id);
 
   // close cross section group
   H5Gclose(xs_group_id);
 
-
   // write user parameters
   hid_t user_parameters_id = H5Gcreate(group_id, "user_parameters", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
   // give control to the user and temporary restore HDF5 error messages
   //H5Eset_auto (H5E_DEFAULT,(H5E_auto_t) H5Eprint,stderr);
   AddToWriteHDF5(user_parameters_id);
   //H5Eset_auto (H5E_DEFAULT,NULL, NULL);
+  H5Gclose(user_parameters_id);
 
   // close root group
   H5Gclose ( root_id );
@@ -1247,18 +2026,7 @@ void nuSQUIDS::AddToReadHDF5(hid_t hdf5_loc_id){
 
 }
 
-void nuSQUIDS::ReadStateHDF5(std::string str,std::string grp,std::string cross_section_grp_loc){
-  hid_t file_id,group_id,root_id;
-  // open HDF5 file
-  //std::cout << "reading from hdf5 file" << std::endl;
-  file_id = H5Fopen(str.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
-  if (file_id < 0)
-      throw std::runtime_error("nuSQUIDS::Error::file not found : " + str + ".");
-  root_id = H5Gopen(file_id, "/", H5P_DEFAULT);
-  group_id = H5Gopen(root_id, grp.c_str(), H5P_DEFAULT);
-  if ( group_id < 0 )
-      throw std::runtime_error("nuSQUIDS::Error::Group '" + grp + "' does not exist in HDF5.");
-
+std::vector<double> nuSQUIDS::ReadParametersHDF5(hid_t group_id){
   // read number of neutrinos
   H5LTget_attribute_uint(group_id, "basic", "numneu", static_cast<unsigned int*>(&numneu));
   // neutrino/antineutrino/both
@@ -1274,12 +2042,6 @@ void nuSQUIDS::ReadStateHDF5(std::string str,std::string grp,std::string cross_s
   else
     iinteraction = false;
 
-  double squids_time;
-  H5LTget_attribute_double(group_id, "basic", "squids_time", &squids_time);
-
-  double squids_time_initial;
-  H5LTget_attribute_double(group_id, "basic", "squids_time_initial", &squids_time_initial);
-
   // check version numbers
   unsigned int squids_version;
   H5LTget_attribute_uint(group_id, "basic", "squids_version_number", &squids_version);
@@ -1294,7 +2056,50 @@ void nuSQUIDS::ReadStateHDF5(std::string str,std::string grp,std::string cross_s
     throw std::runtime_error("nuSQUIDS::ReadStateHDF5::Error: File was written using nuSQuIDS version " +
         std::to_string(nusquids_version) + " current version is " + std::to_string(NUSQUIDS_VERSION));
 
-  // read and set mixing parameters
+  // reading energy
+  hsize_t dims[1];
+  H5LTget_dataset_info(group_id, "energies", dims, NULL, NULL);
+  std::vector<double> energies(dims[0]);
+  H5LTread_dataset_double(group_id, "energies", energies.data());
+
+  H5LTget_attribute_string(group_id,"energies","elogscale", auxchar);
+  aux = auxchar;
+  if ( aux == "True")
+    elogscale = true;
+  else
+    elogscale = false;
+
+  return energies;
+}
+
+void nuSQUIDS::RestoreStateHDF5(hid_t group_id, const std::vector<double>& energies,
+                                double squids_time_initial, double squids_time,
+                                unsigned int body_id, std::vector<double> body_params,
+                                std::vector<double> track_params, double x_current,
+                                const double* state_data, std::shared_ptr<Body> shared_body){
+  ne = static_cast<unsigned int>(energies.size());
+
+  // setting body and track
+  SetBodyTrack(body_id,body_params.size(),body_params.data(),track_params.size(),track_params.data(),shared_body);
+
+  // set trayectory to current time
+  track->SetX(x_current);
+
+  // initializing nuSQUIDS
+  if (ne == 1){
+    if(not inusquids)
+      init(squids_time_initial);
+    Set_E(energies[0]);
+  }
+  else {
+    init(energies[0]/units.GeV,energies[ne-1]/units.GeV,ne,false,squids_time_initial);
+  }
+  // reset current squids time
+  Set_t(squids_time);
+  // set time offset
+  time_offset = squids_time - track->GetX();
+
+  // read and set mixing parameters, the initializer sets them to their default values
   for( unsigned int i = 0; i < numneu; i++ ){
     for( unsigned int j = i+1; j < numneu; j++ ){
       double th_value;
@@ -1315,23 +2120,118 @@ void nuSQUIDS::ReadStateHDF5(std::string str,std::string grp,std::string cross_s
     H5LTget_attribute_double(group_id,"massdifferences", dm2_label.c_str(), &dm2_value);
     Set_SquareMassDifference(i, dm2_value);
   }
+  SetIniFlavorProyectors();
+  iniH0();
 
-  // reading energy
-  hsize_t dims[2];
-  H5LTget_dataset_info(group_id, "energies", dims, NULL, NULL);
+  // evolve projectors to current time
+  EvolveProjectors(squids_time);
 
-  double data[dims[0]];
-  ne = static_cast<unsigned int>(dims[0]);
-  H5LTread_dataset_double(group_id, "energies", data);
-  //for (int i = 0; i < dims[0]; i ++ )
-  //  std::cout << data[i] << std::endl;
+  // reading state
+  const unsigned int numneusq = numneu*numneu;
+  for(unsigned int ie = 0; ie < ne; ie++){
+    for(unsigned int rho = 0; rho < nrhos; rho++){
+      for(unsigned int j = 0; j < numneusq; j++)
+        state[ie].rho[rho][j] = state_data[(ie*nrhos + rho)*numneusq + j];
+    }
+  }
 
-  H5LTget_attribute_string(group_id,"energies","elogscale", auxchar);
-  aux = auxchar;
-  if ( aux == "True")
-    elogscale = true;
-  else
-    elogscale = false;
+  // we assume that this was created with the writer and got to this point!
+  istate = true;
+  ienergy = true;
+  itrack = true;
+  ibody = true;
+}
+
+void nuSQUIDS::ReadCrossSectionsHDF5(hid_t xs_grp){
+  // initialize vectors
+  InitializeInteractionVectors();
+  InteractionStructure& tables = *int_struct;
+
+  // sigma_CC and sigma_NC
+  std::vector<double> xsCC(nrhos*numneu*ne), xsNC(nrhos*numneu*ne);
+  H5LTread_dataset_double(xs_grp,"sigmacc", xsCC.data());
+  H5LTread_dataset_double(xs_grp,"sigmanc", xsNC.data());
+
+  for ( unsigned int rho = 0; rho < nrhos; rho ++){
+    for ( unsigned int flv = 0; flv < numneu; flv ++){
+        for ( unsigned int ie = 0; ie < ne; ie ++){
+          tables.sigma_CC[rho][flv][ie] = xsCC[rho*(numneu*ne) +  flv*ne + ie];
+          tables.sigma_NC[rho][flv][ie] = xsNC[rho*(numneu*ne) +  flv*ne + ie];
+        }
+    }
+  }
+
+  // dNdE_CC and dNdE_NC
+  std::vector<double> dxsCC(nrhos*numneu*ne*ne), dxsNC(nrhos*numneu*ne*ne);
+  H5LTread_dataset_double(xs_grp,"dNdEcc", dxsCC.data());
+  H5LTread_dataset_double(xs_grp,"dNdEnc", dxsNC.data());
+
+  for( unsigned int rho = 0; rho < nrhos; rho++){
+    for( unsigned int flv = 0; flv < numneu; flv++){
+        for( unsigned int e1 = 0; e1 < ne; e1++){
+            for( unsigned int e2 = 0; e2 < e1; e2++){
+              tables.dNdE_CC[rho][flv][InteractionStructure::TriangularIndex(e1,e2)] = dxsCC[rho*(numneu*ne*ne) +  flv*ne*ne + e1*ne + e2];
+              if(flv == 0)
+                tables.dNdE_NC[rho][InteractionStructure::TriangularIndex(e1,e2)] = dxsNC[rho*(numneu*ne*ne) + e1*ne + e2];
+            }
+        }
+    }
+  }
+
+  // invlen_tau
+  H5LTread_dataset_double(xs_grp,"invlentau", tables.invlen_tau.get_data());
+
+  // dNdE_tau_all,dNdE_tau_lep
+  std::vector<double> dNdEtauall(ne*ne), dNdEtaulep(ne*ne);
+  H5LTread_dataset_double(xs_grp,"dNdEtauall", dNdEtauall.data());
+  H5LTread_dataset_double(xs_grp,"dNdEtaulep", dNdEtaulep.data());
+
+  for( unsigned int e1 = 0; e1 < ne; e1++){
+      for( unsigned int e2 = 0; e2 < e1; e2++){
+        tables.dNdE_tau_all[e1][e2] = dNdEtauall[e1*ne + e2];
+        tables.dNdE_tau_lep[e1][e2] = dNdEtaulep[e1*ne + e2];
+      }
+  }
+
+  InitializeInteractionKernels();
+}
+
+void nuSQUIDS::ReadStateHDF5(std::string str,std::string grp,std::string cross_section_grp_loc){
+  hid_t file_id,root_id;
+  // open HDF5 file
+  //std::cout << "reading from hdf5 file" << std::endl;
+  file_id = H5Fopen(str.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  if (file_id < 0)
+      throw std::runtime_error("nuSQUIDS::Error::file not found : " + str + ".");
+  root_id = H5Gopen(file_id, "/", H5P_DEFAULT);
+
+  try{
+    ReadGroupHDF5(root_id,grp,cross_section_grp_loc,true,nullptr);
+  } catch(...){
+    H5Gclose ( root_id );
+    H5Fclose (file_id);
+    throw;
+  }
+
+  // close root and file
+  H5Gclose ( root_id );
+  H5Fclose (file_id);
+}
+
+void nuSQUIDS::ReadGroupHDF5(hid_t root_id,std::string grp,std::string cross_section_grp_loc,
+                             bool read_cross_sections,std::shared_ptr<Body> shared_body){
+  hid_t group_id = H5Gopen(root_id, grp.c_str(), H5P_DEFAULT);
+  if ( group_id < 0 )
+      throw std::runtime_error("nuSQUIDS::Error::Group '" + grp + "' does not exist in HDF5.");
+
+  // read number of neutrinos, neutrino type, interactions, versions and energies
+  std::vector<double> energies = ReadParametersHDF5(group_id);
+
+  double squids_time;
+  H5LTget_attribute_double(group_id, "basic", "squids_time", &squids_time);
+
+  double squids_time_initial;
+  H5LTget_attribute_double(group_id, "basic", "squids_time_initial", &squids_time_initial);
 
   // reading body and track
   unsigned int body_id;
@@ -1339,63 +2239,40 @@ void nuSQUIDS::ReadStateHDF5(std::string str,std::string grp,std::string cross_s
   H5LTget_attribute_uint(group_id,"body","ID",&body_id);
 
   H5LTget_dataset_info(group_id,"body", dimbody,NULL,NULL);
-  double body_params[dimbody[0]];
-  H5LTread_dataset_double(group_id,"body", body_params);
+  std::vector<double> body_params(dimbody[0]);
+  H5LTread_dataset_double(group_id,"body", body_params.data());
 
   hsize_t dimtrack[1];
   H5LTget_dataset_info(group_id,"track", dimtrack ,NULL,NULL);
-  double track_params[dimtrack[0]];
-  H5LTread_dataset_double(group_id,"track", track_params);
+  std::vector<double> track_params(dimtrack[0]);
+  H5LTread_dataset_double(group_id,"track", track_params.data());
 
   double x_current;
   H5LTget_attribute_double(group_id,"track","X",&x_current);
 
-  // setting body and track
-  SetBodyTrack(body_id,dimbody[0],body_params,dimtrack[0],track_params);
-
-  // set trayectory to current time
-  track->SetX(x_current);
-
-  // initializing nuSQUIDS
-  if (ne == 1){
-    if(not inusquids)
-      init(squids_time_initial);
-    Set_E(data[0]);
-  }
-  else {
-    init(data[0]/units.GeV,data[ne-1]/units.GeV,ne,false,squids_time_initial);
-  }
-  // reset current squids time
-  Set_t(squids_time);
-  // set time offset
-  time_offset = squids_time - track->GetX();
-
-  // evolve projectors to current time
-  EvolveProjectors(squids_time);
   // reading state
+  hsize_t dims[2];
   H5LTget_dataset_info(group_id,"neustate", dims,NULL,NULL);
-  double neudata[dims[0]*dims[1]];
-  H5LTread_dataset_double(group_id,"neustate", neudata);
+  std::vector<double> neudata(dims[0]*dims[1]);
+  H5LTread_dataset_double(group_id,"neustate", neudata.data());
 
   H5LTget_dataset_info(group_id,"aneustate", dims,NULL,NULL);
-  double aneudata[dims[0]*dims[1]];
-  H5LTread_dataset_double(group_id,"aneustate", aneudata);
+  std::vector<double> aneudata(dims[0]*dims[1]);
+  H5LTread_dataset_double(group_id,"aneustate", aneudata.data());
 
+  // arrange it as (energy,rho,component)
+  std::vector<double> state_data;
   for(unsigned int ie = 0; ie < dims[0]; ie++){
-    for (unsigned int j = 0; j < dims[1]; j ++){
-      if (NT == neutrino)
-        state[ie].rho[0][j] = neudata[ie*dims[1]+j];
-      else if ( NT == antineutrino)
-        state[ie].rho[0][j] = aneudata[ie*dims[1]+j];
-      else if ( NT == both ){
-        state[ie].rho[0][j] = neudata[ie*dims[1]+j];
-        state[ie].rho[1][j] = aneudata[ie*dims[1]+j];
-      }
-    }
+    if ( NT == neutrino or NT == both )
+      state_data.insert(state_data.end(),&neudata[ie*dims[1]],&neudata[(ie+1)*dims[1]]);
+    if ( NT == antineutrino or NT == both )
+      state_data.insert(state_data.end(),&aneudata[ie*dims[1]],&aneudata[(ie+1)*dims[1]]);
   }
 
+  RestoreStateHDF5(group_id,energies,squids_time_initial,squids_time,
+                   body_id,body_params,track_params,x_current,state_data.data(),shared_body);
 
-  if(iinteraction){
+  if(iinteraction and read_cross_sections){
     // if intereactions will be used then reading cross section information
     hid_t xs_grp;
     if ( cross_section_grp_loc == "") {
@@ -1403,70 +2280,8 @@ void nuSQUIDS::ReadStateHDF5(std::string str,std::string grp,std::string cross_s
     } else {
       xs_grp = H5Gopen(root_id, cross_section_grp_loc.c_str(), H5P_DEFAULT);
     }
-
-    // initialize vectors
-    InitializeInteractionVectors();
-
-    // sigma_CC and sigma_NC
-
-    hsize_t XSdim[3];
-    H5LTget_dataset_info(xs_grp,"sigmacc", XSdim,NULL,NULL);
-
-    double xsCC[XSdim[0]*XSdim[1]*XSdim[2]];
-    H5LTread_dataset_double(xs_grp,"sigmacc", xsCC);
-    double xsNC[XSdim[0]*XSdim[1]*XSdim[2]];
-    H5LTread_dataset_double(xs_grp,"sigmanc", xsNC);
-
-    for ( unsigned int rho = 0; rho < nrhos; rho ++){
-      for ( unsigned int flv = 0; flv < numneu; flv ++){
-          for ( unsigned int ie = 0; ie < ne; ie ++){
-            sigma_CC[rho][flv][ie] = xsCC[rho*(numneu*ne) +  flv*ne + ie];
-            sigma_NC[rho][flv][ie] = xsNC[rho*(numneu*ne) +  flv*ne + ie];
-          }
-      }
-    }
-
-    // dNdE_CC and dNdE_NC
-    hsize_t dXSdim[4];
-    H5LTget_dataset_info(xs_grp,"dNdEcc", dXSdim,NULL,NULL);
-
-    double dxsCC[dXSdim[0]*dXSdim[1]*dXSdim[2]*dXSdim[3]];
-    H5LTread_dataset_double(xs_grp,"dNdEcc", dxsCC);
-    double dxsNC[dXSdim[0]*dXSdim[1]*dXSdim[2]*dXSdim[3]];
-    H5LTread_dataset_double(xs_grp,"dNdEnc", dxsNC);
-
-    for( unsigned int rho = 0; rho < nrhos; rho++){
-      for( unsigned int flv = 0; flv < numneu; flv++){
-          for( unsigned int e1 = 0; e1 < ne; e1++){
-              for( unsigned int e2 = 0; e2 < e1; e2++){
-                dNdE_CC[rho][flv][e1][e2] = dxsCC[rho*(numneu*ne*ne) +  flv*ne*ne + e1*ne + e2];
-                dNdE_NC[rho][flv][e1][e2] = dxsNC[rho*(numneu*ne*ne) +  flv*ne*ne + e1*ne + e2];
-              }
-          }
-      }
-    }
-
-    // invlen_tau
-    hsize_t iltdim[1];
-    H5LTget_dataset_info(xs_grp,"invlentau", iltdim,NULL,NULL);
-    double invlentau[iltdim[0]];
-    H5LTread_dataset_double(xs_grp,"invlentau", invlentau);
-    for(unsigned int ie = 0; ie < ne; ie ++)
-      invlen_tau[ie] = invlentau[ie];
-
-    // dNdE_tau_all,dNdE_tau_lep
-    hsize_t dNdEtaudim[2];
-    H5LTget_dataset_info(xs_grp,"dNdEtauall", dNdEtaudim,NULL,NULL);
-
-    double dNdEtauall[dNdEtaudim[0]*dNdEtaudim[1]];
-    double dNdEtaulep[dNdEtaudim[0]*dNdEtaudim[1]];
-
-    for( unsigned int e1 = 0; e1 < ne; e1++){
-        for( unsigned int e2 = 0; e2 < e1; e2++){
-          dNdE_tau_all[e1][e2] = dNdEtauall[e1*ne + e2];
-          dNdE_tau_lep[e1][e2] = dNdEtaulep[e1*ne + e2];
-        }
-    }
+    ReadCrossSectionsHDF5(xs_grp);
+    H5Gclose(xs_grp);
   }
 
   // read from user parameters
@@ -1476,33 +2291,24 @@ void nuSQUIDS::ReadStateHDF5(std::string str,std::string grp,std::string cross_s
   //H5Eset_auto (H5E_DEFAULT,NULL, NULL);
   H5Gclose(user_parameters_id);
 
-  // close HDF5 file
   H5Gclose ( group_id );
-  // close root and file
-  H5Gclose ( root_id );
-  H5Fclose (file_id);
-
-  // we assume that this was created with the writer and got to this point!
-  istate = true;
-  ienergy = true;
-  itrack = true;
-  ibody = true;
-  // initialize H0
-  iniH0();
 }
 
 
-void nuSQUIDS::SetBodyTrack(unsigned int body_id, unsigned int body_params_len, double body_params[], unsigned int track_params_len, double track_params[]){
+void nuSQUIDS::SetBodyTrack(unsigned int body_id, unsigned int body_params_len, double body_params[], unsigned int track_params_len, double track_params[], std::shared_ptr<Body> shared_body){
+    const bool reuse_body = shared_body != nullptr and shared_body->GetId() == body_id;
     switch(body_id){
       case 1:
         {
-          body = std::make_shared<Vacuum>();
+          if(not reuse_body)
+            body = std::make_shared<Vacuum>();
           track = std::make_shared<Vacuum::Track>(track_params[0],track_params[1]);
           break;
         }
       case 2:
         {
-          body = std::make_shared<ConstantDensity>(body_params[0],body_params[1]);
+          if(not reuse_body)
+            body = std::make_shared<ConstantDensity>(body_params[0],body_params[1]);
           track = std::make_shared<ConstantDensity::Track>(track_params[0],track_params[1]);
           break;
         }
@@ -1515,31 +2321,36 @@ void nuSQUIDS::SetBodyTrack(unsigned int body_id, unsigned int body_params_len,
             rho[i] = body_params[xn+i];
             ye[i] = body_params[2*xn+i];
           }
-          body = std::make_shared<VariableDensity>(xx,rho,ye);
+          if(not reuse_body)
+            body = std::make_shared<VariableDensity>(xx,rho,ye);
           track = std::make_shared<VariableDensity::Track>(track_params[0],track_params[1]);
           break;
         }
       case 4:
         {
-          body = std::make_shared<Earth>();
+          if(not reuse_body)
+            body = std::make_shared<Earth>();
           track = std::make_shared<Earth::Track>(track_params[0],track_params[1],track_params[2]);
           break;
         }
       case 5:
         {
-          body = std::make_shared<Sun>();
+          if(not reuse_body)
+            body = std::make_shared<Sun>();
           track = std::make_shared<Sun::Track>(track_params[0],track_params[1]);
           break;
         }
       case 6:
         {
-          body = std::make_shared<SunASnu>();
+          if(not reuse_body)
+            body = std::make_shared<SunASnu>();
           track = std::make_shared<SunASnu::Track>(track_params[0],track_params[1]);
           break;
         }
       case 7:
         {
-          body = std::make_shared<EarthAtm>();
+          if(not reuse_body)
+            body = std::make_shared<EarthAtm>();
           // track_param[2] corresponds to the zenith angle
           track = std::make_shared<EarthAtm::Track>(track_params[2]);
           break;
@@ -1551,12 +2362,20 @@ void nuSQUIDS::SetBodyTrack(unsigned int body_id, unsigned int body_params_len,
           break;
         }
     }
+    if(reuse_body)
+      body = shared_body;
+    track_profile.reset();
+    layer_boundaries_current = false;
 }
 
 unsigned int nuSQUIDS::GetNumNeu() const{
   return numneu;
 }
 
+unsigned int nuSQUIDS::GetNumRho() const{
+  return nrhos;
+}
+
 void nuSQUIDS::ProgressBar() const{
   double progress = (track->GetX()-track->GetInitialX())/(track->GetFinalX() - track->GetInitialX());
   int barWidth = 70;
@@ -1578,6 +2397,39 @@ void nuSQUIDS::Set_TauRegeneration(bool opt){
     tauregeneration = opt;
 }
 
+void nuSQUIDS::Set_FusedDerivatives(bool opt){
+    fused_derivatives = opt;
+}
+
+void nuSQUIDS::Set_TrackProfile(bool opt, double tolerance, unsigned int max_nodes){
+    if(tolerance < 0)
+      throw std::runtime_error("nuSQUIDS::Error::The track profile tolerance must be non negative.");
+    if(tolerance != track_profile_tolerance or max_nodes != track_profile_max_nodes)
+      track_profile.reset();
+    use_track_profile = opt;
+    track_profile_tolerance = tolerance;
+    track_profile_max_nodes = max_nodes;
+}
+
+void nuSQUIDS::Set_LayeredEvolution(bool opt, double max_length){
+    if(opt and iinteraction)
+      throw std::runtime_error("nuSQUIDS::Error::The layered evolution cannot be used with interactions.");
+    if(max_length < 0)
+      throw std::runtime_error("nuSQUIDS::Error::The layered evolution piece length must be non negative.");
+    layered_evolution = opt;
+    if(max_length > 0)
+      layer_max_length = max_length;
+}
+
+void nuSQUIDS::Set_ClosedFormEvolution(bool opt){
+    closed_form_evolution = opt;
+}
+
+void nuSQUIDS::Set_StopAtDiscontinuities(bool opt){
+    stop_at_discontinuities = opt;
+    step_probe = StepProbe();
+}
+
 void nuSQUIDS::Set_ProgressBar(bool opt){
     progressbar = opt;
 }
@@ -1658,17 +2510,11 @@ ne(other.ne),
 E_range(std::move(other.E_range)),
 delE(std::move(other.delE)),
 ncs(std::move(other.ncs)),
-dNdE_CC(std::move(other.dNdE_CC)),
-dNdE_NC(std::move(other.dNdE_NC)),
+int_struct(std::move(other.int_struct)),
 invlen_NC(std::move(other.invlen_NC)),
 invlen_CC(std::move(other.invlen_CC)),
 invlen_INT(std::move(other.invlen_INT)),
-sigma_CC(std::move(other.sigma_CC)),
-sigma_NC(std::move(other.sigma_NC)),
 tdc(std::move(other.tdc)),
-invlen_tau(std::move(other.invlen_tau)),
-dNdE_tau_all(std::move(other.dNdE_tau_all)),
-dNdE_tau_lep(std::move(other.dNdE_tau_lep)),
 taubr_lep(other.taubr_lep),
 tau_lifetime(other.tau_lifetime),
 tau_mass(other.tau_mass),
@@ -1676,12 +2522,20 @@ tau_reg_scale(other.tau_reg_scale),
 positivization_scale(other.positivization_scale),
 body(other.body),
 track(other.track),
+track_profile(std::move(other.track_profile)),
+use_track_profile(other.use_track_profile),
+track_profile_tolerance(other.track_profile_tolerance),
+track_profile_max_nodes(other.track_profile_max_nodes),
 DM2(other.DM2),
 H0_array(std::move(other.H0_array)),
 b0_proj(std::move(other.b0_proj)),
 b1_proj(std::move(other.b1_proj)),
 evol_b0_proj(std::move(other.evol_b0_proj)),
-evol_b1_proj(std::move(other.evol_b1_proj)),
+proj_soa(std::move(other.proj_soa)),
+phase_pairs(std::move(other.phase_pairs)),
+phase_frequencies(std::move(other.phase_frequencies)),
+soa_metric(std::move(other.soa_metric)),
+soa_scratch(std::move(other.soa_scratch)),
 inusquids(other.inusquids),
 ibody(other.ibody),
 ienergy(other.ienergy),
@@ -1692,9 +2546,19 @@ elogscale(other.elogscale),
 tauregeneration(other.tauregeneration),
 positivization(other.positivization),
 progressbar(other.progressbar),
+fused_derivatives(other.fused_derivatives),
 progressbar_count(other.progressbar_count),
 progressbar_loop(other.progressbar_loop),
-NT(other.NT)
+time_offset(other.time_offset),
+cp_symmetric_projectors(other.cp_symmetric_projectors),
+evol_proj_time(other.evol_proj_time),
+NT(other.NT),
+layered_evolution(other.layered_evolution),
+layer_max_length(other.layer_max_length),
+closed_form_evolution(other.closed_form_evolution),
+stop_at_discontinuities(other.stop_at_discontinuities),
+layer_boundaries(std::move(other.layer_boundaries)),
+layer_boundaries_current(other.layer_boundaries_current)
 {
   other.inusquids=false; //other is no longer usable, since we stole its contents
 }
@@ -1711,17 +2575,11 @@ nuSQUIDS& nuSQUIDS::operator=(nuSQUIDS&& other){
   E_range = std::move(other.E_range);
   delE = std::move(other.delE);
   ncs = other.ncs;
-  dNdE_CC = std::move(other.dNdE_CC);
-  dNdE_NC = std::move(other.dNdE_NC);
+  int_struct = std::move(other.int_struct);
   invlen_CC = std::move(other.invlen_CC);
   invlen_NC = std::move(other.invlen_NC);
   invlen_INT = std::move(other.invlen_INT);
-  sigma_CC = std::move(other.sigma_CC);
-  sigma_NC = std::move(other.sigma_NC);
   tdc = other.tdc;
-  invlen_tau = std::move(other.invlen_tau);
-  dNdE_tau_all = std::move(other.dNdE_tau_all);
-  dNdE_tau_lep = std::move(other.dNdE_tau_lep);
   taubr_lep = other.taubr_lep;
   tau_lifetime = other.tau_lifetime;
   tau_mass = other.tau_mass;
@@ -1729,12 +2587,20 @@ nuSQUIDS& nuSQUIDS::operator=(nuSQUIDS&& other){
   positivization_scale = other.positivization_scale;
   body = other.body;
   track = other.track;
+  track_profile = std::move(other.track_profile);
+  use_track_profile = other.use_track_profile;
+  track_profile_tolerance = other.track_profile_tolerance;
+  track_profile_max_nodes = other.track_profile_max_nodes;
   DM2 = other.DM2;
   H0_array = std::move(other.H0_array);
   b0_proj = std::move(other.b0_proj);
   b1_proj = std::move(other.b1_proj);
   evol_b0_proj = std::move(other.evol_b0_proj);
-  evol_b1_proj = std::move(other.evol_b1_proj);
+  proj_soa = std::move(other.proj_soa);
+  phase_pairs = std::move(other.phase_pairs);
+  phase_frequencies = std::move(other.phase_frequencies);
+  soa_metric = std::move(other.soa_metric);
+  soa_scratch = std::move(other.soa_scratch);
 
   inusquids = other.inusquids;
   ibody = other.ibody;
@@ -1746,10 +2612,20 @@ nuSQUIDS& nuSQUIDS::operator=(nuSQUIDS&& other){
   tauregeneration = other.tauregeneration;
   positivization = other.positivization;
   progressbar = other.progressbar;
+  fused_derivatives = other.fused_derivatives;
   progressbar_count = other.progressbar_count;
   progressbar_loop = other.progressbar_loop;
+  time_offset = other.time_offset;
+  cp_symmetric_projectors = other.cp_symmetric_projectors;
+  evol_proj_time = other.evol_proj_time;
 
   NT = other.NT;
+  layered_evolution = other.layered_evolution;
+  layer_max_length = other.layer_max_length;
+  closed_form_evolution = other.closed_form_evolution;
+  stop_at_discontinuities = other.stop_at_discontinuities;
+  layer_boundaries = std::move(other.layer_boundaries);
+  layer_boundaries_current = other.layer_boundaries_current;
 
   // initial nusquids object render useless
   other.inusquids = false;
@@ -0,0 +1,113 @@
+ /******************************************************************************
+ *    This program is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published by      *
+ *   the Free Software Foundation, either version 3 of the License, or         *
+ *   (at your option) any later version.                                       *
+ *                                                                             *
+ *   This program is distributed in the hope that it will be useful,           *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ *   GNU General Public License for more details.                              *
+ *                                                                             *
+ *   You should have received a copy of the GNU General Public License         *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *                                                                             *
+ *   Authors:                                                                  *
+ *      Carlos Arguelles (University of Wisconsin Madison)                     *
+ *         carguelles@icecube.wisc.edu                                         *
+ *      Jordi Salvado (University of Wisconsin Madison)                        *
+ *         jsalvado@icecube.wisc.edu                                           *
+ *      Christopher Weaver (University of Wisconsin Madison)                   *
+ *         chris.weaver@icecube.wisc.edu                                       *
+ ******************************************************************************/
+
+
+#include "scheduler.h"
+
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+
+namespace nusquids{
+
+WorkStealingScheduler::WorkStealingScheduler(unsigned int nworkers):nworkers(std::max(1u,nworkers)){}
+
+std::vector<double> WorkStealingScheduler::Run(const std::vector<double>& costs,
+                                               std::function<void(unsigned int,unsigned int)> task) const{
+  const unsigned int ntasks = costs.size();
+  std::vector<double> wall_time(ntasks,0.0);
+  if(ntasks == 0)
+    return wall_time;
+  const unsigned int nthreads = std::min(nworkers,ntasks);
+
+  // deal the tasks, most expensive first, in turns to every worker
+  std::vector<unsigned int> order(ntasks);
+  std::iota(order.begin(),order.end(),0);
+  std::stable_sort(order.begin(),order.end(),
+                   [&costs](unsigned int i, unsigned int j){ return costs[i] > costs[j]; });
+
+  std::vector<std::deque<unsigned int>> queue(nthreads);
+  std::vector<double> queued_cost(nthreads,0.0);
+  for(unsigned int k = 0; k < ntasks; k++){
+    queue[k%nthreads].push_back(order[k]);
+    queued_cost[k%nthreads] += costs[order[k]];
+  }
+
+  // the queues are short and the tasks long, so a single lock is enough
+  std::mutex queue_mutex;
+  std::atomic<bool> abort(false);
+  // the exception of the task that failed first
+  std::mutex error_mutex;
+  std::exception_ptr error;
+
+  auto next_task = [&](unsigned int worker, unsigned int& itask){
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    unsigned int victim = worker;
+    if(queue[worker].empty()){
+      // steal from the worker with the most estimated work left
+      for(unsigned int w = 0; w < nthreads; w++){
+        if(not queue[w].empty() and (queue[victim].empty() or queued_cost[w] > queued_cost[victim]))
+          victim = w;
+      }
+      if(queue[victim].empty())
+        return false;
+    }
+    itask = queue[victim].front();
+    queue[victim].pop_front();
+    queued_cost[victim] -= costs[itask];
+    return true;
+  };
+
+  auto worker = [&](unsigned int id){
+    try{
+      unsigned int itask;
+      while(not abort and next_task(id,itask)){
+        auto start = std::chrono::steady_clock::now();
+        task(itask,id);
+        wall_time[itask] = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+      }
+    } catch(...) {
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if(not error)
+        error = std::current_exception();
+      abort = true;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for(unsigned int id = 1; id < nthreads; id++)
+    threads.emplace_back(worker,id);
+  worker(0);
+  for(std::thread& t : threads)
+    t.join();
+
+  if(error)
+    std::rethrow_exception(error);
+  return wall_time;
+}
+
+} // close namespace
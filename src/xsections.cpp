@@ -23,6 +23,7 @@
 
 
 #include "xsections.h"
+#include <sys/stat.h>
 
 namespace nusquids{
 
@@ -100,6 +101,77 @@ quested below 10 GeV or above 10^9 GeV. E_nu = " + std::to_string(E1/GeV) + " [G
            LinInter(logE2,logE_data_range[loge_M2],logE_data_range[loge_M2+1],phiPM,phiPP));
 }
 
+void NeutrinoCrossSections::DifferentialCrossSections(const marray<double,1>& E, NeutrinoFlavor flavor, NeutrinoType neutype, Current current, marray<double,2>& dsde) const{
+  const size_t ne = E.extent(0);
+  dsde.resize(std::vector<size_t>{ne,ne});
+  std::fill(dsde.begin(),dsde.end(),0.0);
+  for(size_t e1 = 0; e1 < ne; e1++){
+    for(size_t e2 = 0; e2 < e1; e2++)
+      dsde[e1][e2] = DifferentialCrossSection(E[e1],E[e2],flavor,neutype,current);
+  }
+}
+
+void NeutrinoDISCrossSectionsFromTables::DifferentialCrossSections(const marray<double,1>& E, NeutrinoFlavor flavor, NeutrinoType neutype, Current current, marray<double,2>& dsde) const{
+  const size_t ne = E.extent(0);
+  dsde.resize(std::vector<size_t>{ne,ne});
+  std::fill(dsde.begin(),dsde.end(),0.0);
+  // we assume that sterile neutrinos are trully sterile
+  if (not (flavor == electron or flavor == muon or flavor == tau))
+    return;
+  if (current != CC and current != NC)
+    throw std::runtime_error("nuSQUIDS::XSECTIONS::ERROR::Current type unkwown.");
+  const marray<double,4>& dsde_data = (current == CC) ? dsde_CC_data : dsde_NC_data;
+
+  // logarithms and table bins of the energies
+  double dlogE = logE_data_range[1]-logE_data_range[0];
+  std::vector<double> logE(ne);
+  std::vector<size_t> loge_M(ne);
+  for(size_t ie = 0; ie < ne; ie++){
+    logE[ie] = log(E[ie]/GeV);
+    loge_M[ie] = static_cast<size_t>((logE[ie]-logE_data_range[0])/dlogE);
+  }
+
+  for(size_t e1 = 1; e1 < ne; e1++){
+    if ( E[e1] < Emin or E[e1] > Emax )
+      throw std::runtime_error("NeutrinoCrossSections::Init: Only DIS cross sections are included. Interpolation re\
+quested below 10 GeV or above 10^9 GeV. E_nu = " + std::to_string(E[e1]/GeV) + " [GeV].");
+    const size_t loge_M1 = loge_M[e1];
+    for(size_t e2 = 0; e2 < e1; e2++){
+      const size_t loge_M2 = loge_M[e2];
+      if ( (loge_M2 > div-1) or (loge_M1 > div-1) or (loge_M1 == loge_M2))
+        continue;
+      double phiMM = dsde_data[loge_M1][loge_M2][neutype][flavor];
+      double phiMP = dsde_data[loge_M1][loge_M2+1][neutype][flavor];
+      if ( loge_M1 == div-1 ){
+        // we are at the boundary, cannot bilinearly interpolate
+        dsde[e1][e2] = LinInter(logE[e2],logE_data_range[loge_M2],logE_data_range[loge_M2+1],
+            phiMM,phiMP);
+        continue;
+      }
+      double phiPM = dsde_data[loge_M1+1][loge_M2][neutype][flavor];
+      double phiPP = dsde_data[loge_M1+1][loge_M2+1][neutype][flavor];
+      dsde[e1][e2] = LinInter(logE[e1],logE_data_range[loge_M1],logE_data_range[loge_M1+1],
+             LinInter(logE[e2],logE_data_range[loge_M2],logE_data_range[loge_M2+1],phiMM,phiMP),
+             LinInter(logE[e2],logE_data_range[loge_M2],logE_data_range[loge_M2+1],phiPM,phiPP));
+    }
+  }
+}
+
+std::string NeutrinoDISCrossSectionsFromTables::TablesCacheKey(){
+  std::string root = XSECTION_LOCATION ;
+  std::string filename_format = "_1e+11_1e+18_500.dat";
+  std::string key = "NeutrinoDISCrossSectionsFromTables:" + root + filename_format;
+  // tables replaced in place get a different key
+  for(std::string table : {"dsde_CC","dsde_NC","sigma_CC","sigma_NC"}){
+    struct stat file_stat;
+    if(stat((root+table+filename_format).c_str(),&file_stat) != 0)
+      continue;
+    key += ":" + std::to_string(static_cast<long long>(file_stat.st_size)) +
+           ":" + std::to_string(static_cast<long long>(file_stat.st_mtime));
+  }
+  return key;
+}
+
 void NeutrinoDISCrossSectionsFromTables::Init(){
        std::string root = XSECTION_LOCATION ;
        std::string filename_format = "_1e+11_1e+18_500.dat";
@@ -0,0 +1,74 @@
+#include <nuSQuIDS/nuSQUIDS.h>
+#include <iostream>
+#include <vector>
+
+using namespace nusquids;
+
+const unsigned int numneu = 3;
+
+// the initial state depends on the zenith, as an atmospheric flux would
+marray<double,3> initial_state(double costh, size_t ne){
+  marray<double,3> state{ne,2,numneu};
+  std::fill(state.begin(),state.end(),0);
+  for ( size_t ei = 0 ; ei < ne; ei++){
+    for ( int rho = 0; rho < 2; rho ++ ){
+      state[ei][rho][0] = 0.5*(1.0 + costh*costh);
+      state[ei][rho][1] = 1.0;
+    }
+  }
+  return state;
+}
+
+void configure(nuSQUIDSAtm<>& nus_atm){
+  nus_atm.Set_MixingAngle(0,1,0.563942);
+  nus_atm.Set_MixingAngle(0,2,0.154085);
+  nus_atm.Set_MixingAngle(1,2,0.785398);
+  nus_atm.Set_SquareMassDifference(1,7.65e-05);
+  nus_atm.Set_SquareMassDifference(2,0.00247);
+  nus_atm.Set_rel_error(1.0e-10);
+  nus_atm.Set_abs_error(1.0e-10);
+}
+
+int main(){
+  const unsigned int ne = 20;
+  const unsigned int max_zenith = 25;
+  nuSQUIDSAtm<> adaptive(linspace(-1.,0.2,4),1.e2,1.e5,ne,numneu,both,true,false);
+  configure(adaptive);
+  adaptive.EvolveStateAdaptive([&](double costh){ return initial_state(costh,ne); },flavor,1.0e-2,max_zenith);
+
+  marray<double,1> costh_range = adaptive.GetCosthRange();
+  if ( costh_range.extent(0) > max_zenith )
+    std::cout << "Too many zenith nodes " << costh_range.extent(0) << std::endl;
+  if ( costh_range.extent(0) <= 5 )
+    std::cout << "The grid was not refined" << std::endl;
+  for ( size_t ci = 1 ; ci < costh_range.extent(0); ci++){
+    if ( costh_range[ci] <= costh_range[ci-1] )
+      std::cout << "Zenith nodes are not increasing at " << ci << std::endl;
+  }
+
+  // every node, old or added, must be the same as evolving that zenith directly
+  nuSQUIDSAtm<> reference(costh_range,1.e2,1.e5,ne,numneu,both,true,false);
+  configure(reference);
+  marray<double,4> inistate{costh_range.extent(0),ne,2,numneu};
+  for ( size_t ci = 0 ; ci < costh_range.extent(0); ci++){
+    marray<double,3> state = initial_state(costh_range[ci],ne);
+    std::copy(state.begin(),state.end(),&inistate[ci][0][0][0]);
+  }
+  reference.Set_initial_state(inistate,flavor);
+  reference.EvolveState();
+
+  for ( size_t ci = 0 ; ci < costh_range.extent(0); ci++){
+    for ( unsigned int ei = 0 ; ei < ne; ei++){
+      for ( int rho = 0; rho < 2; rho ++ ){
+        for ( int flv = 0; flv < numneu; flv ++){
+          double r = reference.GetnuSQuIDS(ci).EvalFlavorAtNode(flv,ei,rho);
+          double a = adaptive.GetnuSQuIDS(ci).EvalFlavorAtNode(flv,ei,rho);
+          if ( std::abs(r - a) > 1.0e-8 )
+            std::cout << "DIF " << ci << " " << ei << " " << rho << " " << flv << " " << r << " " << a << std::endl;
+        }
+      }
+    }
+  }
+
+  return 0;
+}
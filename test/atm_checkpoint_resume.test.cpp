@@ -0,0 +1,111 @@
+#include <nuSQuIDS/nuSQUIDS.h>
+#include <iostream>
+#include <cstdio>
+
+using namespace nusquids;
+
+const unsigned int numneu = 3;
+
+// exposes the piecewise evolution the checkpointing is built on
+class Resumable: public nuSQUIDS {
+  public:
+    using nuSQUIDS::EvolveInterval;
+    using nuSQUIDS::GetStateData;
+    using nuSQUIDS::GetScalarData;
+};
+
+template<typename BaseType>
+void configure(nuSQUIDSAtm<BaseType>& nus_atm){
+  nus_atm.Set_rel_error(1.0e-10);
+  nus_atm.Set_abs_error(1.0e-10);
+  nus_atm.Set_TauRegeneration(true);
+
+  marray<double,4> inistate{nus_atm.GetNumCos(),nus_atm.GetNumE(),2,numneu};
+  std::fill(inistate.begin(),inistate.end(),0);
+  for ( int ci = 0 ; ci < nus_atm.GetNumCos(); ci++){
+    for ( int ei = 0 ; ei < nus_atm.GetNumE(); ei++){
+      for ( int rho = 0; rho < 2; rho ++ ){
+        inistate[ci][ei][rho][1] = 1.0;
+        inistate[ci][ei][rho][2] = 1.0;
+      }
+    }
+  }
+  nus_atm.Set_initial_state(inistate,flavor);
+}
+
+// overwrites the row of a zenith bin in a dataset of the checkpoint
+void write_row(const std::string& filename, const std::string& name, size_t row, const std::vector<double>& data){
+  hid_t file_id = H5Fopen(filename.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+  hid_t dset_id = H5Dopen(file_id, name.c_str(), H5P_DEFAULT);
+  hid_t file_space = H5Dget_space(dset_id);
+  int rank = H5Sget_simple_extent_ndims(file_space);
+  std::vector<hsize_t> dims(rank), start(rank,0);
+  H5Sget_simple_extent_dims(file_space, dims.data(), NULL);
+  start[0] = row;
+  dims[0] = 1;
+  H5Sselect_hyperslab(file_space, H5S_SELECT_SET, start.data(), NULL, dims.data(), NULL);
+  hid_t mem_space = H5Screate_simple(rank, dims.data(), NULL);
+  H5Dwrite(dset_id, H5T_NATIVE_DOUBLE, mem_space, file_space, H5P_DEFAULT, data.data());
+  H5Sclose(mem_space);
+  H5Sclose(file_space);
+  H5Dclose(dset_id);
+  H5Fclose(file_id);
+}
+
+int main(){
+  const std::string filename = "./atm_checkpoint.hdf5";
+  const marray<double,1> costh = linspace(-1.,0.2,5);
+  const double segment = 1000.*squids::Const().km;
+
+  // uninterrupted run, leaves a finished checkpoint behind
+  nuSQUIDSAtm<> reference(costh,1.e2,1.e5,20,numneu,both,true,true);
+  configure(reference);
+  reference.Set_Checkpoint(filename,segment);
+  reference.EvolveState();
+
+  // turn it into the checkpoint of a job preempted midway: the first bin after three
+  // pieces, the third after one, the fourth not started, and the others done
+  nuSQUIDSAtm<Resumable> preempted(costh,1.e2,1.e5,20,numneu,both,true,true);
+  configure(preempted);
+  for ( auto bin : {std::make_pair(0,3),std::make_pair(2,1),std::make_pair(3,0)} ){
+    Resumable& nsq = preempted.GetnuSQuIDS(bin.first);
+    double progress = bin.second*segment;
+    for ( double x = 0; x < progress; x += segment )
+      nsq.EvolveInterval(x,x + segment);
+    write_row(filename,"state",bin.first,nsq.GetStateData());
+    write_row(filename,"checkpoint_scalars",bin.first,nsq.GetScalarData());
+    write_row(filename,"squids_time",bin.first,std::vector<double>{nsq.Get_t()});
+    write_row(filename,"checkpoint_progress",bin.first,std::vector<double>{progress});
+  }
+
+  // a new job picks up the checkpoint
+  nuSQUIDSAtm<> resumed(costh,1.e2,1.e5,20,numneu,both,true,true);
+  configure(resumed);
+  resumed.EvolveStateFromCheckpoint(filename);
+
+  std::vector<double> times = resumed.GetZenithEvolutionTimes();
+  for ( size_t ci = 0 ; ci < times.size(); ci++){
+    if ( (times[ci] == 0.0) != (ci == 1 or ci == 4) )
+      std::cout << "Zenith bin " << ci << " evolution time " << times[ci] << std::endl;
+  }
+
+  // the finished checkpoint is a regular state file
+  nuSQUIDSAtm<> read(filename);
+
+  for ( size_t ci = 0 ; ci < costh.extent(0); ci++){
+    for ( unsigned int ei = 0 ; ei < reference.GetNumE(); ei++){
+      for ( int rho = 0; rho < 2; rho ++ ){
+        for ( int flv = 0; flv < numneu; flv ++){
+          double r = reference.GetnuSQuIDS(ci).EvalFlavorAtNode(flv,ei,rho);
+          double c = resumed.GetnuSQuIDS(ci).EvalFlavorAtNode(flv,ei,rho);
+          double f = read.GetnuSQuIDS(ci).EvalFlavorAtNode(flv,ei,rho);
+          if ( std::abs(r - c) > 1.0e-9 or std::abs(r - f) > 1.0e-9 )
+            std::cout << "DIF " << ci << " " << ei << " " << rho << " " << flv << " " << r << " " << c << " " << f << std::endl;
+        }
+      }
+    }
+  }
+
+  std::remove(filename.c_str());
+  return 0;
+}
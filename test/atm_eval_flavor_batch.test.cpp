@@ -0,0 +1,78 @@
+#include <nuSQuIDS/nuSQUIDS.h>
+#include <iostream>
+#include <vector>
+#include <random>
+
+using namespace nusquids;
+
+int main(){
+  unsigned int numneu = 3;
+  nuSQUIDSAtm<> nus_atm(-1.,0.2,6,1.e2,1.e5,30,numneu,both,true,false);
+
+  nus_atm.Set_rel_error(1.0e-10);
+  nus_atm.Set_abs_error(1.0e-10);
+
+  marray<double,4> inistate{nus_atm.GetNumCos(),nus_atm.GetNumE(),2,numneu};
+  std::fill(inistate.begin(),inistate.end(),0);
+  for ( int ci = 0 ; ci < nus_atm.GetNumCos(); ci++){
+    for ( int ei = 0 ; ei < nus_atm.GetNumE(); ei++){
+      for ( int rho = 0; rho < 2; rho ++ ){
+        inistate[ci][ei][rho][1] = 1.0;
+      }
+    }
+  }
+  nus_atm.Set_initial_state(inistate,flavor);
+  nus_atm.EvolveState();
+
+  // random events, plus events sitting on the grid nodes and edges
+  const size_t nevents = 5000;
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> costh_dist(-1.,0.2);
+  std::uniform_real_distribution<double> logE_dist(log(1.e2),log(1.e5));
+  std::vector<unsigned int> flv(nevents), rho(nevents);
+  std::vector<double> costh(nevents), enu(nevents), output(nevents);
+  marray<double,1> costh_range = nus_atm.GetCosthRange();
+  marray<double,1> e_range = nus_atm.GetERange();
+  for(size_t i = 0; i < nevents; i++){
+    flv[i] = i%numneu;
+    rho[i] = (i/numneu)%2;
+    costh[i] = (i%7 == 0) ? costh_range[i%costh_range.extent(0)] : costh_dist(rng);
+    enu[i] = (i%11 == 0) ? e_range[i%e_range.extent(0)] : exp(logE_dist(rng));
+  }
+
+  nus_atm.Set_NumThreads(4);
+  nus_atm.EvalFlavorBatch(nevents,flv.data(),costh.data(),enu.data(),rho.data(),output.data());
+
+  for(size_t i = 0; i < nevents; i++){
+    double single = nus_atm.EvalFlavor(flv[i],costh[i],enu[i],rho[i]);
+    if ( single != output[i] )
+      std::cout << "DIF " << i << " " << single << " " << output[i] << std::endl;
+  }
+
+  // out of range events are reported as in EvalFlavor
+  costh[0] = 0.5;
+  try{
+    nus_atm.EvalFlavorBatch(nevents,flv.data(),costh.data(),enu.data(),rho.data(),output.data());
+    std::cout << "Out of bounds event was evaluated" << std::endl;
+  } catch(std::runtime_error& e) {}
+  costh[0] = -0.5;
+
+  // and so are flavors and equations the object does not have
+  flv[0] = numneu;
+  try{
+    nus_atm.EvalFlavorBatch(1,flv.data(),costh.data(),enu.data(),rho.data(),output.data());
+    std::cout << "Out of bounds flavor was evaluated" << std::endl;
+  } catch(std::runtime_error& e) {}
+  flv[0] = 0;
+  rho[0] = 1;
+  nuSQUIDSAtm<> nus_atm_neutrino(-1.,0.2,6,1.e2,1.e5,30,numneu,neutrino,true,false);
+  marray<double,3> inistate_neutrino{nus_atm_neutrino.GetNumCos(),nus_atm_neutrino.GetNumE(),numneu};
+  std::fill(inistate_neutrino.begin(),inistate_neutrino.end(),1.0);
+  nus_atm_neutrino.Set_initial_state(inistate_neutrino,flavor);
+  try{
+    nus_atm_neutrino.EvalFlavorBatch(1,flv.data(),costh.data(),enu.data(),rho.data(),output.data());
+    std::cout << "Antineutrino event was evaluated with neutrinos only" << std::endl;
+  } catch(std::runtime_error& e) {}
+
+  return 0;
+}
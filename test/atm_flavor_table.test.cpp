@@ -0,0 +1,58 @@
+#include <nuSQuIDS/nuSQUIDS.h>
+#include <iostream>
+#include <vector>
+#include <random>
+
+using namespace nusquids;
+
+int main(){
+  unsigned int numneu = 3;
+  nuSQUIDSAtm<> nus_atm(-1.,0.2,6,1.e2,1.e5,30,numneu,both,true,false);
+
+  nus_atm.Set_rel_error(1.0e-10);
+  nus_atm.Set_abs_error(1.0e-10);
+
+  marray<double,4> inistate{nus_atm.GetNumCos(),nus_atm.GetNumE(),2,numneu};
+  std::fill(inistate.begin(),inistate.end(),0);
+  for ( int ci = 0 ; ci < nus_atm.GetNumCos(); ci++){
+    for ( int ei = 0 ; ei < nus_atm.GetNumE(); ei++){
+      for ( int rho = 0; rho < 2; rho ++ ){
+        inistate[ci][ei][rho][1] = 1.0;
+      }
+    }
+  }
+  nus_atm.Set_initial_state(inistate,flavor);
+  nus_atm.EvolveState();
+
+  nus_atm.Set_NumThreads(4);
+  FlavorTable table = nus_atm.FreezeFlavorTable(-0.9,0.1,41,2.e2,5.e4,101);
+
+  // the nodes hold exactly what EvalFlavor returns
+  for(unsigned int ic = 0; ic < table.GetNumCos(); ic+=5){
+    for(unsigned int ie = 0; ie < table.GetNumE(); ie+=7){
+      for(unsigned int rho = 0; rho < 2; rho++){
+        for(unsigned int flv = 0; flv < numneu; flv++){
+          double expected = nus_atm.EvalFlavor(flv,table.GetCosth(ic),table.GetEnergy(ie),rho);
+          double node = table(ic,ie,rho,flv);
+          double interpolated = table.Eval(flv,table.GetCosth(ic),table.GetEnergy(ie),rho);
+          if ( node != expected or std::abs(interpolated - expected) > 1.0e-12 )
+            std::cout << "DIF " << ic << " " << ie << " " << rho << " " << flv << " " << expected << " " << node << " " << interpolated << std::endl;
+        }
+      }
+    }
+  }
+
+  // a written table is read back unchanged
+  table.Write("./atm_flavor_table.bin");
+  FlavorTable table_read("./atm_flavor_table.bin");
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> costh_dist(-0.9,0.1);
+  std::uniform_real_distribution<double> logE_dist(log(2.e2),log(5.e4));
+  for(unsigned int i = 0; i < 1000; i++){
+    double costh = costh_dist(rng), enu = exp(logE_dist(rng));
+    if ( table.Eval(i%numneu,costh,enu,i%2) != table_read.Eval(i%numneu,costh,enu,i%2) )
+      std::cout << "DIF read " << costh << " " << enu << std::endl;
+  }
+
+  return 0;
+}
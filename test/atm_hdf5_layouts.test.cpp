@@ -0,0 +1,83 @@
+#include <nuSQuIDS/nuSQUIDS.h>
+#include <iostream>
+
+using namespace nusquids;
+
+const unsigned int numneu = 3;
+
+// prints the differences between the flavor content of two bundles
+void compare(const std::string& label, nuSQUIDSAtm<>& reference, nuSQUIDSAtm<>& read){
+  if ( read.GetNumCos() != reference.GetNumCos() ){
+    std::cout << label << " has " << read.GetNumCos() << " zenith nodes" << std::endl;
+    return;
+  }
+  for ( int ci = 0 ; ci < reference.GetNumCos(); ci++){
+    for ( int ei = 0 ; ei < reference.GetNumE(); ei++){
+      for ( int rho = 0; rho < 2; rho ++ ){
+        for ( int flv = 0; flv < numneu; flv ++){
+          double r = reference.GetnuSQuIDS(ci).EvalFlavorAtNode(flv,ei,rho);
+          double m = read.GetnuSQuIDS(ci).EvalFlavorAtNode(flv,ei,rho);
+          if ( std::abs(r - m) > 1.0e-12 )
+            std::cout << label << " DIF " << ci << " " << ei << " " << rho << " " << flv << " " << r << " " << m << std::endl;
+        }
+      }
+    }
+  }
+
+  // off the nodes the mixing parameters are used to evolve the projectors
+  for ( double costh : {-0.93,-0.41,0.07} ){
+    for ( double enu : {2.3e2,7.1e3,4.4e4} ){
+      for ( int rho = 0; rho < 2; rho ++ ){
+        for ( int flv = 0; flv < numneu; flv ++){
+          double r = reference.EvalFlavor(flv,costh,enu,rho);
+          double m = read.EvalFlavor(flv,costh,enu,rho);
+          if ( std::abs(r - m) > 1.0e-12 )
+            std::cout << label << " DIF " << costh << " " << enu << " " << rho << " " << flv << " " << r << " " << m << std::endl;
+        }
+      }
+    }
+  }
+}
+
+int main(){
+  nuSQUIDSAtm<> nus_atm(linspace(-1.,0.2,5),1.e2,1.e5,20,numneu,both,true,true);
+
+  nus_atm.Set_MixingAngle(0,1,0.563942);
+  nus_atm.Set_MixingAngle(0,2,0.154085);
+  nus_atm.Set_MixingAngle(1,2,0.785398);
+  nus_atm.Set_SquareMassDifference(1,7.65e-05);
+  nus_atm.Set_SquareMassDifference(2,0.00247);
+  nus_atm.Set_CPPhase(0,2,0.3);
+
+  nus_atm.Set_rel_error(1.0e-10);
+  nus_atm.Set_abs_error(1.0e-10);
+
+  marray<double,4> inistate{nus_atm.GetNumCos(),nus_atm.GetNumE(),2,numneu};
+  std::fill(inistate.begin(),inistate.end(),0);
+  for ( int ci = 0 ; ci < nus_atm.GetNumCos(); ci++){
+    for ( int ei = 0 ; ei < nus_atm.GetNumE(); ei++){
+      for ( int rho = 0; rho < 2; rho ++ ){
+        inistate[ci][ei][rho][1] = 1.0;
+      }
+    }
+  }
+  nus_atm.Set_initial_state(inistate,flavor);
+  nus_atm.EvolveState();
+
+  nus_atm.WriteStateHDF5("./atm_consolidated.hdf5");
+  nus_atm.WriteStateHDF5("./atm_groups.hdf5",false);
+
+  nuSQUIDSAtm<> consolidated("./atm_consolidated.hdf5");
+  compare("consolidated",nus_atm,consolidated);
+  nuSQUIDSAtm<> groups("./atm_groups.hdf5");
+  compare("groups",nus_atm,groups);
+
+  if ( consolidated.GetnuSQuIDS(0).Get_MixingAngle(0,1) != nus_atm.Get_MixingAngle(0,1) )
+    std::cout << "Mixing angle was not restored" << std::endl;
+  if ( consolidated.GetnuSQuIDS(1).GetInteractionStructure() != consolidated.GetnuSQuIDS(0).GetInteractionStructure() )
+    std::cout << "Interaction tables are not shared" << std::endl;
+  if ( consolidated.GetnuSQuIDS(1).GetBody() != consolidated.GetnuSQuIDS(0).GetBody() )
+    std::cout << "Earth model is not shared" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,85 @@
+#include <nuSQuIDS/nuSQUIDS.h>
+#include <iostream>
+#include <cstdio>
+
+using namespace nusquids;
+
+const unsigned int numneu = 3;
+
+// prints the differences between the flavor content of two bundles at a zenith
+void compare(const std::string& label, nuSQUIDSAtm<>& reference, nuSQUIDSAtm<>& read, double costh){
+  for ( double enu : {2.3e2,7.1e3,4.4e4} ){
+    for ( int rho = 0; rho < 2; rho ++ ){
+      for ( int flv = 0; flv < numneu; flv ++){
+        double r = reference.EvalFlavor(flv,costh,enu,rho);
+        double m = read.EvalFlavor(flv,costh,enu,rho);
+        if ( std::abs(r - m) > 1.0e-12 )
+          std::cout << label << " DIF " << costh << " " << enu << " " << rho << " " << flv << " " << r << " " << m << std::endl;
+      }
+    }
+  }
+}
+
+int main(){
+  nuSQUIDSAtm<> nus_atm(linspace(-1.,0.2,7),1.e2,1.e5,20,numneu,both,true,true);
+
+  nus_atm.Set_rel_error(1.0e-10);
+  nus_atm.Set_abs_error(1.0e-10);
+
+  marray<double,4> inistate{nus_atm.GetNumCos(),nus_atm.GetNumE(),2,numneu};
+  std::fill(inistate.begin(),inistate.end(),0);
+  for ( int ci = 0 ; ci < nus_atm.GetNumCos(); ci++){
+    for ( int ei = 0 ; ei < nus_atm.GetNumE(); ei++){
+      for ( int rho = 0; rho < 2; rho ++ ){
+        inistate[ci][ei][rho][1] = 1.0;
+      }
+    }
+  }
+  nus_atm.Set_initial_state(inistate,flavor);
+  nus_atm.EvolveState();
+
+  for ( bool consolidated : {true,false} ){
+    std::string label = consolidated ? "consolidated" : "groups";
+    std::string filename = "./atm_lazy_" + label + ".hdf5";
+    nus_atm.WriteStateHDF5(filename,consolidated);
+
+    // only the first zenith band is used, so only its two nodes are read
+    nuSQUIDSAtm<> lazy(filename,true,false);
+    compare(label,nus_atm,lazy,-0.95);
+    if ( lazy.GetnuSQuIDS(0).GetInteractionStructure() != nullptr )
+      std::cout << label << " cross sections were read" << std::endl;
+
+    std::rename(filename.c_str(),(filename + ".moved").c_str());
+    try{
+      lazy.GetnuSQuIDS(1);
+    } catch(std::runtime_error& e) {
+      std::cout << label << " zenith node 1 was not read: " << e.what() << std::endl;
+    }
+    try{
+      lazy.GetnuSQuIDS(lazy.GetNumCos()-1);
+      std::cout << label << " last zenith node was read eagerly" << std::endl;
+    } catch(std::runtime_error& e) {}
+    std::rename((filename + ".moved").c_str(),filename.c_str());
+
+    // the rest of the nodes are read on demand
+    compare(label,nus_atm,lazy,0.15);
+    unsigned int nevents = 4;
+    std::vector<unsigned int> flv {0,1,2,1}, rho {0,1,0,1};
+    std::vector<double> costh {-0.55,-0.15,0.05,-0.85}, enu {3.e2,2.e3,5.e4,8.e3};
+    std::vector<double> output(nevents);
+    lazy.EvalFlavorBatch(nevents,flv.data(),costh.data(),enu.data(),rho.data(),output.data());
+    for ( unsigned int i = 0; i < nevents; i++){
+      double r = nus_atm.EvalFlavor(flv[i],costh[i],enu[i],rho[i]);
+      if ( std::abs(r - output[i]) > 1.0e-12 )
+        std::cout << label << " batch DIF " << i << " " << r << " " << output[i] << std::endl;
+    }
+
+    // all the nodes share the Earth model
+    for ( int ci = 1 ; ci < lazy.GetNumCos(); ci++){
+      if ( lazy.GetnuSQuIDS(ci).GetBody() != lazy.GetnuSQuIDS(0).GetBody() )
+        std::cout << label << " Earth model is not shared at " << ci << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,50 @@
+#include <nuSQuIDS/nuSQUIDS.h>
+#include <iostream>
+#include <vector>
+
+using namespace nusquids;
+
+// evolves a small atmospheric bundle with the given number of threads
+std::shared_ptr<nuSQUIDSAtm<>> evolve(unsigned int nthreads){
+  unsigned int numneu = 3;
+  auto nus_atm = std::make_shared<nuSQUIDSAtm<>>(-1.,0.2,6,1.e2,1.e5,30,numneu,both,true,false);
+
+  nus_atm->Set_rel_error(1.0e-10);
+  nus_atm->Set_abs_error(1.0e-10);
+
+  marray<double,4> inistate{nus_atm->GetNumCos(),nus_atm->GetNumE(),2,numneu};
+  std::fill(inistate.begin(),inistate.end(),0);
+  for ( int ci = 0 ; ci < nus_atm->GetNumCos(); ci++){
+    for ( int ei = 0 ; ei < nus_atm->GetNumE(); ei++){
+      for ( int rho = 0; rho < 2; rho ++ ){
+        inistate[ci][ei][rho][1] = 1.0;
+      }
+    }
+  }
+  nus_atm->Set_initial_state(inistate,flavor);
+
+  nus_atm->Set_NumThreads(nthreads);
+  nus_atm->EvolveState();
+  return nus_atm;
+}
+
+int main(){
+  auto serial = evolve(1);
+  auto parallel = evolve(4);
+
+  // the parallel evolution must reproduce the serial one exactly
+  for ( int ci = 0 ; ci < serial->GetNumCos(); ci++){
+    for ( int ei = 0 ; ei < serial->GetNumE(); ei++){
+      for ( int rho = 0; rho < 2; rho ++ ){
+        for ( int flv = 0; flv < 3; flv ++ ){
+          double s = serial->GetnuSQuIDS(ci).EvalFlavorAtNode(flv,ei,rho);
+          double p = parallel->GetnuSQuIDS(ci).EvalFlavorAtNode(flv,ei,rho);
+          if ( s != p )
+            std::cout << "DIF " << ci << " " << ei << " " << rho << " " << flv << " " << s << " " << p << std::endl;
+        }
+      }
+    }
+  }
+
+  return 0;
+}
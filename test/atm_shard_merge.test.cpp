@@ -0,0 +1,94 @@
+#include <nuSQuIDS/nuSQUIDS.h>
+#include <iostream>
+#include <vector>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace nusquids;
+
+const unsigned int numneu = 3;
+
+// evolves a small atmospheric bundle on the given zenith nodes
+std::shared_ptr<nuSQUIDSAtm<>> evolve(marray<double,1> costh_array){
+  auto nus_atm = std::make_shared<nuSQUIDSAtm<>>(costh_array,1.e2,1.e5,20,numneu,both,true,false);
+
+  nus_atm->Set_rel_error(1.0e-10);
+  nus_atm->Set_abs_error(1.0e-10);
+
+  marray<double,4> inistate{nus_atm->GetNumCos(),nus_atm->GetNumE(),2,numneu};
+  std::fill(inistate.begin(),inistate.end(),0);
+  for ( int ci = 0 ; ci < nus_atm->GetNumCos(); ci++){
+    for ( int ei = 0 ; ei < nus_atm->GetNumE(); ei++){
+      for ( int rho = 0; rho < 2; rho ++ ){
+        inistate[ci][ei][rho][1] = 1.0;
+      }
+    }
+  }
+  nus_atm->Set_initial_state(inistate,flavor);
+  nus_atm->EvolveState();
+  return nus_atm;
+}
+
+int main(){
+  marray<double,1> costh_array = linspace(-1.,0.2,6);
+  const unsigned int nshards = 3;
+
+  // every shard is computed by a separate process
+  std::vector<std::string> shard_files;
+  std::vector<pid_t> children;
+  for(unsigned int ishard = 0; ishard < nshards; ishard++){
+    std::string filename = "./atm_shard_" + std::to_string(ishard) + ".hdf5";
+    shard_files.push_back(filename);
+    pid_t pid = fork();
+    if(pid == 0){
+      try{
+        evolve(GetAtmShardZenithRange(costh_array,ishard,nshards))->WriteStateHDF5(filename);
+      } catch(std::exception& e) {
+        std::cout << e.what() << std::endl;
+        _exit(1);
+      }
+      _exit(0);
+    }
+    children.push_back(pid);
+  }
+
+  auto reference = evolve(costh_array);
+
+  for(pid_t pid : children){
+    int status;
+    waitpid(pid,&status,0);
+    if(not WIFEXITED(status) or WEXITSTATUS(status) != 0)
+      std::cout << "Shard process failed" << std::endl;
+  }
+
+  // merge the shards in reverse order, the merged table must be sorted anyway
+  std::reverse(shard_files.begin(),shard_files.end());
+  MergeAtmStateHDF5(shard_files,"./atm_shard_merged.hdf5");
+  nuSQUIDSAtm<> merged("./atm_shard_merged.hdf5");
+
+  if ( merged.GetNumCos() != reference->GetNumCos() )
+    std::cout << "Merged table has " << merged.GetNumCos() << " zenith nodes" << std::endl;
+
+  for ( int ci = 0 ; ci < reference->GetNumCos(); ci++){
+    if ( merged.GetCosthRange()[ci] != reference->GetCosthRange()[ci] )
+      std::cout << "DIF costh " << ci << " " << merged.GetCosthRange()[ci] << std::endl;
+    for ( int ei = 0 ; ei < reference->GetNumE(); ei++){
+      for ( int rho = 0; rho < 2; rho ++ ){
+        for ( int flv = 0; flv < numneu; flv ++){
+          double r = reference->GetnuSQuIDS(ci).EvalFlavorAtNode(flv,ei,rho);
+          double m = merged.GetnuSQuIDS(ci).EvalFlavorAtNode(flv,ei,rho);
+          if ( std::abs(r - m) > 1.0e-12 )
+            std::cout << "DIF " << ci << " " << ei << " " << rho << " " << flv << " " << r << " " << m << std::endl;
+        }
+      }
+    }
+  }
+
+  // a shard cannot be merged with itself
+  try{
+    MergeAtmStateHDF5({shard_files[0],shard_files[0]},"./atm_shard_merged.hdf5");
+    std::cout << "Duplicated zenith nodes were merged" << std::endl;
+  } catch(std::runtime_error& e) {}
+
+  return 0;
+}
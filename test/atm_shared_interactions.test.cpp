@@ -0,0 +1,62 @@
+#include <nuSQuIDS/nuSQUIDS.h>
+#include <iostream>
+
+using namespace nusquids;
+
+int main(){
+  unsigned int numneu = 3;
+  auto ncs = std::make_shared<NeutrinoDISCrossSectionsFromTables>();
+  nuSQUIDSAtm<> nus_atm(-1.,0.2,3,1.e2,1.e6,20,numneu,both,true,true,ncs);
+
+  // all zeniths use the tables of the first one
+  auto int_struct = nus_atm.GetnuSQuIDS(0).GetInteractionStructure();
+  if ( int_struct == nullptr )
+    std::cout << "Interaction tables were not built" << std::endl;
+  for ( int ci = 1 ; ci < nus_atm.GetNumCos(); ci++){
+    if ( nus_atm.GetnuSQuIDS(ci).GetInteractionStructure() != int_struct )
+      std::cout << "Zenith " << ci << " does not share the interaction tables" << std::endl;
+  }
+
+  marray<double,4> inistate{nus_atm.GetNumCos(),nus_atm.GetNumE(),2,numneu};
+  std::fill(inistate.begin(),inistate.end(),0);
+  marray<double,3> inistate_single{nus_atm.GetNumE(),2,numneu};
+  std::fill(inistate_single.begin(),inistate_single.end(),0);
+  marray<double,1> e_range = nus_atm.GetERange();
+  for ( int ci = 0 ; ci < nus_atm.GetNumCos(); ci++){
+    for ( int ei = 0 ; ei < nus_atm.GetNumE(); ei++){
+      for ( int rho = 0; rho < 2; rho ++ ){
+        inistate[ci][ei][rho][1] = pow(e_range[ei],-2.0);
+        inistate_single[ei][rho][1] = pow(e_range[ei],-2.0);
+      }
+    }
+  }
+  nus_atm.Set_rel_error(1.0e-8);
+  nus_atm.Set_abs_error(1.0e-8);
+  nus_atm.Set_initial_state(inistate,flavor);
+  nus_atm.EvolveState();
+
+  // a zenith evolved on its own, with its own tables, gives the same result
+  unsigned int ci = 1;
+  nuSQUIDS nus(1.e2,1.e6,20,numneu,both,true,true,ncs);
+  nus.Set_Body(std::make_shared<EarthAtm>());
+  nus.Set_Track(std::make_shared<EarthAtm::Track>(acos(nus_atm.GetCosthRange()[ci])));
+  nus.Set_rel_error(1.0e-8);
+  nus.Set_abs_error(1.0e-8);
+  nus.Set_initial_state(inistate_single,flavor);
+  nus.EvolveState();
+
+  if ( nus.GetInteractionStructure() == int_struct )
+    std::cout << "Independent object shares the interaction tables" << std::endl;
+  for ( int ei = 0 ; ei < nus.GetNumE(); ei++){
+    for ( int rho = 0; rho < 2; rho ++ ){
+      for ( int flv = 0; flv < numneu; flv ++){
+        double a = nus_atm.GetnuSQuIDS(ci).EvalFlavorAtNode(flv,ei,rho);
+        double b = nus.EvalFlavorAtNode(flv,ei,rho);
+        if ( a != b )
+          std::cout << "DIF " << ei << " " << rho << " " << flv << " " << a << " " << b << std::endl;
+      }
+    }
+  }
+
+  return 0;
+}
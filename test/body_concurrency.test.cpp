@@ -0,0 +1,70 @@
+#include <nuSQuIDS/nuSQUIDS.h>
+#include <iostream>
+#include <thread>
+
+using namespace nusquids;
+
+// Evaluates the body along the track and stores density and ye at each step.
+template<typename TrackType>
+std::vector<double> profile(const Body& body, TrackType track, unsigned int nsteps){
+  std::vector<double> values;
+  double xini = track.GetInitialX(), xend = track.GetFinalX();
+  for(unsigned int i = 0; i <= nsteps; i++){
+    track.SetX(xini + (xend-xini)*i/nsteps);
+    values.push_back(body.density(track));
+    values.push_back(body.ye(track));
+  }
+  return values;
+}
+
+// Evaluates the same body from several threads, each with its own track, and
+// compares the profiles to the ones computed serially.
+template<typename BodyType, typename TrackType>
+void check(const std::string& name, std::shared_ptr<BodyType> body, const std::vector<TrackType>& tracks){
+  const unsigned int nsteps = 2000;
+  if(not body->IsThreadSafe())
+    std::cout << name << " is not thread safe" << std::endl;
+  std::vector<std::vector<double>> expected;
+  for(const TrackType& track : tracks)
+    expected.push_back(profile(*body,track,nsteps));
+
+  const unsigned int nthreads = 8;
+  std::vector<unsigned int> mismatches(nthreads,0);
+  std::vector<std::thread> threads;
+  for(unsigned int t = 0; t < nthreads; t++){
+    threads.emplace_back([&,t](){
+      for(unsigned int repeat = 0; repeat < 10; repeat++){
+        size_t i = (t + repeat)%tracks.size();
+        if(profile(*body,tracks[i],nsteps) != expected[i])
+          mismatches[t]++;
+      }
+    });
+  }
+  for(std::thread& thread : threads)
+    thread.join();
+  for(unsigned int t = 0; t < nthreads; t++){
+    if(mismatches[t] != 0)
+      std::cout << name << ": thread " << t << " found " << mismatches[t] << " mismatching profiles" << std::endl;
+  }
+}
+
+int main(){
+  squids::Const units;
+
+  std::vector<Earth::Track> earth_tracks;
+  for(double baseline : {500.,3000.,8000.,12000.})
+    earth_tracks.emplace_back(baseline*units.km);
+  check("Earth",std::make_shared<Earth>(),earth_tracks);
+
+  std::vector<EarthAtm::Track> earth_atm_tracks;
+  for(double costh : {-1.,-0.7,-0.3,-0.05})
+    earth_atm_tracks.emplace_back(acos(costh));
+  check("EarthAtm",std::make_shared<EarthAtm>(),earth_atm_tracks);
+
+  std::vector<Sun::Track> sun_tracks;
+  for(double fraction : {0.2,0.5,0.9,1.})
+    sun_tracks.emplace_back(fraction*695980.*units.km);
+  check("Sun",std::make_shared<Sun>(),sun_tracks);
+
+  return 0;
+}
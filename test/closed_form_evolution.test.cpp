@@ -0,0 +1,84 @@
+#include <nuSQuIDS/nuSQUIDS.h>
+#include <iostream>
+#include <vector>
+
+using namespace nusquids;
+
+// counts the right hand side evaluations
+class CountingSQUIDS: public nuSQUIDS {
+  public:
+    using nuSQUIDS::nuSQUIDS;
+    unsigned long evaluations = 0;
+  protected:
+    void AddToPreDerive(double x){ evaluations++; }
+};
+
+// evolves a muon neutrino and antineutrino flux
+template<typename NUSQUIDS = nuSQUIDS>
+NUSQUIDS evolve(std::shared_ptr<Body> body, std::shared_ptr<Track> track, bool closed_form,
+                double th12 = 0.58, double th13 = 0.15){
+  NUSQUIDS nus(0.1,10.,40,3,both,true,false);
+  nus.Set_Body(body);
+  nus.Set_Track(track);
+  nus.Set_rel_error(1.0e-12);
+  nus.Set_abs_error(1.0e-12);
+  nus.Set_MixingAngle(0,1,th12);
+  nus.Set_MixingAngle(0,2,th13);
+  nus.Set_MixingAngle(1,2,0.7);
+  nus.Set_SquareMassDifference(1,7.5e-5);
+  nus.Set_SquareMassDifference(2,2.5e-3);
+  nus.Set_CPPhase(0,2,1.);
+  nus.Set_ClosedFormEvolution(closed_form);
+
+  marray<double,3> inistate{nus.GetNumE(),2,3};
+  std::fill(inistate.begin(),inistate.end(),0);
+  for ( unsigned int ei = 0 ; ei < nus.GetNumE(); ei++)
+    inistate[ei][0][1] = inistate[ei][1][1] = 1.;
+  nus.Set_initial_state(inistate,flavor);
+  nus.EvolveState();
+  return nus;
+}
+
+int main(){
+  squids::Const units;
+  const double baseline = 1300.*units.km;
+  auto vacuum = std::make_shared<Vacuum>();
+  auto vacuum_track = std::make_shared<Vacuum::Track>(baseline);
+
+  // the closed form agrees with the integration in vacuum and in matter
+  std::vector<std::pair<std::shared_ptr<Body>,std::shared_ptr<Track>>> cases {
+    {vacuum,vacuum_track},
+    {std::make_shared<ConstantDensity>(2.8,0.5),std::make_shared<ConstantDensity::Track>(baseline)}};
+  for ( auto& c : cases ){
+    nuSQUIDS integrated = evolve(c.first,c.second,false);
+    nuSQUIDS closed_form = evolve(c.first,c.second,true);
+    for ( unsigned int ei = 0 ; ei < integrated.GetNumE(); ei++){
+      for ( unsigned int rho = 0; rho < 2; rho++){
+        for ( unsigned int flv = 0; flv < 3; flv++){
+          double a = integrated.EvalFlavorAtNode(flv,ei,rho);
+          double b = closed_form.EvalFlavorAtNode(flv,ei,rho);
+          if ( std::abs(a - b) > 1.0e-6 )
+            std::cout << "DIF " << ei << " " << rho << " " << flv << " " << a << " " << b << std::endl;
+        }
+      }
+    }
+  }
+
+  // and is exact: with a single mixing angle the survival probability is the two flavor one
+  nuSQUIDS two_flavor = evolve(vacuum,vacuum_track,true,0.,0.);
+  for ( unsigned int ei = 0 ; ei < two_flavor.GetNumE(); ei++){
+    double phase = (2.5e-3 - 7.5e-5)*baseline/(4.*two_flavor.GetERange()[ei]);
+    double expected = 1. - pow(sin(1.4),2)*pow(sin(phase),2);
+    for ( unsigned int rho = 0; rho < 2; rho++){
+      if ( std::abs(two_flavor.EvalFlavorAtNode(1,ei,rho) - expected) > 1.0e-9 )
+        std::cout << "Survival probability " << ei << " " << rho << " "
+                  << two_flavor.EvalFlavorAtNode(1,ei,rho) << " " << expected << std::endl;
+    }
+  }
+
+  // derived classes are integrated
+  if ( evolve<CountingSQUIDS>(vacuum,vacuum_track,true).evaluations == 0 )
+    std::cout << "A derived class was evolved in closed form" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,41 @@
+#include <nuSQuIDS/nuSQUIDS.h>
+#include <iostream>
+
+using namespace nusquids;
+
+template<typename T>
+bool same(const T& a, const T& b){
+  return a.size() == b.size() and std::equal(a.begin(),a.end(),b.begin());
+}
+
+int main(){
+  squids::Const units;
+  // the batched differential cross sections are the ones of each pair of energies
+  NeutrinoDISCrossSectionsFromTables xs;
+  marray<double,1> E = logspace(1.e2*units.GeV,1.e6*units.GeV,39);
+  marray<double,2> batched, pairs;
+  for (auto neutype : {NeutrinoCrossSections::neutrino,NeutrinoCrossSections::antineutrino}){
+    for (auto flavor : {NeutrinoCrossSections::electron,NeutrinoCrossSections::muon,NeutrinoCrossSections::tau}){
+      for (auto current : {NeutrinoCrossSections::CC,NeutrinoCrossSections::NC}){
+        xs.DifferentialCrossSections(E,flavor,neutype,current,batched);
+        xs.NeutrinoCrossSections::DifferentialCrossSections(E,flavor,neutype,current,pairs);
+        if ( not same(batched,pairs) )
+          std::cout << "Batched cross sections differ " << neutype << " " << flavor << " " << current << std::endl;
+      }
+    }
+  }
+
+  // the tables do not depend on the number of threads computing them
+  nuSQUIDS::Set_InteractionThreads(1);
+  nuSQUIDS serial(1.e2,1.e6,40,3,both,true,true);
+  nuSQUIDS::Set_InteractionThreads(4);
+  nuSQUIDS parallel(1.e2,1.e6,40,3,both,true,true);
+  nuSQUIDS::Set_InteractionThreads(0);
+  auto s = serial.GetInteractionStructure();
+  auto p = parallel.GetInteractionStructure();
+  if ( not same(s->dNdE_CC,p->dNdE_CC) or not same(s->dNdE_NC,p->dNdE_NC) or
+       not same(s->dNdE_tau_all,p->dNdE_tau_all) or not same(s->dNdE_tau_lep,p->dNdE_tau_lep) )
+    std::cout << "Tables depend on the number of threads" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,68 @@
+#include <nuSQuIDS/nuSQUIDS.h>
+#include <iostream>
+#include <vector>
+
+using namespace nusquids;
+
+// records where along the track the right hand side is evaluated
+class RecordingSQUIDS: public nuSQUIDS {
+  public:
+    using nuSQUIDS::nuSQUIDS;
+    std::vector<double> positions;
+  protected:
+    void AddToPreDerive(double x){ positions.push_back(GetTrack()->GetX()); }
+};
+
+std::vector<double> evolve(bool stop_at_discontinuities, std::vector<double>& positions){
+  squids::Const units;
+  RecordingSQUIDS nus(1.,1.e2,20,3,neutrino,true,false);
+  nus.Set_Body(std::make_shared<Earth>());
+  nus.Set_Track(std::make_shared<Earth::Track>(12000.*units.km));
+  nus.Set_rel_error(1.0e-10);
+  nus.Set_abs_error(1.0e-10);
+  nus.Set_h_max(500.*units.km);
+  nus.Set_StopAtDiscontinuities(stop_at_discontinuities);
+
+  marray<double,2> inistate{nus.GetNumE(),3};
+  std::fill(inistate.begin(),inistate.end(),0);
+  for ( unsigned int ei = 0 ; ei < nus.GetNumE(); ei++)
+    inistate[ei][1] = 1.;
+  nus.Set_initial_state(inistate,flavor);
+  nus.EvolveState();
+
+  std::vector<double> probabilities;
+  for ( unsigned int ei = 0 ; ei < nus.GetNumE(); ei++){
+    for ( unsigned int flv = 0; flv < 3; flv++)
+      probabilities.push_back(nus.EvalFlavorAtNode(flv,ei));
+  }
+  positions = nus.positions;
+  return probabilities;
+}
+
+int main(){
+  std::vector<double> continuous_positions, stopped_positions;
+  std::vector<double> continuous = evolve(false,continuous_positions);
+  std::vector<double> stopped = evolve(true,stopped_positions);
+
+  for ( unsigned int i = 0; i < continuous.size(); i++){
+    if ( std::abs(continuous[i] - stopped[i]) > 1.0e-6 )
+      std::cout << "DIF " << i << " " << continuous[i] << " " << stopped[i] << std::endl;
+  }
+  // a step starts at every boundary inside the track
+  Earth::Track track(12000.*squids::Const().km);
+  for ( double boundary : Earth().GetLayerBoundaries(track) ){
+    if ( boundary <= 0 or boundary >= track.GetFinalX() )
+      continue;
+    bool reached = false;
+    for ( double x : stopped_positions )
+      reached = reached or std::abs(x - boundary) <= 1.0e-9*track.GetFinalX();
+    if ( not reached )
+      std::cout << "No step starts at the boundary at " << boundary << std::endl;
+  }
+  // no step straddles the ends of the core mantle ramp, so fewer steps are rejected
+  if ( stopped_positions.size() >= continuous_positions.size() )
+    std::cout << "Stopping took " << stopped_positions.size() << " evaluations, "
+              << continuous_positions.size() << " without stopping" << std::endl;
+
+  return 0;
+}
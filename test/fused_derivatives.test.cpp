@@ -0,0 +1,67 @@
+#include <nuSQuIDS/nuSQUIDS.h>
+#include <iostream>
+
+using namespace nusquids;
+
+// exposes the terms of the right hand side at a given position; it does not change
+// them, so it declares itself the type for which the fused terms may be used
+class Probe: public nuSQUIDS {
+  public:
+    using nuSQUIDS::nuSQUIDS;
+    void EvaluateAt(double x){ PreDerive(x); }
+    squids::SU_vector Term(unsigned int term, unsigned int ie, unsigned int irho) const {
+      if ( term == 0 )
+        return HI(ie,irho);
+      if ( term == 1 )
+        return GammaRho(ie,irho);
+      return InteractionsRho(ie,irho);
+    }
+  protected:
+    const std::type_info& FusedTermsType() const override { return typeid(Probe); }
+};
+
+void configure(Probe& nus, Basis basis, NeutrinoType NT, bool fused){
+  const unsigned int numneu = nus.GetNumNeu();
+  nus.Set_Body(std::make_shared<Earth>());
+  nus.Set_Track(std::make_shared<Earth::Track>(10000.*nus.units.km));
+  nus.Set_CPPhase(0,2,1.0);
+  nus.Set_Basis(basis);
+  nus.Set_TauRegeneration(NT == both);
+  nus.Set_FusedDerivatives(fused);
+  const unsigned int nrho = (NT == both) ? 2 : 1;
+  marray<double,3> inistate{nus.GetNumE(),nrho,numneu};
+  for ( unsigned int ei = 0 ; ei < nus.GetNumE(); ei++)
+    for ( unsigned int rho = 0; rho < nrho; rho ++ )
+      for ( unsigned int flv = 0; flv < numneu; flv ++)
+        inistate[ei][rho][flv] = 1.0 + 0.1*flv + 0.05*rho;
+  nus.Set_initial_state(inistate,flavor);
+  nus.EvaluateAt(3000.*nus.units.km);
+}
+
+int main(){
+  // the fused terms are the per node ones, also with a sterile neutrino
+  for (unsigned int numneu : {3u, 4u}){
+    for (Basis basis : {interaction, mass}){
+      for (NeutrinoType NT : {neutrino, antineutrino, both}){
+        Probe reference(1.e2,1.e6,20,numneu,NT,true,true);
+        Probe fused(1.e2,1.e6,20,numneu,NT,true,true);
+        configure(reference,basis,NT,false);
+        configure(fused,basis,NT,true);
+        for ( unsigned int term = 0; term < 3; term++){
+          for ( unsigned int ei = 0 ; ei < reference.GetNumE(); ei++){
+            for ( unsigned int rho = 0; rho < ((NT == both) ? 2 : 1); rho ++ ){
+              squids::SU_vector r = reference.Term(term,ei,rho);
+              squids::SU_vector f = fused.Term(term,ei,rho);
+              for ( unsigned int i = 0; i < numneu*numneu; i++){
+                if ( r[i] != f[i] )
+                  std::cout << "DIF " << numneu << " " << basis << " " << NT << " " << term << " " << ei << " " << rho << " " << i
+                            << " " << r[i] << " " << f[i] << std::endl;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,93 @@
+#include <nuSQuIDS/nuSQUIDS.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <dirent.h>
+
+using namespace nusquids;
+
+template<typename T>
+bool same(const T& a, const T& b){
+  return a.size() == b.size() and std::equal(a.begin(),a.end(),b.begin());
+}
+
+std::vector<std::string> list_files(const std::string& directory){
+  std::vector<std::string> files;
+  DIR* dir = opendir(directory.c_str());
+  while ( dirent* entry = readdir(dir) ){
+    std::string name = entry->d_name;
+    if ( name != "." and name != ".." )
+      files.push_back(directory + "/" + name);
+  }
+  closedir(dir);
+  return files;
+}
+
+// overwrites the first occurrence of a value in a file
+bool replace_value(const std::string& file, double value, double replacement){
+  std::ifstream in(file,std::ios::binary);
+  std::stringstream buffer;
+  buffer << in.rdbuf();
+  in.close();
+  std::string content = buffer.str();
+  size_t position = content.find(std::string(reinterpret_cast<const char*>(&value),sizeof(double)));
+  if ( position == std::string::npos )
+    return false;
+  std::memcpy(&content[position],&replacement,sizeof(double));
+  std::ofstream out(file,std::ios::binary);
+  out << content;
+  return true;
+}
+
+int main(){
+  unsigned int numneu = 3;
+  char directory[] = "/tmp/nusquids_cacheXXXXXX";
+  if ( mkdtemp(directory) == nullptr ){
+    std::cout << "Could not create the cache directory" << std::endl;
+    return 1;
+  }
+
+  nuSQUIDS reference(1.e2,1.e6,30,numneu,both,true,true);
+
+  // the first object computes the tables and writes them
+  nuSQUIDS::Set_InteractionCacheDirectory(directory);
+  nuSQUIDS first(1.e2,1.e6,30,numneu,both,true,true);
+  // the second one reads them, which the marked value shows
+  auto ref = reference.GetInteractionStructure();
+  const double marker = 1.2345;
+  std::vector<std::string> files = list_files(directory);
+  if ( files.size() != 1 or not replace_value(files[0],ref->sigma_CC[0][0][0],marker) )
+    std::cout << "Could not mark the cache file" << std::endl;
+  nuSQUIDS second(1.e2,1.e6,30,numneu,both,true,true);
+  // a different grid does not use the same file
+  nuSQUIDS other(1.e2,1.e6,31,numneu,both,true,true);
+  nuSQUIDS::Set_InteractionCacheDirectory("");
+
+  for ( const nuSQUIDS* nus : {&first,&second} ){
+    auto tables = nus->GetInteractionStructure();
+    marray<double,3> sigma_CC = ref->sigma_CC;
+    if ( nus == &second )
+      sigma_CC[0][0][0] = marker;
+    if ( not same(tables->sigma_CC,sigma_CC) or not same(tables->sigma_NC,ref->sigma_NC) or
+         not same(tables->dNdE_CC,ref->dNdE_CC) or not same(tables->dNdE_NC,ref->dNdE_NC) or
+         not same(tables->invlen_tau,ref->invlen_tau) or
+         not same(tables->dNdE_tau_all,ref->dNdE_tau_all) or not same(tables->dNdE_tau_lep,ref->dNdE_tau_lep) or
+         not same(tables->tau_cc_kernel,ref->tau_cc_kernel) )
+      std::cout << "Cached tables differ from the expected ones" << std::endl;
+  }
+  if ( other.GetInteractionStructure()->sigma_CC.extent(2) != 31 )
+    std::cout << "Tables of a different grid were read" << std::endl;
+
+  // one file per grid, and no temporary files left
+  files = list_files(directory);
+  if ( files.size() != 2 )
+    std::cout << "Unexpected number of cache files " << files.size() << std::endl;
+
+  for ( const std::string& file : files )
+    unlink(file.c_str());
+  rmdir(directory);
+  return 0;
+}
@@ -0,0 +1,78 @@
+#include <nuSQuIDS/nuSQUIDS.h>
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+
+using namespace nusquids;
+
+// evolves a muon neutrino and antineutrino flux, integrating the equations or composing layers
+nuSQUIDS evolve(std::shared_ptr<Body> body, std::shared_ptr<Track> track, Basis basis, bool layered){
+  nuSQUIDS nus(1.,1.e2,20,3,both,true,false);
+  nus.Set_Body(body);
+  nus.Set_Track(track);
+  nus.Set_Basis(basis);
+  nus.Set_rel_error(1.0e-12);
+  nus.Set_abs_error(1.0e-12);
+  nus.Set_ClosedFormEvolution(false);
+  nus.Set_LayeredEvolution(layered,20.*nus.units.km);
+
+  marray<double,3> inistate{nus.GetNumE(),2,3};
+  std::fill(inistate.begin(),inistate.end(),0);
+  for ( unsigned int ei = 0 ; ei < nus.GetNumE(); ei++)
+    inistate[ei][0][1] = inistate[ei][1][1] = 1.;
+  nus.Set_initial_state(inistate,flavor);
+  nus.EvolveState();
+  return nus;
+}
+
+void compare(const std::string& name, std::shared_ptr<Body> body, std::shared_ptr<Track> track, double tolerance){
+  for ( Basis basis : {interaction,mass} ){
+    nuSQUIDS integrated = evolve(body,track,basis,false);
+    nuSQUIDS layered = evolve(body,track,basis,true);
+    for ( unsigned int ei = 0 ; ei < integrated.GetNumE(); ei++){
+      for ( unsigned int rho = 0; rho < 2; rho++){
+        for ( unsigned int flv = 0; flv < 3; flv++){
+          double a = integrated.EvalFlavorAtNode(flv,ei,rho);
+          double b = layered.EvalFlavorAtNode(flv,ei,rho);
+          if ( std::abs(a - b) > tolerance )
+            std::cout << name << " DIF " << basis << " " << ei << " " << rho << " " << flv << " " << a << " " << b << std::endl;
+        }
+      }
+    }
+  }
+}
+
+int main(){
+  squids::Const units;
+
+  // a diameter crosses the two nodes around each of the five inner discontinuities
+  // of PREM twice, and the node below the surface at both ends
+  Earth earth;
+  Earth::Track diameter(2.*earth.GetRadius()*units.km);
+  std::vector<double> boundaries = earth.GetLayerBoundaries(diameter);
+  if ( boundaries.size() != 22 )
+    std::cout << "Found " << boundaries.size() << " layer boundaries along the diameter" << std::endl;
+  if ( not std::is_sorted(boundaries.begin(),boundaries.end()) )
+    std::cout << "The layer boundaries are not sorted" << std::endl;
+
+  // a coarser two layer model with gradients in both layers has a single discontinuity
+  const std::string model = "./layered_evolution_model.dat";
+  std::ofstream file(model);
+  for ( unsigned int i = 0; i <= 50; i++){
+    double r = 0.02*i;
+    file << r << " " << ((r < 0.5) ? 12. - 6.*r*r : 5. - 2.*r) << " " << 0.47 << std::endl;
+  }
+  file.close();
+  Earth two_layers(model);
+  std::remove(model.c_str());
+  if ( two_layers.GetLayerBoundaries(diameter).size() != 4 )
+    std::cout << "Found " << two_layers.GetLayerBoundaries(diameter).size() << " boundaries in the two layer model" << std::endl;
+
+  // a single constant layer is exact
+  compare("ConstantDensity",std::make_shared<ConstantDensity>(5.,0.5),
+          std::make_shared<ConstantDensity::Track>(1300.*units.km),1.0e-8);
+  // and PREM is approximated by 20 km pieces
+  compare("Earth",std::make_shared<Earth>(),std::make_shared<Earth::Track>(8000.*units.km),2.0e-3);
+
+  return 0;
+}
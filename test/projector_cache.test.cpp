@@ -0,0 +1,93 @@
+#include <nuSQuIDS/nuSQUIDS.h>
+#include <iostream>
+
+using namespace nusquids;
+
+// exposes the evolved flavor projectors
+class ProjectorSQUIDS: public nuSQUIDS {
+  public:
+    using nuSQUIDS::nuSQUIDS;
+    void EvaluateAt(double x){ PreDerive(x); }
+    squids::SU_vector Projector(unsigned int rho, unsigned int flv, unsigned int ei) const {
+      return EvolvedFlavorProj(rho,flv,ei);
+    }
+    // the projector evolved node by node with SU_vector::Evolve
+    squids::SU_vector Expected(unsigned int rho, unsigned int flv, unsigned int ei, double x) const {
+      return b1_proj[rho][flv].Evolve(H0_array[ei],x - Get_t_initial());
+    }
+    const squids::SU_vector& Initial(unsigned int rho, unsigned int flv) const { return b1_proj[rho][flv]; }
+};
+
+// checks the structure of arrays evolution against SU_vector::Evolve
+void check_evolution(const ProjectorSQUIDS& nus, double x, unsigned int numneu){
+  for ( unsigned int rho = 0; rho < 2; rho++){
+    for ( unsigned int flv = 0; flv < numneu; flv++){
+      squids::SU_vector initial = nus.GetFlavorProj(flv,rho);
+      for ( unsigned int i = 0; i < numneu*numneu; i++){
+        if ( initial[i] != nus.Initial(rho,flv)[i] )
+          std::cout << "Flavor projector " << numneu << " " << rho << " " << flv << " " << i << std::endl;
+      }
+      for ( unsigned int ei = 0; ei < nus.GetNumE(); ei++){
+        squids::SU_vector projector = nus.Projector(rho,flv,ei);
+        squids::SU_vector expected = nus.Expected(rho,flv,ei,x);
+        for ( unsigned int i = 0; i < numneu*numneu; i++){
+          if ( std::abs(projector[i] - expected[i]) > 1.0e-10 )
+            std::cout << "Evolved projector " << numneu << " " << rho << " " << flv << " " << ei << " " << i << " "
+                      << projector[i] << " " << expected[i] << std::endl;
+        }
+      }
+    }
+  }
+}
+
+void configure(ProjectorSQUIDS& nus, double th13, double dm31){
+  nus.Set_Body(std::make_shared<ConstantDensity>(3.,0.5));
+  nus.Set_Track(std::make_shared<ConstantDensity::Track>(1000.*nus.units.km));
+  nus.Set_MixingAngle(0,2,th13);
+  nus.Set_SquareMassDifference(2,dm31);
+  marray<double,3> inistate{nus.GetNumE(),2,3};
+  std::fill(inistate.begin(),inistate.end(),1.);
+  nus.Set_initial_state(inistate,flavor);
+}
+
+int main(){
+  const double x = 500.*squids::Const().km;
+  ProjectorSQUIDS reused(1.,1.e2,10,3,both,true,false);
+  configure(reused,0.15,2.5e-3);
+  reused.EvolveState();
+  reused.EvaluateAt(x);
+
+  // the projectors evaluated again at the same position follow the new parameters
+  for ( auto parameters : {std::make_pair(0.3,2.5e-3),std::make_pair(0.3,1.e-3)} ){
+    configure(reused,parameters.first,parameters.second);
+    reused.EvaluateAt(x);
+    ProjectorSQUIDS fresh(1.,1.e2,10,3,both,true,false);
+    configure(fresh,parameters.first,parameters.second);
+    fresh.EvaluateAt(x);
+    check_evolution(fresh,x,3);
+    for ( unsigned int rho = 0; rho < 2; rho++){
+      for ( unsigned int flv = 0; flv < 3; flv++){
+        for ( unsigned int ei = 0; ei < fresh.GetNumE(); ei++){
+          for ( unsigned int i = 0; i < 9; i++){
+            if ( reused.Projector(rho,flv,ei)[i] != fresh.Projector(rho,flv,ei)[i] )
+              std::cout << "Stale projector " << parameters.first << " " << parameters.second << " "
+                        << rho << " " << flv << " " << ei << " " << i << std::endl;
+          }
+        }
+      }
+    }
+  }
+  // with a sterile neutrino and CP violation, so that the antineutrinos are evolved
+  ProjectorSQUIDS sterile(1.,1.e2,10,4,both,true,false);
+  sterile.Set_Body(std::make_shared<ConstantDensity>(3.,0.5));
+  sterile.Set_Track(std::make_shared<ConstantDensity::Track>(1000.*sterile.units.km));
+  sterile.Set_MixingAngle(1,3,0.1);
+  sterile.Set_SquareMassDifference(3,1.);
+  sterile.Set_CPPhase(0,2,1.);
+  marray<double,3> inistate{sterile.GetNumE(),2,4};
+  std::fill(inistate.begin(),inistate.end(),1.);
+  sterile.Set_initial_state(inistate,flavor);
+  sterile.EvaluateAt(x);
+  check_evolution(sterile,x,4);
+  return 0;
+}
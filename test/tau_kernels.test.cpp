@@ -0,0 +1,94 @@
+#include <nuSQuIDS/nuSQUIDS.h>
+#include <iostream>
+
+using namespace nusquids;
+
+// exposes the tau regeneration terms and the tables they are built from
+class TauSQUIDS: public nuSQUIDS {
+  public:
+    using nuSQUIDS::nuSQUIDS;
+    void EvaluateAt(double x){ PreDerive(x); }
+    void Decay(){ ConvertTauIntoNuTau(); }
+
+    // width of the initial energy node, the last node takes the one of the last interval
+    double Width(unsigned int e2) const { return delE[(e2 + 1 < ne) ? e2 : ne - 2]; }
+
+    // tau production as summed node by node before the kernels
+    double LoopProduction(unsigned int ei, unsigned int iscalar) const {
+      double nutautoleptau = 0.0;
+      for(unsigned int e2 = ei + 1; e2 < ne; e2++)
+        nutautoleptau += (EvolvedFlavorProj(iscalar,2,e2)*state[e2].rho[iscalar])*
+                         (invlen_CC[iscalar][2][e2])*(int_struct->dNdE_CC[iscalar][2][InteractionStructure::TriangularIndex(e2,ei)])*Width(e2);
+      return nutautoleptau;
+    }
+    double KernelProduction(unsigned int ei, unsigned int iscalar) const {
+      return InteractionsScalar(ei,iscalar);
+    }
+
+    // tau decay as summed node by node before the kernels
+    std::vector<squids::SU_vector> LoopDecay() const {
+      std::vector<squids::SU_vector> rho;
+      for(unsigned int e1 = 0; e1 < ne; e1++){
+        double tau_neu_all = 0.0, tau_neu_lep = 0.0, tau_aneu_all = 0.0, tau_aneu_lep = 0.0;
+        for(unsigned int e2 = e1 + 1; e2 < ne; e2++){
+          tau_neu_all  += int_struct->dNdE_tau_all[e2][e1]*Width(e2)*state[e2].scalar[0];
+          tau_neu_lep  += int_struct->dNdE_tau_lep[e2][e1]*Width(e2)*state[e2].scalar[0];
+          tau_aneu_all += int_struct->dNdE_tau_all[e2][e1]*Width(e2)*state[e2].scalar[1];
+          tau_aneu_lep += int_struct->dNdE_tau_lep[e2][e1]*Width(e2)*state[e2].scalar[1];
+        }
+        rho.push_back(state[e1].rho[0] + tau_neu_all*EvolvedFlavorProj(0,2,e1) +
+                      tau_aneu_lep*EvolvedFlavorProj(0,0,e1) + tau_aneu_lep*EvolvedFlavorProj(0,1,e1));
+        rho.push_back(state[e1].rho[1] + tau_aneu_all*EvolvedFlavorProj(1,2,e1) +
+                      tau_neu_lep*EvolvedFlavorProj(1,0,e1) + tau_neu_lep*EvolvedFlavorProj(1,1,e1));
+      }
+      return rho;
+    }
+    void SetTauFlux(unsigned int ei, double tau, double antitau){
+      state[ei].scalar[0] = tau;
+      state[ei].scalar[1] = antitau;
+    }
+    const squids::SU_vector& Rho(unsigned int ei, unsigned int irho) const { return state[ei].rho[irho]; }
+};
+
+bool close(double a, double b){
+  return std::abs(a - b) <= 1.0e-12*std::max(std::abs(a),std::abs(b)) + 1.0e-300;
+}
+
+int main(){
+  squids::Const units;
+  TauSQUIDS nus(1.e2,1.e6,40,3,both,true,true);
+  nus.Set_TauRegeneration(true);
+  nus.Set_Body(std::make_shared<ConstantDensity>(5.,0.5));
+  nus.Set_Track(std::make_shared<ConstantDensity::Track>(1000.*units.km));
+  marray<double,3> inistate{nus.GetNumE(),2,3};
+  for ( unsigned int ei = 0 ; ei < nus.GetNumE(); ei++)
+    for ( unsigned int rho = 0; rho < 2; rho++)
+      for ( unsigned int flv = 0; flv < 3; flv++)
+        inistate[ei][rho][flv] = 1. + 0.1*flv + 0.01*rho + 0.001*ei;
+  nus.Set_initial_state(inistate,flavor);
+  nus.EvaluateAt(500.*units.km);
+
+  for ( unsigned int iscalar = 0; iscalar < 2; iscalar++){
+    for ( unsigned int ei = 0 ; ei < nus.GetNumE(); ei++){
+      double loop = nus.LoopProduction(ei,iscalar);
+      double kernel = nus.KernelProduction(ei,iscalar);
+      if ( not close(loop,kernel) )
+        std::cout << "Production " << iscalar << " " << ei << " " << loop << " " << kernel << std::endl;
+    }
+  }
+
+  for ( unsigned int ei = 0 ; ei < nus.GetNumE(); ei++)
+    nus.SetTauFlux(ei,1.e-3*(ei + 1),2.e-3*(nus.GetNumE() - ei));
+  std::vector<squids::SU_vector> expected = nus.LoopDecay();
+  nus.Decay();
+  for ( unsigned int ei = 0 ; ei < nus.GetNumE(); ei++){
+    for ( unsigned int rho = 0; rho < 2; rho++){
+      for ( unsigned int i = 0; i < 9; i++){
+        if ( not close(expected[2*ei + rho][i],nus.Rho(ei,rho)[i]) )
+          std::cout << "Decay " << ei << " " << rho << " " << i << " "
+                    << expected[2*ei + rho][i] << " " << nus.Rho(ei,rho)[i] << std::endl;
+      }
+    }
+  }
+  return 0;
+}
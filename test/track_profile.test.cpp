@@ -0,0 +1,86 @@
+#include <nuSQuIDS/nuSQUIDS.h>
+#include <iostream>
+
+using namespace nusquids;
+
+// Checks that the profile follows the body everywhere, on both sides of every discontinuity.
+void check_profile(const std::string& name, const Body& body, Track& track, double tolerance){
+  TrackProfile profile(body,track,tolerance);
+  if(profile.GetError() > tolerance and profile.GetNodes() < 1u<<14)
+    std::cout << name << ": the profile stopped refining early with error " << profile.GetError() << std::endl;
+
+  const unsigned int nsteps = 100000;
+  double xini = track.GetInitialX(), xend = track.GetFinalX();
+  std::vector<double> positions;
+  for(unsigned int i = 0; i < nsteps; i++)
+    positions.push_back(xini + (xend-xini)*(i+0.5)/nsteps);
+  std::vector<double> boundaries = body.GetLayerBoundaries(track);
+  for(double boundary : boundaries){
+    positions.push_back(boundary - 1.0e-6*(xend-xini));
+    positions.push_back(boundary + 1.0e-6*(xend-xini));
+  }
+  if(profile.GetSegments() != boundaries.size() + 1)
+    std::cout << name << ": " << profile.GetSegments() << " pieces for " << boundaries.size() << " boundaries" << std::endl;
+
+  double largest = 0, difference = 0;
+  for(double x : positions){
+    track.SetX(x);
+    largest = std::max(largest,body.density(track));
+    difference = std::max(difference,std::abs(body.density(track) - profile.density(x)));
+    if(std::abs(body.ye(track) - profile.ye(x)) > 10*tolerance)
+      std::cout << name << ": electron fraction differs at x = " << x << std::endl;
+  }
+  if(difference > 10*tolerance*largest)
+    std::cout << name << ": largest relative difference of the profile " << difference/largest << std::endl;
+}
+
+int main(){
+  squids::Const units;
+  const double tolerance = 1.0e-4;
+
+  auto earth = std::make_shared<Earth>();
+  for(double baseline : {500.,6000.,12700.}){
+    Earth::Track track(baseline*units.km);
+    check_profile("Earth",*earth,track,tolerance);
+  }
+
+  auto earth_atm = std::make_shared<EarthAtm>();
+  for(double costh : {-1.,-0.5,0.3}){
+    EarthAtm::Track track(acos(costh));
+    check_profile("EarthAtm",*earth_atm,track,tolerance);
+  }
+
+  // the node limit is honoured, and the track is left where it was
+  Earth::Track track(12000.*units.km);
+  track.SetX(100.*units.km);
+  TrackProfile coarse(*earth,track,1.0e-12,65);
+  if(coarse.GetNodes() > 65 or coarse.GetError() <= 1.0e-12)
+    std::cout << "The profile has " << coarse.GetNodes() << " nodes and error " << coarse.GetError() << std::endl;
+  if(track.GetX() != 100.*units.km)
+    std::cout << "The profile moved the track to " << track.GetX() << std::endl;
+
+  // the oscillation probabilities do not change when the profile is used
+  nuSQUIDS reference(1.,30.,10,3,neutrino,true,false), profiled(1.,30.,10,3,neutrino,true,false);
+  marray<double,2> inistate{reference.GetNumE(),3};
+  std::fill(inistate.begin(),inistate.end(),0);
+  for(unsigned int ei = 0; ei < reference.GetNumE(); ei++)
+    inistate[ei][1] = 1.;
+  for(nuSQUIDS* nus : {&reference,&profiled}){
+    nus->Set_Body(earth);
+    nus->Set_Track(std::make_shared<Earth::Track>(12000.*units.km));
+    nus->Set_TrackProfile(nus == &profiled,tolerance);
+    nus->Set_initial_state(inistate,flavor);
+    nus->EvolveState();
+  }
+  if(profiled.GetTrackProfile() == nullptr)
+    std::cout << "The profile was not built" << std::endl;
+  for(unsigned int ei = 0; ei < reference.GetNumE(); ei++){
+    for(unsigned int flv = 0; flv < 3; flv++){
+      if(std::abs(profiled.EvalFlavorAtNode(flv,ei) - reference.EvalFlavorAtNode(flv,ei)) > 1.0e-3)
+        std::cout << "Probability " << ei << " " << flv << " differs: " << profiled.EvalFlavorAtNode(flv,ei)
+                  << " " << reference.EvalFlavorAtNode(flv,ei) << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,80 @@
+#include <nuSQuIDS/scheduler.h>
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <map>
+#include <stdexcept>
+
+using namespace nusquids;
+
+int main(){
+  // every task runs exactly once, and each worker on a single thread
+  for ( unsigned int nworkers : {1u,3u,8u} ){
+    const unsigned int ntasks = 40;
+    std::vector<double> costs;
+    for ( unsigned int i = 0; i < ntasks; i++)
+      costs.push_back((i*7)%11 + 1.);
+    std::vector<std::atomic<int>> runs(ntasks);
+    for ( auto& r : runs )
+      r = 0;
+    std::mutex thread_mutex;
+    std::map<unsigned int,std::thread::id> threads;
+    bool consistent = true;
+
+    WorkStealingScheduler scheduler(nworkers);
+    std::vector<double> times = scheduler.Run(costs,[&](unsigned int itask, unsigned int worker){
+      runs[itask]++;
+      std::lock_guard<std::mutex> lock(thread_mutex);
+      auto thread = threads.emplace(worker,std::this_thread::get_id()).first;
+      consistent = consistent and worker < scheduler.GetNumWorkers() and thread->second == std::this_thread::get_id();
+    });
+    if ( times.size() != ntasks )
+      std::cout << nworkers << " workers returned " << times.size() << " times" << std::endl;
+    for ( unsigned int i = 0; i < ntasks; i++){
+      if ( runs[i] != 1 or times[i] < 0 )
+        std::cout << nworkers << " workers ran task " << i << " " << runs[i] << " times" << std::endl;
+    }
+    if ( not consistent )
+      std::cout << nworkers << " workers moved between threads" << std::endl;
+  }
+
+  if ( not WorkStealingScheduler(4).Run({},[](unsigned int, unsigned int){}).empty() )
+    std::cout << "Times returned without tasks" << std::endl;
+
+  // a single worker starts with the most expensive task, and stops at the first failure
+  std::atomic<int> started(0);
+  try{
+    WorkStealingScheduler(1).Run({1.,3.,2.},[&](unsigned int itask, unsigned int){
+      started++;
+      throw std::runtime_error("task " + std::to_string(itask));
+    });
+    std::cout << "The failure was not rethrown" << std::endl;
+  } catch(std::runtime_error& e){
+    if ( std::string(e.what()) != "task 1" or started != 1 )
+      std::cout << "Rethrew '" << e.what() << "' after " << started << " tasks" << std::endl;
+  }
+
+  // with several workers the exception that was thrown first is rethrown,
+  // even when a worker with a lower index fails later
+  std::atomic<bool> failed(false);
+  try{
+    WorkStealingScheduler(2).Run({2.,1.},[&](unsigned int itask, unsigned int){
+      if ( itask == 1 ){
+        failed = true;
+        throw std::runtime_error("first");
+      }
+      while ( not failed )
+        std::this_thread::yield();
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      throw std::runtime_error("second");
+    });
+    std::cout << "The failure was not rethrown" << std::endl;
+  } catch(std::runtime_error& e){
+    if ( std::string(e.what()) != "first" )
+      std::cout << "Rethrew '" << e.what() << "' instead of the first failure" << std::endl;
+  }
+
+  return 0;
+}